@@ -163,80 +163,104 @@ static const uint16_t frontalface_weak_feature_idx[] = {
     1,   121, 38,  17, 100, 63,  101, 118, 92,  10,  131, 83,  135, 115, 64,  36,  93, 91,  107,
 };
 
-static const float frontalface_weak_left_val[] = {
-    -0.654321014881134f, -0.773921608924866f, -0.706856310367584f, -0.808373570442200f,
-    -0.769841015338898f, -0.750655889511108f, -0.777599036693573f, -0.560188293457031f,
-    -0.612452626228333f, -0.611449658870697f, -0.685407757759094f, -0.405109494924545f,
-    -0.738816261291504f, -0.658294379711151f, -0.598132371902466f, -0.649878799915314f,
-    -0.527819573879242f, -0.520650506019592f, -0.751606106758118f, -0.763931393623352f,
-    -0.512376904487610f, -0.376317411661148f, -0.535276591777802f, -0.567837417125702f,
-    -0.570626258850098f, -0.534460186958313f, -0.770034849643707f, -0.504366874694824f,
-    -0.680804073810577f, -0.492759138345718f, -0.644510746002197f, -0.530755698680878f,
-    -0.522763431072235f, -0.498357266187668f, -0.499086052179337f, -0.569500923156738f,
-    -0.659040510654449f, -0.497277677059174f, -0.438315898180008f, -0.638610541820526f,
-    -0.551279425621033f, -0.641875505447388f, -0.484190136194229f, -0.585573434829712f,
-    -0.251847654581070f, -0.430343240499497f, -0.425955355167389f, -0.560558915138245f,
-    -0.519265651702881f, -0.501307725906372f, -0.463141411542893f, -0.394971609115601f,
-    -0.485588550567627f, -0.462028533220291f, -0.642064332962036f, -0.482011288404465f,
-    -0.446555256843567f, -0.519058644771576f, -0.432380944490433f, -0.458873271942139f,
-    -0.521855354309082f, -0.492000073194504f, -0.449456810951233f, -0.518082678318024f,
-    -0.608124077320099f, -0.179019391536713f, -0.368102461099625f, -0.321723252534866f,
-    -0.437328457832336f, -0.440483689308167f, -0.429415225982666f, -0.397305250167847f,
-    -0.705468356609344f, -0.590594768524170f, -0.444920480251312f, -0.469381868839264f,
-    -0.360035121440888f, -0.445989191532135f, -0.446606904268265f, -0.339495629072189f,
-    -0.534651219844818f, -0.437933564186096f, -0.267098635435104f, -0.414984434843063f,
-    -0.498589158058167f, -0.456872999668121f, -0.477083683013916f, -0.487771511077881f,
-    -0.372165471315384f, -0.393419504165649f, -0.432330071926117f, -0.499327868223190f,
-    -0.331022530794144f, -0.526656091213226f, -0.417188882827759f, -0.455670535564423f,
-    -0.418252974748612f, -0.362536966800690f, -0.474292516708374f, -0.366627156734467f,
-    -0.456763744354248f, -0.405511796474457f, -0.378789722919464f, -0.425832897424698f,
-    -0.456102311611175f, -0.431467264890671f, -0.417454332113266f, -0.432136476039886f,
-    -0.501838624477386f, -0.503750562667847f, -0.244819641113281f, -0.463328391313553f,
-    -0.373109906911850f, -0.365890949964523f, -0.521438419818878f, -0.428903698921204f,
-    -0.462154239416122f, -0.371154844760895f, -0.518065214157104f, -0.259259253740311f,
-    -0.380119591951370f, -0.350911706686020f, -0.406875729560852f, -0.455714106559753f,
-    -0.411780327558518f, -0.400839775800705f, -0.569418966770172f, -0.319534122943878f,
-    -0.336533904075623f, -0.420454531908035f, -0.376255393028259f, -0.425349742174149f,
-    -0.360199809074402f, -0.403429388999939f, -0.362089961767197f, -0.390381664037705f,
-    -0.359144538640976f, -0.429767042398453f, -0.572700679302216f,
+static const gs_real frontalface_weak_left_val[] = {
+    GS_REAL(-0.654321014881134f), GS_REAL(-0.773921608924866f), GS_REAL(-0.706856310367584f),
+    GS_REAL(-0.808373570442200f), GS_REAL(-0.769841015338898f), GS_REAL(-0.750655889511108f),
+    GS_REAL(-0.777599036693573f), GS_REAL(-0.560188293457031f), GS_REAL(-0.612452626228333f),
+    GS_REAL(-0.611449658870697f), GS_REAL(-0.685407757759094f), GS_REAL(-0.405109494924545f),
+    GS_REAL(-0.738816261291504f), GS_REAL(-0.658294379711151f), GS_REAL(-0.598132371902466f),
+    GS_REAL(-0.649878799915314f), GS_REAL(-0.527819573879242f), GS_REAL(-0.520650506019592f),
+    GS_REAL(-0.751606106758118f), GS_REAL(-0.763931393623352f), GS_REAL(-0.512376904487610f),
+    GS_REAL(-0.376317411661148f), GS_REAL(-0.535276591777802f), GS_REAL(-0.567837417125702f),
+    GS_REAL(-0.570626258850098f), GS_REAL(-0.534460186958313f), GS_REAL(-0.770034849643707f),
+    GS_REAL(-0.504366874694824f), GS_REAL(-0.680804073810577f), GS_REAL(-0.492759138345718f),
+    GS_REAL(-0.644510746002197f), GS_REAL(-0.530755698680878f), GS_REAL(-0.522763431072235f),
+    GS_REAL(-0.498357266187668f), GS_REAL(-0.499086052179337f), GS_REAL(-0.569500923156738f),
+    GS_REAL(-0.659040510654449f), GS_REAL(-0.497277677059174f), GS_REAL(-0.438315898180008f),
+    GS_REAL(-0.638610541820526f), GS_REAL(-0.551279425621033f), GS_REAL(-0.641875505447388f),
+    GS_REAL(-0.484190136194229f), GS_REAL(-0.585573434829712f), GS_REAL(-0.251847654581070f),
+    GS_REAL(-0.430343240499497f), GS_REAL(-0.425955355167389f), GS_REAL(-0.560558915138245f),
+    GS_REAL(-0.519265651702881f), GS_REAL(-0.501307725906372f), GS_REAL(-0.463141411542893f),
+    GS_REAL(-0.394971609115601f), GS_REAL(-0.485588550567627f), GS_REAL(-0.462028533220291f),
+    GS_REAL(-0.642064332962036f), GS_REAL(-0.482011288404465f), GS_REAL(-0.446555256843567f),
+    GS_REAL(-0.519058644771576f), GS_REAL(-0.432380944490433f), GS_REAL(-0.458873271942139f),
+    GS_REAL(-0.521855354309082f), GS_REAL(-0.492000073194504f), GS_REAL(-0.449456810951233f),
+    GS_REAL(-0.518082678318024f), GS_REAL(-0.608124077320099f), GS_REAL(-0.179019391536713f),
+    GS_REAL(-0.368102461099625f), GS_REAL(-0.321723252534866f), GS_REAL(-0.437328457832336f),
+    GS_REAL(-0.440483689308167f), GS_REAL(-0.429415225982666f), GS_REAL(-0.397305250167847f),
+    GS_REAL(-0.705468356609344f), GS_REAL(-0.590594768524170f), GS_REAL(-0.444920480251312f),
+    GS_REAL(-0.469381868839264f), GS_REAL(-0.360035121440888f), GS_REAL(-0.445989191532135f),
+    GS_REAL(-0.446606904268265f), GS_REAL(-0.339495629072189f), GS_REAL(-0.534651219844818f),
+    GS_REAL(-0.437933564186096f), GS_REAL(-0.267098635435104f), GS_REAL(-0.414984434843063f),
+    GS_REAL(-0.498589158058167f), GS_REAL(-0.456872999668121f), GS_REAL(-0.477083683013916f),
+    GS_REAL(-0.487771511077881f), GS_REAL(-0.372165471315384f), GS_REAL(-0.393419504165649f),
+    GS_REAL(-0.432330071926117f), GS_REAL(-0.499327868223190f), GS_REAL(-0.331022530794144f),
+    GS_REAL(-0.526656091213226f), GS_REAL(-0.417188882827759f), GS_REAL(-0.455670535564423f),
+    GS_REAL(-0.418252974748612f), GS_REAL(-0.362536966800690f), GS_REAL(-0.474292516708374f),
+    GS_REAL(-0.366627156734467f), GS_REAL(-0.456763744354248f), GS_REAL(-0.405511796474457f),
+    GS_REAL(-0.378789722919464f), GS_REAL(-0.425832897424698f), GS_REAL(-0.456102311611175f),
+    GS_REAL(-0.431467264890671f), GS_REAL(-0.417454332113266f), GS_REAL(-0.432136476039886f),
+    GS_REAL(-0.501838624477386f), GS_REAL(-0.503750562667847f), GS_REAL(-0.244819641113281f),
+    GS_REAL(-0.463328391313553f), GS_REAL(-0.373109906911850f), GS_REAL(-0.365890949964523f),
+    GS_REAL(-0.521438419818878f), GS_REAL(-0.428903698921204f), GS_REAL(-0.462154239416122f),
+    GS_REAL(-0.371154844760895f), GS_REAL(-0.518065214157104f), GS_REAL(-0.259259253740311f),
+    GS_REAL(-0.380119591951370f), GS_REAL(-0.350911706686020f), GS_REAL(-0.406875729560852f),
+    GS_REAL(-0.455714106559753f), GS_REAL(-0.411780327558518f), GS_REAL(-0.400839775800705f),
+    GS_REAL(-0.569418966770172f), GS_REAL(-0.319534122943878f), GS_REAL(-0.336533904075623f),
+    GS_REAL(-0.420454531908035f), GS_REAL(-0.376255393028259f), GS_REAL(-0.425349742174149f),
+    GS_REAL(-0.360199809074402f), GS_REAL(-0.403429388999939f), GS_REAL(-0.362089961767197f),
+    GS_REAL(-0.390381664037705f), GS_REAL(-0.359144538640976f), GS_REAL(-0.429767042398453f),
+    GS_REAL(-0.572700679302216f),
 };
 
-static const float frontalface_weak_right_val[] = {
-    0.888888895511627f, 0.727863371372223f, 0.676153421401978f, 0.768569648265839f,
-    0.659291565418243f, 0.544460594654083f, 0.546546161174774f, 0.774311304092407f,
-    0.697812795639038f, 0.653762817382812f, 0.540323913097382f, 0.758403360843658f,
-    0.534084320068359f, 0.533949673175812f, 0.532350480556488f, 0.491335064172745f,
-    0.694637238979340f, 0.632992029190063f, 0.423202425241470f, 0.412356883287430f,
-    0.579183459281921f, 0.729823350906372f, 0.565948009490967f, 0.496147990226746f,
-    0.457228839397430f, 0.467205405235291f, 0.594394087791443f, 0.615127444267273f,
-    0.466732591390610f, 0.540188550949097f, 0.422782212495804f, 0.625817954540253f,
-    0.504974603652954f, 0.510644137859344f, 0.506050705909729f, 0.446046739816666f,
-    0.361642450094223f, 0.602707445621490f, 0.596623718738556f, 0.397799998521805f,
-    0.428207963705063f, 0.354986608028412f, 0.466801941394806f, 0.387913584709167f,
-    0.708865404129028f, 0.528328835964203f, 0.544080913066864f, 0.422073334455490f,
-    0.439985543489456f, 0.457025468349457f, 0.479024618864060f, 0.608203232288361f,
-    0.478536993265152f, 0.498966902494430f, 0.362435191869736f, 0.463214069604874f,
-    0.506178855895996f, 0.444148033857346f, 0.566376805305481f, 0.454703301191330f,
-    0.411109238862991f, 0.432672530412674f, 0.444851070642471f, 0.388897269964218f,
-    0.333322227001190f, 0.660597205162048f, 0.513974964618683f, 0.617155313491821f,
-    0.435818523168564f, 0.460122019052505f, 0.445216178894043f, 0.485452681779862f,
-    0.269799739122391f, 0.510193288326263f, 0.449070930480957f, 0.406109482049942f,
-    0.505632698535919f, 0.413241565227508f, 0.413506776094437f, 0.565864503383636f,
-    0.358447939157486f, 0.412364512681961f, 0.601414322853088f, 0.467088818550110f,
-    0.371958494186401f, 0.396581202745438f, 0.386260151863098f, 0.377898633480072f,
-    0.499440014362335f, 0.476964145898819f, 0.434216409921646f, 0.366537809371948f,
-    0.562462627887726f, 0.370440304279327f, 0.454043567180633f, 0.370426207780838f,
-    0.426723122596741f, 0.468465626239777f, 0.368950724601746f, 0.458012729883194f,
-    0.389470815658569f, 0.548794507980347f, 0.453200340270996f, 0.420279175043106f,
-    0.400274783372879f, 0.408634662628174f, 0.424986898899078f, 0.409083873033524f,
-    0.370253384113312f, 0.356498122215271f, 0.568970918655396f, 0.358792960643768f,
-    0.429045557975769f, 0.455647319555283f, 0.322103738784790f, 0.400495618581772f,
-    0.383274853229523f, 0.461270153522492f, 0.320587038993836f, 0.587301611900330f,
-    0.471882730722427f, 0.509480714797974f, 0.413013637065888f, 0.353979200124741f,
-    0.411859244108200f, 0.403475701808929f, 0.296476274728775f, 0.529401898384094f,
-    0.506745874881744f, 0.516574561595917f, 0.407530277967453f, 0.372805535793304f,
-    0.456325620412826f, 0.416081696748734f, 0.459414273500443f, 0.438145935535431f,
-    0.462407886981964f, 0.402329355478287f, 0.299593478441238f,
+static const gs_real frontalface_weak_right_val[] = {
+    GS_REAL(0.888888895511627f), GS_REAL(0.727863371372223f), GS_REAL(0.676153421401978f),
+    GS_REAL(0.768569648265839f), GS_REAL(0.659291565418243f), GS_REAL(0.544460594654083f),
+    GS_REAL(0.546546161174774f), GS_REAL(0.774311304092407f), GS_REAL(0.697812795639038f),
+    GS_REAL(0.653762817382812f), GS_REAL(0.540323913097382f), GS_REAL(0.758403360843658f),
+    GS_REAL(0.534084320068359f), GS_REAL(0.533949673175812f), GS_REAL(0.532350480556488f),
+    GS_REAL(0.491335064172745f), GS_REAL(0.694637238979340f), GS_REAL(0.632992029190063f),
+    GS_REAL(0.423202425241470f), GS_REAL(0.412356883287430f), GS_REAL(0.579183459281921f),
+    GS_REAL(0.729823350906372f), GS_REAL(0.565948009490967f), GS_REAL(0.496147990226746f),
+    GS_REAL(0.457228839397430f), GS_REAL(0.467205405235291f), GS_REAL(0.594394087791443f),
+    GS_REAL(0.615127444267273f), GS_REAL(0.466732591390610f), GS_REAL(0.540188550949097f),
+    GS_REAL(0.422782212495804f), GS_REAL(0.625817954540253f), GS_REAL(0.504974603652954f),
+    GS_REAL(0.510644137859344f), GS_REAL(0.506050705909729f), GS_REAL(0.446046739816666f),
+    GS_REAL(0.361642450094223f), GS_REAL(0.602707445621490f), GS_REAL(0.596623718738556f),
+    GS_REAL(0.397799998521805f), GS_REAL(0.428207963705063f), GS_REAL(0.354986608028412f),
+    GS_REAL(0.466801941394806f), GS_REAL(0.387913584709167f), GS_REAL(0.708865404129028f),
+    GS_REAL(0.528328835964203f), GS_REAL(0.544080913066864f), GS_REAL(0.422073334455490f),
+    GS_REAL(0.439985543489456f), GS_REAL(0.457025468349457f), GS_REAL(0.479024618864060f),
+    GS_REAL(0.608203232288361f), GS_REAL(0.478536993265152f), GS_REAL(0.498966902494430f),
+    GS_REAL(0.362435191869736f), GS_REAL(0.463214069604874f), GS_REAL(0.506178855895996f),
+    GS_REAL(0.444148033857346f), GS_REAL(0.566376805305481f), GS_REAL(0.454703301191330f),
+    GS_REAL(0.411109238862991f), GS_REAL(0.432672530412674f), GS_REAL(0.444851070642471f),
+    GS_REAL(0.388897269964218f), GS_REAL(0.333322227001190f), GS_REAL(0.660597205162048f),
+    GS_REAL(0.513974964618683f), GS_REAL(0.617155313491821f), GS_REAL(0.435818523168564f),
+    GS_REAL(0.460122019052505f), GS_REAL(0.445216178894043f), GS_REAL(0.485452681779862f),
+    GS_REAL(0.269799739122391f), GS_REAL(0.510193288326263f), GS_REAL(0.449070930480957f),
+    GS_REAL(0.406109482049942f), GS_REAL(0.505632698535919f), GS_REAL(0.413241565227508f),
+    GS_REAL(0.413506776094437f), GS_REAL(0.565864503383636f), GS_REAL(0.358447939157486f),
+    GS_REAL(0.412364512681961f), GS_REAL(0.601414322853088f), GS_REAL(0.467088818550110f),
+    GS_REAL(0.371958494186401f), GS_REAL(0.396581202745438f), GS_REAL(0.386260151863098f),
+    GS_REAL(0.377898633480072f), GS_REAL(0.499440014362335f), GS_REAL(0.476964145898819f),
+    GS_REAL(0.434216409921646f), GS_REAL(0.366537809371948f), GS_REAL(0.562462627887726f),
+    GS_REAL(0.370440304279327f), GS_REAL(0.454043567180633f), GS_REAL(0.370426207780838f),
+    GS_REAL(0.426723122596741f), GS_REAL(0.468465626239777f), GS_REAL(0.368950724601746f),
+    GS_REAL(0.458012729883194f), GS_REAL(0.389470815658569f), GS_REAL(0.548794507980347f),
+    GS_REAL(0.453200340270996f), GS_REAL(0.420279175043106f), GS_REAL(0.400274783372879f),
+    GS_REAL(0.408634662628174f), GS_REAL(0.424986898899078f), GS_REAL(0.409083873033524f),
+    GS_REAL(0.370253384113312f), GS_REAL(0.356498122215271f), GS_REAL(0.568970918655396f),
+    GS_REAL(0.358792960643768f), GS_REAL(0.429045557975769f), GS_REAL(0.455647319555283f),
+    GS_REAL(0.322103738784790f), GS_REAL(0.400495618581772f), GS_REAL(0.383274853229523f),
+    GS_REAL(0.461270153522492f), GS_REAL(0.320587038993836f), GS_REAL(0.587301611900330f),
+    GS_REAL(0.471882730722427f), GS_REAL(0.509480714797974f), GS_REAL(0.413013637065888f),
+    GS_REAL(0.353979200124741f), GS_REAL(0.411859244108200f), GS_REAL(0.403475701808929f),
+    GS_REAL(0.296476274728775f), GS_REAL(0.529401898384094f), GS_REAL(0.506745874881744f),
+    GS_REAL(0.516574561595917f), GS_REAL(0.407530277967453f), GS_REAL(0.372805535793304f),
+    GS_REAL(0.456325620412826f), GS_REAL(0.416081696748734f), GS_REAL(0.459414273500443f),
+    GS_REAL(0.438145935535431f), GS_REAL(0.462407886981964f), GS_REAL(0.402329355478287f),
+    GS_REAL(0.299593478441238f),
 };
 
 static const uint16_t frontalface_weak_subset_offset[] = {
@@ -429,12 +453,14 @@ static const uint16_t frontalface_stage_nweaks[] = {
     3, 4, 4, 5, 5, 5, 5, 6, 7, 7, 7, 7, 8, 9, 10, 9, 9, 9, 10, 10,
 };
 
-static const float frontalface_stage_threshold[] = {
-    -0.752089202404022f, -0.487207829952240f, -1.159232854843140f, -0.756235599517822f,
-    -0.808535814285278f, -0.554997146129608f, -0.877646028995514f, -1.113928794860840f,
-    -0.824362576007843f, -1.223711609840393f, -0.554423093795776f, -0.716156065464020f,
-    -0.674394071102142f, -1.204229831695557f, -0.840205013751984f, -1.197439432144165f,
-    -0.573312819004059f, -0.489259690046310f, -0.591194093227386f, -0.761291623115540f,
+static const gs_real frontalface_stage_threshold[] = {
+    GS_REAL(-0.752089202404022f), GS_REAL(-0.487207829952240f), GS_REAL(-1.159232854843140f),
+    GS_REAL(-0.756235599517822f), GS_REAL(-0.808535814285278f), GS_REAL(-0.554997146129608f),
+    GS_REAL(-0.877646028995514f), GS_REAL(-1.113928794860840f), GS_REAL(-0.824362576007843f),
+    GS_REAL(-1.223711609840393f), GS_REAL(-0.554423093795776f), GS_REAL(-0.716156065464020f),
+    GS_REAL(-0.674394071102142f), GS_REAL(-1.204229831695557f), GS_REAL(-0.840205013751984f),
+    GS_REAL(-1.197439432144165f), GS_REAL(-0.573312819004059f), GS_REAL(-0.489259690046310f),
+    GS_REAL(-0.591194093227386f), GS_REAL(-0.761291623115540f),
 };
 
 static const struct gs_lbp_cascade frontalface = {
@@ -1,14 +1,132 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <glob.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
 
+// grayskull profiling hooks, recorded when --trace or --profile is given
+static void trace_begin(const char *name, unsigned long long npixels);
+static void trace_end(const char *name);
+#define GS_TRACE_BEGIN(name, npixels) trace_begin(name, npixels)
+#define GS_TRACE_END(name) trace_end(name)
+
 #include "grayskull.h"
 
 // face detection data from opencv lbpcascade_frontalface.xml cascade
 #include "frontalface.h"
 
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+//
+// Tracing: --trace writes Chrome trace events (chrome://tracing or ui.perfetto.dev), --profile
+// prints wall time, calls and throughput per traced function or phase.
+//
+enum { TRACE_JSON = 1, TRACE_PROFILE = 2 };
+static int tracing;
+
+struct trace_event {
+  const char *name;
+  double ts, dur;
+  int tid;
+};
+
+struct trace_stat {
+  const char *name;
+  unsigned long long calls, pixels;
+  double ms;
+};
+
+struct trace_frame {
+  const char *name;
+  unsigned long long npixels;
+  double t;
+};
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_event *trace_events;
+static size_t trace_nevents, trace_cap;
+static struct trace_stat trace_stats[128];
+static int trace_nstats, trace_ntids;
+static double trace_t0;
+static __thread struct trace_frame trace_stack[32];
+static __thread int trace_depth, trace_tid;
+
+static void trace_begin(const char *name, unsigned long long npixels) {
+  if (!tracing) return;
+  if (trace_depth < 32) trace_stack[trace_depth] = (struct trace_frame){name, npixels, now_ms()};
+  trace_depth++;
+}
+
+static void trace_end(const char *name) {
+  (void)name;
+  if (!tracing || --trace_depth >= 32 || trace_depth < 0) return;
+  struct trace_frame *f = &trace_stack[trace_depth];
+  double dur = now_ms() - f->t;
+  pthread_mutex_lock(&trace_lock);
+  if (!trace_tid) trace_tid = ++trace_ntids;
+  if (tracing & TRACE_JSON) {
+    if (trace_nevents == trace_cap) {
+      size_t cap = trace_cap ? trace_cap * 2 : 4096;
+      struct trace_event *e = realloc(trace_events, cap * sizeof(*e));
+      if (e) trace_events = e, trace_cap = cap;
+    }
+    if (trace_nevents < trace_cap)
+      trace_events[trace_nevents++] = (struct trace_event){f->name, f->t, dur, trace_tid};
+  }
+  if (tracing & TRACE_PROFILE) {
+    int i = 0;
+    while (i < trace_nstats && strcmp(trace_stats[i].name, f->name) != 0) i++;
+    if (i == trace_nstats && trace_nstats < 128) trace_stats[trace_nstats++].name = f->name;
+    if (i < trace_nstats) {
+      trace_stats[i].calls++;
+      trace_stats[i].pixels += f->npixels;
+      trace_stats[i].ms += dur;
+    }
+  }
+  pthread_mutex_unlock(&trace_lock);
+}
+
+static int trace_write(const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f) return -1;
+  fprintf(f, "{\"traceEvents\":[\n");
+  for (size_t i = 0; i < trace_nevents; i++) {
+    struct trace_event *e = &trace_events[i];
+    fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            i ? ",\n" : "", e->name, e->tid, (e->ts - trace_t0) * 1e3, e->dur * 1e3);
+  }
+  fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  return fclose(f);
+}
+
+static int cmp_stats(const void *a, const void *b) {
+  double d = ((const struct trace_stat *)b)->ms - ((const struct trace_stat *)a)->ms;
+  return (d > 0) - (d < 0);
+}
+
+static void trace_report(void) {
+  qsort(trace_stats, trace_nstats, sizeof(trace_stats[0]), cmp_stats);
+  fprintf(stderr, "%-28s %8s %12s %10s %10s\n", "phase", "calls", "total ms", "ms/call", "Mpx/s");
+  for (int i = 0; i < trace_nstats; i++) {
+    struct trace_stat *st = &trace_stats[i];
+    fprintf(stderr, "%-28s %8llu %12.3f %10.3f", st->name, st->calls, st->ms, st->ms / st->calls);
+    if (st->pixels && st->ms > 0) {
+      fprintf(stderr, " %10.1f\n", st->pixels / st->ms / 1e3);
+    } else {
+      fprintf(stderr, " %10s\n", "-");
+    }
+  }
+}
+
 static void identify(struct gs_image img, struct gs_image *out, char *argv[]) {
   (void)out, (void)argv;
   printf("Portable Graymap, %ux%u (%u) pixels\n", img.w, img.h, img.w * img.h);
@@ -76,6 +194,12 @@ static void crop(struct gs_image img, struct gs_image *out, char *argv[]) {
   gs_crop(*out, img, (struct gs_rect){x, y, w, h});
 }
 
+static void rotate(struct gs_image img, struct gs_image *out, char *argv[]) {
+  float deg = atof(argv[0]);
+  *out = gs_alloc(img.w, img.h);
+  gs_rotate(*out, img, deg * 0.01745329f, 255);
+}
+
 static void blur(struct gs_image img, struct gs_image *out, char *argv[]) {
   int r = atoi(argv[0]);
   if (r <= 0) {
@@ -140,6 +264,75 @@ static void sobel(struct gs_image img, struct gs_image *out, char *argv[]) {
   gs_sobel(*out, img);
 }
 
+// Draws blob boxes (gray) with the blob pixels (white) on top, out must be zeroed
+static void draw_blobs(struct gs_image out, struct gs_image img, struct gs_blob *blobs,
+                       unsigned n) {
+  for (unsigned i = 0; i < n; i++) {
+    unsigned x1 = GS_MAX(0, (int)blobs[i].box.x - 2), y1 = GS_MAX(0, (int)blobs[i].box.y - 2);
+    unsigned x2 = GS_MIN(img.w - 1, blobs[i].box.x + blobs[i].box.w + 2),
+             y2 = GS_MIN(img.h - 1, blobs[i].box.y + blobs[i].box.h + 2);
+    for (unsigned y = y1; y <= y2; y++) {
+      for (unsigned x = x1; x <= x2; x++) { out.data[y * out.w + x] = 128; }
+    }
+  }
+  gs_for(img, x, y) if (img.data[y * img.w + x] > 128) out.data[y * out.w + x] = 255;
+}
+
+static void thin(struct gs_image img, struct gs_image *out, char *argv[]) {
+  int method = strcmp(argv[0], "zs") == 0   ? GS_ZHANG_SUEN
+               : strcmp(argv[0], "gh") == 0 ? GS_GUO_HALL
+                                            : -1;
+  if (method < 0) {
+    fprintf(stderr, "Error: Invalid thinning method (zs/gh): %s\n", argv[0]);
+    return;
+  }
+  *out = gs_alloc(img.w, img.h);
+  uint32_t *list = malloc(img.w * img.h * sizeof(uint32_t));
+  if (!gs_valid(*out) || !list) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+  } else {
+    gs_copy(*out, img);
+    gs_thin(*out, method, list, img.w * img.h);
+  }
+  free(list);
+}
+
+// Spans of the stack for fill and holes, runs of pixels that are still to be scanned
+#define FILL_SPANS 4096
+
+static void fill(struct gs_image img, struct gs_image *out, char *argv[]) {
+  int x = atoi(argv[0]), y = atoi(argv[1]), v = atoi(argv[2]), t = atoi(argv[3]);
+  if (x < 0 || y < 0 || x >= (int)img.w || y >= (int)img.h || v < 0 || v > 255 || t < 0 ||
+      t > 255) {
+    fprintf(stderr, "Error: Invalid seed, value or tolerance\n");
+    return;
+  }
+  struct gs_span *stack = malloc(FILL_SPANS * sizeof(struct gs_span));
+  *out = gs_alloc(img.w, img.h);
+  if (!stack || !gs_valid(*out)) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+  } else {
+    gs_copy(*out, img);
+    if (gs_flood_fill(*out, x, y, v, t, 1, stack, FILL_SPANS) < 0)
+      fprintf(stderr, "Warning: Too many spans, the region is partly filled\n");
+  }
+  free(stack);
+}
+
+static void holes(struct gs_image img, struct gs_image *out, char *argv[]) {
+  (void)argv;
+  struct gs_span *stack = malloc(FILL_SPANS * sizeof(struct gs_span));
+  *out = gs_alloc(img.w, img.h);
+  if (!stack || !gs_valid(*out)) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+  } else {
+    gs_copy(*out, img);
+    if (gs_fill_holes(*out, stack, FILL_SPANS) < 0)
+      fprintf(stderr, "Warning: Too many spans, holes are not filled\n");
+  }
+  free(stack);
+}
+
 static void blobs(struct gs_image img, struct gs_image *out, char *argv[]) {
   int n = atoi(argv[0]);
   if (n <= 0) {
@@ -158,15 +351,9 @@ static void blobs(struct gs_image img, struct gs_image *out, char *argv[]) {
     return;
   }
   unsigned nblobs = gs_blobs(img, labels, blobs, n);
-  for (unsigned i = 0; i < nblobs; i++) {
-    unsigned x1 = GS_MAX(0, (int)blobs[i].box.x - 2), y1 = GS_MAX(0, (int)blobs[i].box.y - 2);
-    unsigned x2 = GS_MIN(img.w, blobs[i].box.x + blobs[i].box.w + 2),
-             y2 = GS_MIN(img.h, blobs[i].box.y + blobs[i].box.h + 2);
-    for (unsigned y = y1; y <= y2; y++) {
-      for (unsigned x = x1; x <= x2; x++) { out->data[y * out->w + x] = 128; }
-    }
-  }
-  gs_for(img, x, y) if (img.data[y * out->w + x] > 128) out->data[y * img.w + x] = 255;
+  draw_blobs(*out, img, blobs, nblobs);
+  free(labels);
+  free(blobs);
 }
 
 static void draw_line(struct gs_image img, unsigned x1, unsigned y1, unsigned x2, unsigned y2,
@@ -183,31 +370,162 @@ static void draw_line(struct gs_image img, unsigned x1, unsigned y1, unsigned x2
   }
 }
 
-static void scan(struct gs_image img, struct gs_image *out, char *argv[]) {
-  (void)argv;
-  struct gs_image tmp = gs_alloc(img.w, img.h);
+// Finds straight segments of Sobel edges with the probabilistic Hough transform
+static void lines(struct gs_image img, struct gs_image *out, char *argv[]) {
+  int t = atoi(argv[0]), len = atoi(argv[1]);
+  if (t <= 0 || len <= 0) {
+    fprintf(stderr, "Error: Invalid threshold or length\n");
+    return;
+  }
+  struct gs_image edges = gs_alloc(img.w, img.h);
+  struct gs_point *pts = malloc(img.w * img.h * sizeof(struct gs_point));
+  uint16_t *acc = malloc(gs_hough_size(img.w, img.h, 1) * sizeof(uint16_t));
+  struct gs_segment *segs = malloc(256 * sizeof(struct gs_segment));
+  if (!gs_valid(edges) || !pts || !acc || !segs) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+  } else {
+    gs_sobel(edges, img);
+    gs_threshold(edges, gs_otsu_threshold(edges));
+    unsigned npts = gs_edge_points(edges, pts, img.w * img.h);
+    unsigned n = gs_hough_segments(edges, pts, npts, 1, acc, t, len, 3, segs, 256);
+    *out = gs_alloc(img.w, img.h);
+    gs_copy(*out, img);
+    for (unsigned i = 0; i < n; i++)
+      draw_line(*out, segs[i].p0.x, segs[i].p0.y, segs[i].p1.x, segs[i].p1.y, 255);
+  }
+  gs_free(edges);
+  free(pts);
+  free(acc);
+  free(segs);
+}
+
+// Outlines QR codes found by their finder patterns and barcode regions
+static void codes(struct gs_image img, struct gs_image *out, char *argv[]) {
+  int m = atoi(argv[0]);
+  if (m <= 0) {
+    fprintf(stderr, "Error: Invalid module size\n");
+    return;
+  }
+  struct gs_image bin = gs_alloc(img.w, img.h), cells = gs_alloc(img.w / 8, img.h / 8);
+  gs_label *labels = malloc(cells.w * cells.h * sizeof(gs_label));
+  if (!gs_valid(bin) || !gs_valid(cells) || !labels) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+  } else {
+    struct gs_finder f[32];
+    struct gs_qr qrs[8];
+    struct gs_blob blobs[64];
+    gs_copy(bin, img);
+    gs_threshold(bin, gs_otsu_threshold(bin));
+    unsigned nf = gs_qr_finders(bin, 0, m, f, 32), nq = gs_qr_locate(f, nf, img.w, img.h, qrs, 8);
+    unsigned nb = gs_barcode_regions(img, cells, labels, blobs, 64, 200, 8);
+    fprintf(stderr, "%u finders, %u QR codes, %u barcodes\n", nf, nq, nb);
+    *out = gs_alloc(img.w, img.h);
+    gs_copy(*out, img);
+    for (unsigned i = 0; i < nq; i++) {
+      for (int k = 0; k < 4; k++) {
+        struct gs_point a = qrs[i].corners[k], b = qrs[i].corners[(k + 1) % 4];
+        draw_line(*out, a.x, a.y, b.x, b.y, 255);
+      }
+    }
+    for (unsigned i = 0; i < nb; i++) {
+      struct gs_rect r = blobs[i].box;
+      draw_line(*out, r.x, r.y, r.x + r.w - 1, r.y, 255);
+      draw_line(*out, r.x, r.y + r.h - 1, r.x + r.w - 1, r.y + r.h - 1, 255);
+      draw_line(*out, r.x, r.y, r.x, r.y + r.h - 1, 255);
+      draw_line(*out, r.x + r.w - 1, r.y, r.x + r.w - 1, r.y + r.h - 1, 255);
+    }
+  }
+  gs_free(bin);
+  gs_free(cells);
+  free(labels);
+}
+
+#define SCAN_WIDTH 800
+#define SCAN_HEIGHT 1000
+#define SCAN_PREVIEW 512
+
+// Finds the largest bright blob and warps it into out, tmp and labels are img-sized scratch
+// The document is found on a preview at most SCAN_PREVIEW pixels wide, its corners are refined in
+// small windows at full resolution and only the final warp touches every output pixel. tmp must
+// hold img.w * img.h pixels and labels the preview size.
+static void scan_document(struct gs_image out, struct gs_image img, struct gs_image tmp,
+                          gs_label *labels) {
+  // build the preview by halving, each level is stored after the previous one in tmp
+  struct gs_image small = img;
+  uint8_t *p = tmp.data;
+  unsigned scale = 1;
+  while (small.w > SCAN_PREVIEW && small.h > 1) {
+    struct gs_image half = {small.w / 2, small.h / 2, p};
+    gs_downsample(half, small);
+    p += half.w * half.h, small = half, scale *= 2;
+  }
   // preprocess, remove noise, binarise
-  gs_blur(tmp, img, 1);
-  gs_threshold(tmp, gs_otsu_threshold(tmp) + 10);
+  struct gs_image bin = {small.w, small.h, p};
+  gs_blur(bin, small, 1);
+  gs_threshold(bin, gs_otsu_threshold(bin) + 10);
   // find blobs
-  gs_label *labels = calloc(img.w * img.h, sizeof(gs_label));
   struct gs_blob blobs[1000];
-  unsigned n = gs_blobs(tmp, labels, blobs, sizeof(blobs) / sizeof(blobs[0]));
+  unsigned n = gs_blobs(bin, labels, blobs, sizeof(blobs) / sizeof(blobs[0]));
   // find largest blob
   unsigned largest = 0;
   for (unsigned i = 1; i < n; i++)
     if (blobs[i].area > blobs[largest].area) largest = i;
-  // find corners
-  struct gs_point corners[4];
-  gs_blob_corners(tmp, labels, &blobs[largest], corners);
+  // find corners, fall back to the whole image if there is nothing to scan
+  struct gs_point corners[4] = {{0, 0}, {img.w - 1, 0}, {img.w - 1, img.h - 1}, {0, img.h - 1}};
+  if (n > 0) {
+    gs_blob_corners(bin, labels, &blobs[largest], corners);
+    // back to full resolution, a preview pixel covers scale x scale image pixels
+    for (unsigned i = 0; i < 4 && scale > 1; i++) {
+      corners[i].x = GS_MIN(corners[i].x * scale + scale / 2, img.w - 1);
+      corners[i].y = GS_MIN(corners[i].y * scale + scale / 2, img.h - 1);
+    }
+    if (scale > 1) gs_refine_corners(img, corners, 4, scale * 2);
+  }
   // perspective correct
-  const unsigned OUTPUT_WIDTH = 800, OUTPUT_HEIGHT = 1000;
-  *out = gs_alloc(OUTPUT_WIDTH, OUTPUT_HEIGHT);
-  gs_perspective_correct(*out, img, corners);
+  gs_perspective_correct(out, img, corners);
+}
 
+static void scan(struct gs_image img, struct gs_image *out, char *argv[]) {
+  (void)argv;
+  struct gs_image tmp = gs_alloc(img.w, img.h);
+  gs_label *labels = calloc(img.w * img.h, sizeof(gs_label));
+  *out = gs_alloc(SCAN_WIDTH, SCAN_HEIGHT);
+  scan_document(*out, img, tmp, labels);
   gs_free(tmp);
   free(labels);
 }
+
+// Straightens text lines: skew of the binarised page halved down to 400 pixels or less, then one
+// rotation of the full image
+static void deskew(struct gs_image img, struct gs_image *out, char *argv[]) {
+  (void)argv;
+  struct gs_image tmp = gs_alloc(img.w, img.h), small = img;
+  if (!gs_valid(tmp)) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return;
+  }
+  uint8_t *p = tmp.data;
+  while (small.w > 400 && small.h > 1) {
+    struct gs_image half = {small.w / 2, small.h / 2, p};
+    gs_downsample(half, small);
+    p += half.w * half.h, small = half;
+  }
+  struct gs_image bin = {small.w, small.h, p};
+  gs_copy(bin, small);
+  gs_threshold(bin, gs_otsu_threshold(bin));
+  void *work = malloc(gs_skew_size(bin.w, bin.h));
+  if (work) *out = gs_alloc(img.w, img.h);
+  if (!work || !gs_valid(*out)) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+  } else {
+    gs_real skew = gs_skew(bin, 15, work);
+    fprintf(stderr, "Skew: %.2f degrees\n", skew * 57.29578f);
+    gs_rotate(*out, img, -skew, 255);
+  }
+  gs_free(tmp);
+  free(work);
+}
+
 static int sort_keypoints(const void *a, const void *b) {
   const struct gs_keypoint *kp1 = (const struct gs_keypoint *)a,
                            *kp2 = (const struct gs_keypoint *)b;
@@ -241,6 +559,35 @@ static void keypoints(struct gs_image img, struct gs_image *out, char *argv[]) {
   free(kps);
 }
 
+// Shi-Tomasi corners over 5x5 windows, at least 1% of the strongest and D pixels apart
+static void corners(struct gs_image img, struct gs_image *out, char *argv[]) {
+  int n = atoi(argv[0]), d = atoi(argv[1]);
+  if (n <= 0 || d < 0) {
+    fprintf(stderr, "Error: Invalid number of corners or distance\n");
+    return;
+  }
+  uint32_t *resp = malloc(img.w * img.h * sizeof(uint32_t));
+  void *work = malloc(gs_corners_size(img.w)), *fwork = malloc(gs_features_size(img.w, img.h, d));
+  struct gs_keypoint *kps = calloc(n, sizeof(struct gs_keypoint));
+  if (!resp || !work || !fwork || !kps) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+  } else {
+    gs_corners(img, 2, GS_SHI_TOMASI, work, resp);
+    unsigned nkps = gs_good_features(resp, img.w, img.h, 10, d, fwork, kps, n);
+    *out = gs_alloc(img.w, img.h);
+    gs_copy(*out, img);
+    for (unsigned i = 0; i < nkps; i++) {
+      unsigned x = kps[i].pt.x, y = kps[i].pt.y, r = 2;
+      for (int dy = -r; dy <= (int)r; dy++) gs_set(*out, x, y + dy, 255);
+      for (int dx = -r; dx <= (int)r; dx++) gs_set(*out, x + dx, y, 255);
+    }
+  }
+  free(resp);
+  free(work);
+  free(fwork);
+  free(kps);
+}
+
 // Pyramid ORB extraction for nanomagick
 static unsigned extract_pyramid_orb_nm(struct gs_image img, struct gs_keypoint *kps, unsigned nkps,
                                        unsigned threshold, uint8_t *buffer, unsigned n_levels) {
@@ -252,6 +599,7 @@ static unsigned extract_pyramid_orb_nm(struct gs_image img, struct gs_keypoint *
   pyramid[0] = img;
 
   // Generate downsampled levels
+  GS_TRACE_BEGIN("orb/pyramid", img.w * img.h);
   for (unsigned level = 1; level < n_levels; level++) {
     unsigned w = pyramid[level - 1].w / 2, h = pyramid[level - 1].h / 2;
     if (w < 32 || h < 32) {
@@ -262,6 +610,7 @@ static unsigned extract_pyramid_orb_nm(struct gs_image img, struct gs_keypoint *
     buffer_offset += w * h;
     gs_downsample(pyramid[level], pyramid[level - 1]);
   }
+  GS_TRACE_END("orb/pyramid");
 
   // Allocate scoremap buffers
   for (unsigned level = 0; level < n_levels; level++) {
@@ -305,7 +654,7 @@ static void orb(struct gs_image img, struct gs_image *out, char *argv[]) {
   unsigned n_scene = extract_pyramid_orb_nm(img, scene_kps, 2500, 20, buffer, 3);
 
   unsigned n_matches =
-      gs_match_orb(template_kps, n_template, scene_kps, n_scene, matches, 300, 60.0f);
+      gs_match_orb(template_kps, n_template, scene_kps, n_scene, matches, 300, 60);
 
   printf("Template: %u keypoints, Scene: %u keypoints, Matches: %u\n", n_template, n_scene,
          n_matches);
@@ -344,9 +693,147 @@ static void orb(struct gs_image img, struct gs_image *out, char *argv[]) {
   gs_free(template);
 }
 
+// Disparity map of a rectified pair, brighter is closer, unmatched pixels are black
+static void stereo(struct gs_image img, struct gs_image *out, char *argv[]) {
+  struct gs_image right = gs_read_pgm(argv[0]);
+  int nd = atoi(argv[1]);
+  if (!gs_valid(right) || right.w != img.w || right.h != img.h || nd <= 0 || nd > 255) {
+    fprintf(stderr, "Error: Invalid right image %s or disparity range\n", argv[0]);
+    gs_free(right);
+    return;
+  }
+  uint32_t *lc = malloc(img.w * img.h * sizeof(uint32_t));
+  uint32_t *rc = malloc(img.w * img.h * sizeof(uint32_t));
+  int16_t *disp = malloc(img.w * img.h * sizeof(int16_t));
+  void *work = malloc(gs_stereo_size(img.w, nd));
+  if (!lc || !rc || !disp || !work) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+  } else {
+    gs_census5x5(img, lc);
+    gs_census5x5(right, rc);
+    gs_stereo_bm(lc, rc, img.w, img.h, nd, 4, 10, work, disp);
+    *out = gs_alloc(img.w, img.h);
+    for (unsigned i = 0; i < img.w * img.h; i++)
+      out->data[i] = disp[i] == GS_DISP_INVALID ? 0 : disp[i] * 255 / (nd * GS_DISP_SCALE);
+  }
+  gs_free(right);
+  free(lc);
+  free(rc);
+  free(disp);
+  free(work);
+}
+
+// Tracks the box of the input image into the next frame, draws it there
+static void track(struct gs_image img, struct gs_image *out, char *argv[]) {
+  struct gs_image next = gs_read_pgm(argv[0]);
+  int x = atoi(argv[1]), y = atoi(argv[2]), w = atoi(argv[3]), h = atoi(argv[4]);
+  if (!gs_valid(next) || x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > (int)img.w ||
+      y + h > (int)img.h) {
+    fprintf(stderr, "Error: Invalid next frame %s or box\n", argv[0]);
+    gs_free(next);
+    return;
+  }
+  struct gs_mosse t = {.n = 64, .rate = 0.125f, .min_psr = 7};
+  void *work = malloc(gs_mosse_size(&t));
+  if (!work) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    gs_free(next);
+    return;
+  }
+  gs_mosse_init(&t, work, img, (struct gs_rect){x, y, w, h});
+  int found = gs_mosse_update(&t, next);
+  fprintf(stderr, "%s at %u,%u, PSR %.1f\n", found ? "Tracked" : "Lost", t.box.x, t.box.y, t.psr);
+  *out = next;
+  unsigned x2 = t.box.x + t.box.w - 1, y2 = t.box.y + t.box.h - 1;
+  draw_line(*out, t.box.x, t.box.y, x2, t.box.y, 255);
+  draw_line(*out, x2, t.box.y, x2, y2, 255);
+  draw_line(*out, x2, y2, t.box.x, y2, 255);
+  draw_line(*out, t.box.x, y2, t.box.x, t.box.y, 255);
+  free(work);
+}
+
+// Global translation from the input image to the next frame, by projections and by phase
+// correlation on 64x64 cell means
+static void motion(struct gs_image img, struct gs_image *out, char *argv[]) {
+  (void)out;
+  struct gs_image next = gs_read_pgm(argv[0]);
+  if (!gs_valid(next) || next.w != img.w || next.h != img.h || img.w < 64 || img.h < 64) {
+    fprintf(stderr, "Error: Invalid next frame %s\n", argv[0]);
+    gs_free(next);
+    return;
+  }
+  uint32_t *p = malloc((img.w + img.h) * 2 * sizeof(uint32_t));
+  void *work = malloc(gs_phase_size(64));
+  if (!p || !work) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+  } else {
+    uint32_t *rows = p, *cols = p + img.h, *nrows = cols + img.w, *ncols = nrows + img.h;
+    gs_projections(img, rows, cols);
+    gs_projections(next, nrows, ncols);
+    int dx = gs_projection_shift(cols, ncols, img.w, img.w / 8);
+    int dy = gs_projection_shift(rows, nrows, img.h, img.h / 8);
+    printf("Projections: %.2f,%.2f\n", (float)dx / GS_SHIFT_SCALE, (float)dy / GS_SHIFT_SCALE);
+    float fx, fy, peak = gs_phase_correlate(img, next, 64, work, &fx, &fy);
+    printf("Phase correlation: %.2f,%.2f, peak %.2f\n", fx, fy, peak);
+  }
+  gs_free(next);
+  free(p);
+  free(work);
+}
+
+// Faces are detected on overlapping tiles, so any image size works with a bounded integral image
+// per thread, and tiles are shared between threads. Each tile keeps up to FACES_MAX detections,
+// the job keeps all of them whatever order the tiles finish in.
+#define FACES_TILE 512
+#define FACES_MAX 256
+
+struct faces_job {
+  struct gs_image img;
+  int step, failed;
+  unsigned next, ntiles, nrects, cap;
+  struct gs_rect *rects;
+  pthread_mutex_t lock;
+};
+
+// A worker without memory claims no tiles, the others take them over
+static void *faces_worker(void *arg) {
+  struct faces_job *job = arg;
+  uint32_t *ii = malloc(FACES_TILE * FACES_TILE * sizeof(uint32_t));
+  struct gs_rect tile = {0, 0, 0, 0}, rects[FACES_MAX];
+  while (ii) {
+    pthread_mutex_lock(&job->lock);
+    unsigned i = job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if (i >= job->ntiles) break;
+    gs_lbp_tile(&frontalface, job->img.w, job->img.h, FACES_TILE, FACES_TILE, GS_REAL(4.0f),
+                job->step, i, &tile);
+    unsigned n = gs_lbp_detect_tile(&frontalface, job->img, tile, ii, rects, FACES_MAX,
+                                    GS_REAL(1.2f), GS_REAL(1.0f), GS_REAL(4.0f), job->step);
+    pthread_mutex_lock(&job->lock);
+    if (job->nrects + n > job->cap) {
+      unsigned cap = GS_MAX(job->cap * 2, job->nrects + n);
+      struct gs_rect *p = realloc(job->rects, cap * sizeof(struct gs_rect));
+      if (p) job->rects = p, job->cap = cap;
+      else job->failed = 1, n = 0;
+    }
+    for (unsigned k = 0; k < n; k++) job->rects[job->nrects++] = rects[k];
+    job->nrects = gs_rects_dedup(job->rects, job->nrects);
+    pthread_mutex_unlock(&job->lock);
+  }
+  free(ii);
+  return NULL;
+}
+
+static int cmp_rects(const void *a, const void *b) {
+  const struct gs_rect *ra = a, *rb = b;
+  if (ra->y != rb->y) return ra->y < rb->y ? -1 : 1;
+  if (ra->x != rb->x) return ra->x < rb->x ? -1 : 1;
+  return (ra->w > rb->w) - (ra->w < rb->w);
+}
+
 static void faces(struct gs_image img, struct gs_image *out, char *argv[]) {
-  static uint32_t integral[640 * 480];  // Max typical image size
-  static struct gs_rect rects[100];
+  static struct faces_job job;
+  pthread_t threads[16];
 
   int min_neighbors = argv[0] ? atoi(argv[0]) : 1;
   if (min_neighbors <= 0) {
@@ -354,25 +841,584 @@ static void faces(struct gs_image img, struct gs_image *out, char *argv[]) {
     return;
   }
 
-  if (img.w * img.h > 640 * 480) {
-    fprintf(stderr, "Error: Image too large for face detection (max 640x480)\n");
+  struct gs_rect tile = {0, 0, 0, 0};
+  job.img = img, job.step = min_neighbors, job.failed = 0;
+  job.next = 0, job.nrects = 0, job.cap = 0, job.rects = NULL;
+  job.ntiles = gs_lbp_tile(&frontalface, img.w, img.h, FACES_TILE, FACES_TILE, GS_REAL(4.0f),
+                           job.step, 0, &tile);
+  pthread_mutex_init(&job.lock, NULL);
+  unsigned nthreads = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+  nthreads = GS_MAX(1, GS_MIN(GS_MIN(nthreads, 16), job.ntiles));
+  unsigned started = 0;
+  while (started < nthreads && pthread_create(&threads[started], NULL, faces_worker, &job) == 0)
+    started++;
+  for (unsigned i = 0; i < started; i++) pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&job.lock);
+  if (started == 0 || job.next < job.ntiles || job.failed) {
+    const char *err = started ? "Memory allocation failed" : "Could not start threads";
+    fprintf(stderr, "Error: %s\n", err);
+    free(job.rects);
     return;
   }
-
-  gs_integral(img, integral);
-  unsigned nrects = gs_lbp_detect(&frontalface, integral, img.w, img.h, rects, 100, 1.2f, 1.0f,
-                                  4.0f, min_neighbors);
+  // Tiles finish in any order, sort to keep the output reproducible
+  qsort(job.rects, job.nrects, sizeof(job.rects[0]), cmp_rects);
 
   *out = gs_alloc(img.w, img.h);
   gs_copy(*out, img);
 
-  for (unsigned i = 0; i < nrects; i++) {
-    struct gs_rect r = rects[i];
+  for (unsigned i = 0; i < job.nrects; i++) {
+    struct gs_rect r = job.rects[i];
     draw_line(*out, r.x, r.y, r.x + r.w, r.y, 255);
     draw_line(*out, r.x, r.y + r.h, r.x + r.w, r.y + r.h, 255);
     draw_line(*out, r.x, r.y, r.x, r.y + r.h, 255);
     draw_line(*out, r.x + r.w, r.y, r.x + r.w, r.y + r.h, 255);
   }
+  free(job.rects);
+}
+
+//
+// In-process pipelines: "blur 3, sobel, threshold otsu" runs every stage in memory, on two
+// ping-pong buffers that are allocated once and reused, so timings only include the library.
+//
+#define PIPE_MAX_STAGES 32
+
+enum { PIPE_A, PIPE_B, PIPE_TMP, PIPE_LABELS, PIPE_BLOBS, PIPE_NBUFS };
+
+struct pipe {
+  void *buf[PIPE_NBUFS];
+  size_t cap[PIPE_NBUFS];
+};
+
+// Returns buffer i of at least n bytes, it only grows and keeps its contents otherwise
+static void *pipe_buf(struct pipe *p, int i, size_t n) {
+  if (n > p->cap[i]) {
+    free(p->buf[i]);
+    p->buf[i] = malloc(n);
+    p->cap[i] = p->buf[i] ? n : 0;
+  }
+  return p->buf[i];
+}
+
+static struct gs_image pipe_img(struct pipe *p, int i, unsigned w, unsigned h) {
+  uint8_t *data = (uint8_t *)pipe_buf(p, i, (size_t)w * h);
+  return data ? (struct gs_image){w, h, data} : (struct gs_image){0, 0, NULL};
+}
+
+static void pipe_free(struct pipe *p) {
+  for (int i = 0; i < PIPE_NBUFS; i++) free(p->buf[i]);
+  *p = (struct pipe){{0}, {0}};
+}
+
+// Stages read src and return the result, either written into ping-pong buffer dst or, for
+// in-place operations, into src itself. An invalid image aborts the pipeline.
+static struct gs_image pipe_blur(struct pipe *p, struct gs_image src, int dst, char *argv[]) {
+  int r = atoi(argv[0]);
+  if (r <= 0) {
+    fprintf(stderr, "Error: Invalid radius: %s\n", argv[0]);
+    return (struct gs_image){0};
+  }
+  struct gs_image out = pipe_img(p, dst, src.w, src.h);
+  if (gs_valid(out)) gs_blur(out, src, r);
+  return out;
+}
+
+static struct gs_image pipe_threshold(struct pipe *p, struct gs_image src, int dst,
+                                      char *argv[]) {
+  (void)p, (void)dst;
+  int t = strcmp(argv[0], "otsu") == 0 ? gs_otsu_threshold(src) : atoi(argv[0]);
+  if (t <= 0) {
+    fprintf(stderr, "Error: Invalid threshold: %s\n", argv[0]);
+    return (struct gs_image){0};
+  }
+  gs_threshold(src, t);
+  return src;
+}
+
+static struct gs_image pipe_adaptive(struct pipe *p, struct gs_image src, int dst, char *argv[]) {
+  int r = atoi(argv[0]), c = atoi(argv[1]);
+  if (r <= 0 || c < 0) {
+    fprintf(stderr, "Error: Invalid radius or constant\n");
+    return (struct gs_image){0};
+  }
+  struct gs_image out = pipe_img(p, dst, src.w, src.h);
+  if (gs_valid(out)) gs_adaptive_threshold(out, src, r, c);
+  return out;
+}
+
+static struct gs_image pipe_sobel(struct pipe *p, struct gs_image src, int dst, char *argv[]) {
+  (void)argv;
+  struct gs_image out = pipe_img(p, dst, src.w, src.h);
+  if (!gs_valid(out)) return out;
+  gs_sobel(out, src);
+  // gs_sobel() leaves the 1px border untouched, clear it instead of the whole buffer
+  for (unsigned x = 0; x < out.w; x++) out.data[x] = out.data[(out.h - 1) * out.w + x] = 0;
+  for (unsigned y = 0; y < out.h; y++) out.data[y * out.w] = out.data[y * out.w + out.w - 1] = 0;
+  return out;
+}
+
+static struct gs_image pipe_morph(struct pipe *p, struct gs_image src, int dst, char *argv[]) {
+  int erode = strcmp(argv[0], "erode") == 0, n = atoi(argv[1]);
+  if ((!erode && strcmp(argv[0], "dilate") != 0) || n <= 0) {
+    fprintf(stderr, "Error: Invalid morphological operation or iterations\n");
+    return (struct gs_image){0};
+  }
+  // iterations ping-pong between src and dst, the result ends up in either of them
+  struct gs_image a = src, b = pipe_img(p, dst, src.w, src.h), t;
+  if (!gs_valid(b)) return b;
+  for (int i = 0; i < n; i++) {
+    if (erode) {
+      gs_erode(b, a);
+    } else {
+      gs_dilate(b, a);
+    }
+    t = a, a = b, b = t;
+  }
+  return a;
+}
+
+static struct gs_image pipe_resize(struct pipe *p, struct gs_image src, int dst, char *argv[]) {
+  int w = atoi(argv[0]), h = atoi(argv[1]);
+  if (w <= 0 || h <= 0) {
+    fprintf(stderr, "Error: Invalid width or height\n");
+    return (struct gs_image){0};
+  }
+  struct gs_image out = pipe_img(p, dst, w, h);
+  if (gs_valid(out)) gs_resize(out, src);
+  return out;
+}
+
+static struct gs_image pipe_crop(struct pipe *p, struct gs_image src, int dst, char *argv[]) {
+  int x = atoi(argv[0]), y = atoi(argv[1]), w = atoi(argv[2]), h = atoi(argv[3]);
+  if (x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > (int)src.w || y + h > (int)src.h) {
+    fprintf(stderr, "Error: Invalid crop rectangle\n");
+    return (struct gs_image){0};
+  }
+  struct gs_image out = pipe_img(p, dst, w, h);
+  if (gs_valid(out)) gs_crop(out, src, (struct gs_rect){x, y, w, h});
+  return out;
+}
+
+static struct gs_image pipe_downsample(struct pipe *p, struct gs_image src, int dst,
+                                       char *argv[]) {
+  (void)argv;
+  if (src.w < 2 || src.h < 2) {
+    fprintf(stderr, "Error: Image too small to downsample\n");
+    return (struct gs_image){0};
+  }
+  struct gs_image out = pipe_img(p, dst, src.w / 2, src.h / 2);
+  if (gs_valid(out)) gs_downsample(out, src);
+  return out;
+}
+
+static struct gs_image pipe_blobs(struct pipe *p, struct gs_image src, int dst, char *argv[]) {
+  int n = atoi(argv[0]);
+  if (n <= 0) {
+    fprintf(stderr, "Error: Invalid number of blobs\n");
+    return (struct gs_image){0};
+  }
+  struct gs_image out = pipe_img(p, dst, src.w, src.h);
+  gs_label *labels = pipe_buf(p, PIPE_LABELS, (size_t)src.w * src.h * sizeof(gs_label));
+  struct gs_blob *blobs = pipe_buf(p, PIPE_BLOBS, n * sizeof(struct gs_blob));
+  if (!gs_valid(out) || !labels || !blobs) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return (struct gs_image){0};
+  }
+  unsigned nblobs = gs_blobs(src, labels, blobs, n);
+  for (unsigned i = 0; i < out.w * out.h; i++) out.data[i] = 0;
+  draw_blobs(out, src, blobs, nblobs);
+  return out;
+}
+
+static struct gs_image pipe_scan(struct pipe *p, struct gs_image src, int dst, char *argv[]) {
+  (void)argv;
+  struct gs_image out = pipe_img(p, dst, SCAN_WIDTH, SCAN_HEIGHT);
+  struct gs_image tmp = pipe_img(p, PIPE_TMP, src.w, src.h);
+  gs_label *labels = pipe_buf(p, PIPE_LABELS, (size_t)src.w * src.h * sizeof(gs_label));
+  if (!gs_valid(out) || !gs_valid(tmp) || !labels) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return (struct gs_image){0};
+  }
+  scan_document(out, src, tmp, labels);
+  return out;
+}
+
+struct stage_def {
+  const char *name;
+  int argc;
+  struct gs_image (*run)(struct pipe *p, struct gs_image src, int dst, char *argv[]);
+} stage_defs[] = {
+    {"blur", 1, pipe_blur},
+    {"threshold", 1, pipe_threshold},
+    {"adaptive", 2, pipe_adaptive},
+    {"sobel", 0, pipe_sobel},
+    {"morph", 2, pipe_morph},
+    {"resize", 2, pipe_resize},
+    {"crop", 4, pipe_crop},
+    {"downsample", 0, pipe_downsample},
+    {"blobs", 1, pipe_blobs},
+    {"scan", 0, pipe_scan},
+    {NULL, 0, NULL},
+};
+
+struct stage {
+  const struct stage_def *def;
+  char *argv[4];
+};
+
+// Splits "blur 3, sobel, morph dilate 9" in place, returns the number of stages or -1
+static int pipe_parse(char *spec, struct stage *stages) {
+  char *segs[PIPE_MAX_STAGES];
+  int n = 0;
+  for (char *c = spec;;) {
+    if (n == PIPE_MAX_STAGES) {
+      fprintf(stderr, "Error: Too many stages (max %d)\n", PIPE_MAX_STAGES);
+      return -1;
+    }
+    segs[n++] = c;
+    if (!(c = strchr(c, ','))) break;
+    *c++ = '\0';
+  }
+  for (int i = 0; i < n; i++) {
+    char *name = strtok(segs[i], " \t");
+    if (!name) {
+      fprintf(stderr, "Error: Empty stage #%d\n", i + 1);
+      return -1;
+    }
+    const struct stage_def *def = stage_defs;
+    while (def->name && strcmp(def->name, name) != 0) def++;
+    if (!def->name) {
+      fprintf(stderr, "Error: Unknown stage '%s'\n", name);
+      return -1;
+    }
+    stages[i].def = def;
+    for (int j = 0; j <= def->argc; j++) {
+      char *arg = strtok(NULL, " \t");
+      if ((j < def->argc) != (arg != NULL)) {
+        fprintf(stderr, "Error: Stage '%s' takes %d argument(s)\n", name, def->argc);
+        return -1;
+      }
+      if (j < def->argc) stages[i].argv[j] = arg;
+    }
+  }
+  return n;
+}
+
+// Runs all stages on img (which may be modified), adding per-stage wall time to ms[]
+static struct gs_image pipe_run(struct pipe *p, struct stage *stages, int n, struct gs_image img,
+                                double *ms) {
+  for (int i = 0; i < n && gs_valid(img); i++) {
+    int dst = img.data == p->buf[PIPE_A] ? PIPE_B : PIPE_A;
+    double t = now_ms();
+    img = stages[i].def->run(p, img, dst, stages[i].argv);
+    if (ms) ms[i] += now_ms() - t;
+  }
+  return img;
+}
+
+static void pipe_report(const struct stage *stages, int n, const double *ms, unsigned runs) {
+  double total = 0;
+  for (int i = 0; i < n; i++) {
+    char desc[64];
+    int len = snprintf(desc, sizeof(desc), "%s", stages[i].def->name);
+    for (int j = 0; j < stages[i].def->argc && len < (int)sizeof(desc); j++)
+      len += snprintf(desc + len, sizeof(desc) - len, " %s", stages[i].argv[j]);
+    fprintf(stderr, "  %-24s %10.3f ms\n", desc, ms[i] / runs);
+    total += ms[i] / runs;
+  }
+  fprintf(stderr, "  %-24s %10.3f ms\n", "total", total);
+}
+
+static void pipe_cmd(struct gs_image img, struct gs_image *out, char *argv[]) {
+  struct stage stages[PIPE_MAX_STAGES];
+  double ms[PIPE_MAX_STAGES] = {0};
+  struct pipe p = {{0}, {0}};
+  char *spec = strdup(argv[0]);
+  int n = spec ? pipe_parse(spec, stages) : -1;
+  if (n > 0) {
+    struct gs_image res = pipe_run(&p, stages, n, img, ms);
+    if (gs_valid(res)) {
+      pipe_report(stages, n, ms, 1);
+      *out = gs_alloc(res.w, res.h);
+      gs_copy(*out, res);
+    }
+  }
+  pipe_free(&p);
+  free(spec);
+}
+
+//
+// Batch mode: a reader thread prefetches images into a few reusable slots, workers run the
+// pipeline with their own reusable buffers, the main thread writes results and recycles slots.
+//
+struct slot {
+  const char *path;
+  uint8_t *in, *out;  // grow-only pixel buffers, reused for every image passing through the slot
+  size_t incap, outcap;
+  struct gs_image img, res;
+};
+
+struct queue {
+  int *items, head, count, cap, closed;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+static void queue_init(struct queue *q, int *items, int cap) {
+  *q = (struct queue){items, 0, 0, cap, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+}
+
+// Never blocks: each queue can hold every slot at once
+static void queue_push(struct queue *q, int item) {
+  pthread_mutex_lock(&q->lock);
+  q->items[(q->head + q->count++) % q->cap] = item;
+  pthread_cond_signal(&q->cond);
+  pthread_mutex_unlock(&q->lock);
+}
+
+// Returns -1 once the queue is closed and drained
+static int queue_pop(struct queue *q) {
+  pthread_mutex_lock(&q->lock);
+  while (q->count == 0 && !q->closed) pthread_cond_wait(&q->cond, &q->lock);
+  int item = -1;
+  if (q->count > 0) item = q->items[q->head], q->head = (q->head + 1) % q->cap, q->count--;
+  pthread_mutex_unlock(&q->lock);
+  return item;
+}
+
+static void queue_close(struct queue *q) {
+  pthread_mutex_lock(&q->lock);
+  q->closed = 1;
+  pthread_cond_broadcast(&q->cond);
+  pthread_mutex_unlock(&q->lock);
+}
+
+static uint8_t *grow(uint8_t **buf, size_t *cap, size_t n) {
+  if (n > *cap) {
+    free(*buf);
+    *buf = malloc(n);
+    *cap = *buf ? n : 0;
+  }
+  return *buf;
+}
+
+// Same format as gs_read_pgm(), but reads into the slot's buffer instead of allocating
+static int read_pgm_slot(struct slot *s) {
+  FILE *f = fopen(s->path, "rb");
+  unsigned w, h, maxval;
+  s->img = (struct gs_image){0, 0, NULL};
+  if (!f) return -1;
+  if (fscanf(f, "P5\n%u %u\n%u\n", &w, &h, &maxval) == 3 && maxval == 255 && w > 0 && h > 0 &&
+      grow(&s->in, &s->incap, (size_t)w * h) && fread(s->in, 1, (size_t)w * h, f) == w * h)
+    s->img = (struct gs_image){w, h, s->in};
+  fclose(f);
+  return gs_valid(s->img) ? 0 : -1;
+}
+
+struct batch {
+  struct stage stages[PIPE_MAX_STAGES];
+  int nstages;
+  char **paths;
+  unsigned npaths;
+  struct slot *slots;
+  struct queue free, ready, done;
+  pthread_mutex_t lock;
+  double ms[PIPE_MAX_STAGES], read_ms;
+  int workers;
+};
+
+static void *batch_reader(void *arg) {
+  struct batch *b = arg;
+  for (unsigned i = 0; i < b->npaths; i++) {
+    int k = queue_pop(&b->free);
+    if (k < 0) break;  // closed when no worker could start
+    struct slot *s = &b->slots[k];
+    s->path = b->paths[i];
+    double t = now_ms();
+    read_pgm_slot(s);
+    pthread_mutex_lock(&b->lock);
+    b->read_ms += now_ms() - t;
+    pthread_mutex_unlock(&b->lock);
+    queue_push(&b->ready, k);
+  }
+  queue_close(&b->ready);
+  return NULL;
+}
+
+static void *batch_worker(void *arg) {
+  struct batch *b = arg;
+  struct pipe p = {{0}, {0}};
+  double ms[PIPE_MAX_STAGES] = {0};
+  for (int k; (k = queue_pop(&b->ready)) >= 0;) {
+    struct slot *s = &b->slots[k];
+    struct gs_image res = {0, 0, NULL};
+    if (gs_valid(s->img)) res = pipe_run(&p, b->stages, b->nstages, s->img, ms);
+    s->res = (struct gs_image){0, 0, NULL};
+    if (gs_valid(res) && grow(&s->out, &s->outcap, (size_t)res.w * res.h)) {
+      s->res = (struct gs_image){res.w, res.h, s->out};
+      gs_copy(s->res, res);
+    }
+    queue_push(&b->done, k);
+  }
+  pipe_free(&p);
+  pthread_mutex_lock(&b->lock);
+  for (int i = 0; i < b->nstages; i++) b->ms[i] += ms[i];
+  if (--b->workers == 0) queue_close(&b->done);
+  pthread_mutex_unlock(&b->lock);
+  return NULL;
+}
+
+// Input is either a glob pattern or a text file with one path per line
+static char **batch_paths(const char *src, unsigned *n, glob_t *g) {
+  *n = 0;
+  if (strpbrk(src, "*?[")) {
+    if (glob(src, 0, NULL, g) != 0) return NULL;
+    *n = g->gl_pathc;
+    return g->gl_pathv;
+  }
+  FILE *f = fopen(src, "r");
+  if (!f) return NULL;
+  char line[4096], **paths = NULL;
+  unsigned cap = 0;
+  while (fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (!line[0]) continue;
+    if (*n == cap) {
+      char **p = realloc(paths, (cap = cap ? cap * 2 : 256) * sizeof(char *));
+      if (!p) break;
+      paths = p;
+    }
+    if (!(paths[*n] = strdup(line))) break;
+    (*n)++;
+  }
+  fclose(f);
+  return paths;
+}
+
+static const char *base_name(const char *path) {
+  const char *base = strrchr(path, '/');
+  return base ? base + 1 : path;
+}
+
+static int sort_base_names(const void *a, const void *b) {
+  return strcmp(base_name(*(char *const *)a), base_name(*(char *const *)b));
+}
+
+// Outputs are named after the input file name alone, so two inputs must not share it
+static int batch_collision(char **paths, unsigned n, const char *outdir) {
+  char **sorted = malloc(n * sizeof(char *));
+  if (!sorted) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return 1;
+  }
+  memcpy(sorted, paths, n * sizeof(char *));
+  qsort(sorted, n, sizeof(char *), sort_base_names);
+  int found = 0;
+  for (unsigned i = 1; i < n && !found; i++) {
+    if ((found = strcmp(base_name(sorted[i - 1]), base_name(sorted[i])) == 0))
+      fprintf(stderr, "Error: %s and %s would both write %s/%s\n", sorted[i - 1], sorted[i], outdir,
+              base_name(sorted[i]));
+  }
+  free(sorted);
+  return found;
+}
+
+// nanomagick batch <jobs> <stages> <list.txt|glob> <outdir>
+static int batch(int argc, char *argv[]) {
+  if (argc != 4) {
+    fprintf(stderr, "Error: Wrong number of arguments for 'batch'\n");
+    return 1;
+  }
+  struct batch b = {.nstages = 0};
+  int jobs = atoi(argv[0]), ret = 1;
+  if (jobs <= 0) jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (jobs <= 0) jobs = 1;
+  char *spec = strdup(argv[1]);
+  if (!spec || (b.nstages = pipe_parse(spec, b.stages)) <= 0) {
+    free(spec);
+    return 1;
+  }
+
+  glob_t g = {0};
+  int globbed = strpbrk(argv[2], "*?[") != NULL;
+  b.paths = batch_paths(argv[2], &b.npaths, &g);
+  if (!b.paths || b.npaths == 0) {
+    fprintf(stderr, "Error: No input files in %s\n", argv[2]);
+    goto end;
+  }
+  if (batch_collision(b.paths, b.npaths, argv[3])) goto end;
+
+  // two slots per worker keep every stage busy: one being read or written, one computed
+  int nslots = jobs * 2 + 2, items[3][64];
+  if (nslots > 64) nslots = 64;
+  struct slot slots[64] = {{0}};
+  b.slots = slots;
+  b.lock = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+  queue_init(&b.free, items[0], nslots);
+  queue_init(&b.ready, items[1], nslots);
+  queue_init(&b.done, items[2], nslots);
+  for (int i = 0; i < nslots; i++) queue_push(&b.free, i);
+
+  double start = now_ms(), write_ms = 0;
+  pthread_t reader, workers[256];
+  if (jobs > 256) jobs = 256;
+  if (pthread_create(&reader, NULL, batch_reader, &b) != 0) {
+    fprintf(stderr, "Error: Could not start threads\n");
+    goto end;
+  }
+  // workers only count themselves down once the reader closes the ready queue
+  int started = 0;
+  while (started < jobs && pthread_create(&workers[started], NULL, batch_worker, &b) == 0)
+    started++;
+  pthread_mutex_lock(&b.lock);
+  b.workers = started;
+  pthread_mutex_unlock(&b.lock);
+  if (started == 0) {
+    fprintf(stderr, "Error: Could not start threads\n");
+    queue_close(&b.free);  // the reader stops once the remaining slots are used
+    while (queue_pop(&b.ready) >= 0) {}
+    pthread_join(reader, NULL);
+    for (int i = 0; i < nslots; i++) free(slots[i].in);
+    goto end;
+  }
+  if (started < jobs) fprintf(stderr, "Warning: %d of %d workers started\n", started, jobs);
+  jobs = started;
+
+  unsigned ok = 0, failed = 0;
+  unsigned long long pixels = 0;
+  char out[4096];
+  for (int k; (k = queue_pop(&b.done)) >= 0;) {
+    struct slot *s = &b.slots[k];
+    snprintf(out, sizeof(out), "%s/%s", argv[3], base_name(s->path));
+    double t = now_ms();
+    if (gs_valid(s->res) && gs_write_pgm(s->res, out) == 0) {
+      ok++, pixels += (unsigned long long)s->img.w * s->img.h;
+    } else {
+      fprintf(stderr, "Error: Could not process %s\n", s->path);
+      failed++;
+    }
+    write_ms += now_ms() - t;
+    queue_push(&b.free, k);
+  }
+  pthread_join(reader, NULL);
+  for (int i = 0; i < jobs; i++) pthread_join(workers[i], NULL);
+  double wall = now_ms() - start;
+
+  fprintf(stderr, "%u files (%u failed), %d workers, %.1f ms\n", ok + failed, failed, jobs, wall);
+  fprintf(stderr, "  %.1f files/s, %.1f Mpx/s\n", ok * 1e3 / wall, pixels / wall / 1e3);
+  fprintf(stderr, "  read %.3f ms/file, write %.3f ms/file, per-stage compute:\n",
+          b.read_ms / b.npaths, write_ms / b.npaths);
+  pipe_report(b.stages, b.nstages, b.ms, b.npaths);
+  for (int i = 0; i < nslots; i++) free(slots[i].in), free(slots[i].out);
+  ret = failed > 0;
+end:
+  if (globbed) {
+    globfree(&g);
+  } else if (b.paths) {
+    for (unsigned i = 0; i < b.npaths; i++) free(b.paths[i]);
+    free(b.paths);
+  }
+  free(spec);
+  return ret;
 }
 
 struct cmd {
@@ -386,31 +1432,46 @@ struct cmd {
     {"view", "                 Display image in terminal", 0, 0, view},
     {"resize", "<w> <h>        Resize image to WxH", 2, 1, resize},
     {"crop", "<x> <y> <w> <h>  Crop image to rectangle (x,y,w,h)", 4, 1, crop},
+    {"rotate", "<deg>          Rotate image clockwise by DEG degrees", 1, 1, rotate},
     {"blur", "<r>              Blur image with radius R", 1, 1, blur},
     {"threshold", "<t>         Apply threshold (0-255 or otsu)", 1, 1, threshold},
     {"adaptive", "<r> <c>      Apply adaptive threshold, radius R and constant C", 2, 1, adaptive},
     {"sobel", "                Edge detection (Sobel)", 0, 1, sobel},
     {"morph", "<op> <n>        Morphological operation (erode/dilate) N times", 2, 1, morph},
+    {"thin", "<zs|gh>          Thin light strokes to skeletons (Zhang-Suen/Guo-Hall)", 1, 1, thin},
+    {"fill", "<x> <y> <v> <t>  Flood fill from (x,y) with V, 8-connected, tolerance T", 4, 1, fill},
+    {"holes", "                Fill holes of light regions", 0, 1, holes},
     {"blobs", "<n>             Find up to N blobs", 1, 1, blobs},
+    {"lines", "<t> <len>       Find line segments of T votes and LEN pixels", 2, 1, lines},
     {"scan", "                 Simple document scanner", 0, 1, scan},
+    {"deskew", "               Straighten the text lines of a page", 0, 1, deskew},
+    {"codes", "<m>             Find QR codes with modules of M+ pixels and barcodes", 1, 1, codes},
     {"keypoints", "<n> <t>     Detect N keypoints with threshold T", 2, 1, keypoints},
+    {"corners", "<n> <d>       Detect N Shi-Tomasi corners at least D pixels apart", 2, 1, corners},
     {"orb", "<template.pgm>    Find template in scene using ORB features", 1, 1, orb},
+    {"stereo", "<right.pgm> <d>  Disparity map of a stereo pair, up to D pixels", 2, 1, stereo},
+    {"motion", "<next.pgm>     Global translation to the next frame", 1, 0, motion},
+    {"track", "<next.pgm> <x> <y> <w> <h>  Track box (x,y,w,h) into the next frame", 5, 1, track},
     {"faces", "<n>             Detect faces using LBP cascade with N minNeighbors", 1, 1, faces},
+    {"pipe", "<stages>         Run comma-separated stages in memory with timings", 1, 1, pipe_cmd},
     {NULL, NULL, 0, 0, NULL},
 };
 
 static void usage(const char *app) {
-  printf("Usage: %s <command> [params] [input.pgm] [output.pgm]\n\n", app);
+  printf("Usage: %s [--trace out.json] [--profile] <command> [params] [input.pgm] [output.pgm]\n\n",
+         app);
   printf("Commands:\n");
   for (struct cmd *cmd = commands; cmd->name != NULL; cmd++)
     printf("  %s %s\n", cmd->name, cmd->help);
+  printf("\nBatch mode:\n  %s batch <jobs> <stages> <list.txt|'glob'> <outdir>\n", app);
 }
 
-int main(int argc, char *argv[]) {
+static int nanomagick(int argc, char *argv[]) {
   if (argc < 2 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
     usage(argv[0]);
     return 1;
   }
+  if (strcmp(argv[1], "batch") == 0) return batch(argc - 2, argv + 2);
 
   for (struct cmd *cmd = commands; cmd->name != NULL; cmd++) {
     if (strcmp(argv[1], cmd->name) != 0) continue;
@@ -420,20 +1481,27 @@ int main(int argc, char *argv[]) {
       usage(argv[0]);
       return 1;
     }
+    GS_TRACE_BEGIN("gs_read_pgm", 0);
     struct gs_image img = gs_read_pgm(argv[cmd->argc + 2]);
+    GS_TRACE_END("gs_read_pgm");
     if (!gs_valid(img)) {
       fprintf(stderr, "Error: Could not load %s\n", argv[cmd->argc + 2]);
       return 1;
     }
     struct gs_image out = {0, 0, NULL};
+    GS_TRACE_BEGIN(cmd->name, img.w * img.h);
     cmd->func(img, &out, argv + 2);
+    GS_TRACE_END(cmd->name);
     if (cmd->hasout) {
       if (!out.data) {
         fprintf(stderr, "Error: Command '%s' did not produce output image\n", argv[1]);
         gs_free(img);
         return 1;
       }
-      if (gs_write_pgm(out, argv[cmd->argc + 3]) != 0) {
+      GS_TRACE_BEGIN("gs_write_pgm", 0);
+      int err = gs_write_pgm(out, argv[cmd->argc + 3]);
+      GS_TRACE_END("gs_write_pgm");
+      if (err != 0) {
         fprintf(stderr, "Error: Could not save %s\n", argv[cmd->argc + 3]);
         gs_free(img);
         gs_free(out);
@@ -447,3 +1515,27 @@ int main(int argc, char *argv[]) {
   printf("Error: Unknown command '%s'\n", argv[1]);
   return 1;
 }
+
+int main(int argc, char *argv[]) {
+  const char *trace_path = NULL;
+  int n = 0;
+  while (n + 1 < argc) {
+    if (strcmp(argv[n + 1], "--trace") == 0 && n + 2 < argc) {
+      tracing |= TRACE_JSON, trace_path = argv[n + 2], n += 2;
+    } else if (strcmp(argv[n + 1], "--profile") == 0) {
+      tracing |= TRACE_PROFILE, n++;
+    } else {
+      break;
+    }
+  }
+  argv[n] = argv[0];
+  trace_t0 = now_ms();
+  int ret = nanomagick(argc - n, argv + n);
+  if (trace_path && trace_write(trace_path) != 0) {
+    fprintf(stderr, "Error: Could not save %s\n", trace_path);
+    ret = 1;
+  }
+  if (tracing & TRACE_PROFILE) trace_report();
+  free(trace_events);
+  return ret;
+}
@@ -0,0 +1,131 @@
+// Benchmarks the scalar, SIMD and threads builds headless on testdata/*.pgm and synthetic
+// camera frames: ms per call of the exported operations and fps of whole demo frames.
+//   make wasm && node examples/wasm/bench.mjs [--builds scalar,simd] [--threads 3]
+//       [--ops blur3,pipe:edges] [--inputs lena.pgm,640x480] [--time 300] [--json]
+import { availableParallelism } from 'node:os';
+import { parseArgs } from 'node:util';
+import { buildExists, builds, load, readPGM, runPipeline, setImage, testImages } from './node.mjs';
+
+const { values: opts } = parseArgs({
+    options: {
+        builds: { type: 'string', default: Object.keys(builds).join(',') },
+        threads: { type: 'string', default: String(Math.max(availableParallelism() - 1, 1)) },
+        ops: { type: 'string', default: '' },
+        inputs: { type: 'string', default: '' },
+        time: { type: 'string', default: '300' },  // ms per op and build
+        json: { type: 'boolean', default: false },
+    },
+});
+
+// Smooth shading, a few dark boxes and some sensor noise, like a camera frame of a desk
+function synthetic(w, h) {
+    const data = new Uint8Array(w * h);
+    let seed = w * 31 + h;
+    for (let y = 0; y < h; y++) {
+        for (let x = 0; x < w; x++) {
+            const box = ((x * 5 / w) | 0) % 2 && ((y * 4 / h) | 0) % 2 && (x + y) % 97 > 8;
+            const v = box ? 40 : 120 + 80 * x / w + 40 * y / h;
+            seed = (seed * 1103515245 + 12345) >>> 0;
+            data[y * w + x] = Math.max(0, Math.min(255, v + (seed >>> 28) - 8));
+        }
+    }
+    return { w, h, data };
+}
+
+// Each op has an optional setup that runs once before timing and a body that is timed
+const threshold = (g) => (g.gs_copy_image(1, 0), g.gs_threshold_image(1, g.gs_otsu_threshold_image(0)));
+const ops = {
+    rgba_to_gray: { run: (g) => g.gs_rgba_to_gray_image(1) },
+    rgba_to_gray_half: { run: (g) => g.gs_rgba_to_gray_half_image(1, g.w, g.h) },
+    gray_to_rgba: { run: (g) => g.gs_gray_to_rgba_image(0) },
+    copy: { run: (g) => g.gs_copy_image(1, 0) },
+    blur3: { run: (g) => g.gs_blur_image(1, 0, 3) },
+    blur7: { run: (g) => g.gs_blur_image(1, 0, 7) },
+    sobel: { run: (g) => g.gs_sobel_image(1, 0) },
+    otsu: { run: (g) => g.gs_otsu_threshold_image(0) },
+    threshold: { setup: (g) => g.gs_copy_image(1, 0), run: (g) => g.gs_threshold_image(1, 128) },
+    adaptive: { run: (g) => g.gs_adaptive_threshold_image(1, 0, 15) },
+    erode: { run: (g) => g.gs_erode_image(1, 0) },
+    dilate: { run: (g) => g.gs_dilate_image(1, 0) },
+    blobs: { setup: threshold, run: (g) => g.gs_detect_blobs(1, 100) },
+    contour: { setup: threshold, run: (g) => g.gs_detect_largest_blob_contour(1, 50) },
+    fast: { run: (g) => g.gs_detect_fast_keypoints(0, 20, 500) },
+    orb: { run: (g) => g.gs_extract_orb_features(0, 20, 300) },
+    match: {
+        setup: (g) => g.gs_store_template_keypoints(g.norb = g.gs_extract_orb_features(0, 20, 300)),
+        run: (g) => g.gs_match_orb_features(g.norb, g.norb, 60),
+    },
+    faces: { run: (g) => g.gs_detect_faces(0, 2) },
+};
+
+// Whole demo frames: RGBA in, pipeline, RGBA out, with op lists as built in the demo UI
+const pipelines = {
+    blur: [[1, 3, 0]],
+    edges: [[1, 2, 0], [2, 0, 0], [3, 0, 0], [7, 2, 0], [8, 20, 0]],
+    contour: [[1, 3, 0], [3, 0, 0], [9, 0, 0]],
+    keypoints: [[1, 1, 0], [10, 20, 300]],
+    orb: [[11, 30, 100]],
+    faces: [[12, 2, 0]],
+};
+for (const [name, pipeline] of Object.entries(pipelines)) {
+    ops[`pipe:${name}`] = {
+        frame: true,
+        run: (g) => {
+            g.gs_rgba_to_gray_image(0);
+            g.gs_gray_to_rgba_image(runPipeline(g, pipeline)[0]);
+        },
+    };
+}
+
+function bench(g, img, op) {
+    setImage(g, img);
+    const rgba = new Uint8Array(g.memory.buffer, g.gs_get_rgba_data(img.w, img.h), img.w * img.h * 4);
+    for (let i = 0; i < rgba.length; i++) rgba[i] = (i & 3) === 3 ? 255 : img.data[i >> 2];
+    if (op.setup) op.setup(g);
+    for (let i = 0; i < 2; i++) op.run(g);  // warm up
+    const budget = Number(opts.time);
+    let iterations = 0, elapsed = 0;
+    const start = performance.now();
+    while (iterations < 3 || elapsed < budget) {
+        op.run(g);
+        iterations++;
+        elapsed = performance.now() - start;
+    }
+    return { ms: elapsed / iterations, iterations };
+}
+
+const list = (s) => s.split(',').map((x) => x.trim()).filter(Boolean);
+const inputNames = opts.inputs ? list(opts.inputs) : [...testImages(), '320x240', '640x480', '1280x720'];
+const opNames = opts.ops ? list(opts.ops) : Object.keys(ops);
+for (const name of opNames) if (!ops[name]) throw new Error(`unknown op ${name}`);
+
+const loaded = {};
+for (const name of list(opts.builds)) {
+    if (!buildExists(name)) {
+        console.warn(`skipping ${name}: ${builds[name]} not found, run make wasm`);
+        continue;
+    }
+    loaded[name] = await load(name, Number(opts.threads));
+}
+
+const results = [];
+for (const input of inputNames) {
+    const size = input.match(/^(\d+)x(\d+)$/);
+    const img = size ? synthetic(Number(size[1]), Number(size[2])) : readPGM(input);
+    if (!opts.json) {
+        console.log(`\n${input} (${img.w}x${img.h}), ms per call, fps for whole frames`);
+        console.log(['op'.padEnd(20), ...Object.keys(loaded).map((b) => b.padStart(20))].join(''));
+    }
+    for (const name of opNames) {
+        const row = [name.padEnd(20)];
+        for (const [build, g] of Object.entries(loaded)) {
+            const r = bench(g, img, ops[name]);
+            results.push({ input, op: name, build, ...r });
+            const fps = ops[name].frame ? ` (${(1000 / r.ms).toFixed(0)} fps)` : '';
+            row.push(` ${r.ms.toFixed(3)}${fps}`.padStart(20));
+        }
+        if (!opts.json) console.log(row.join(''));
+    }
+}
+if (opts.json) console.log(JSON.stringify(results, null, 2));
+process.exit(0);  // helpers of the threads build never return
@@ -0,0 +1,85 @@
+// Runs the same operations on the scalar, SIMD and threads builds and compares the results,
+// headless:
+//   make wasm && node examples/wasm/check.mjs
+import { load, noise, readPGM, runPipeline, setImage } from './node.mjs';
+
+// Returns the bytes produced by an operation: the output image or a list of structs
+const ops = {
+    blur1: (g) => (g.gs_blur_image(1, 0, 1), image(g, 1)),
+    blur7: (g) => (g.gs_blur_image(1, 0, 7), image(g, 1)),
+    threshold: (g) => (g.gs_copy_image(1, 0), g.gs_threshold_image(1, g.gs_otsu_threshold_image(0)), image(g, 1)),
+    sobel: (g) => (g.gs_sobel_image(1, 0), image(g, 1)),
+    erode: (g) => (g.gs_erode_image_iterations(1, 0, 2), image(g, 1)),
+    dilate: (g) => (g.gs_dilate_image_iterations(1, 0, 2), image(g, 1)),
+    // widths that are not multiples of 4 end in the scalar tail of the SIMD loop
+    resize: (g) => Uint8Array.from([[103, 77], [g.w * 2 + 3, g.h + 1]].flatMap(([w, h]) => {
+        g.gs_resize_image(1, 0, w, h);
+        return [...new Uint8Array(g.memory.buffer, g.gs_get_image_data(1), w * h)];
+    })),
+    fast: (g) => structs(g, g.gs_detect_fast_keypoints(0, 20, 500), g.gs_get_keypoint),
+    orb: (g) => structs(g, g.gs_extract_orb_features(0, 20, 300), g.gs_get_orb_keypoint),
+    faces: (g) => structs(g, g.gs_detect_faces(0, 2), g.gs_get_face),
+    pipeline: (g) => {
+        // blur 2, sobel, otsu, dilate 2, blobs 20, keypoints 20/200, faces 2
+        const ops = [[1, 2, 0], [2, 0, 0], [3, 0, 0], [7, 2, 0], [8, 20, 0], [10, 20, 200], [12, 2, 0]];
+        const result = runPipeline(g, ops);
+        const counts = [0, 1, 3, 5, 7, 9, 11].map(i => result[i]);
+        return new Uint8Array([...image(g, result[0]), ...new Uint8Array(Uint32Array.from(counts).buffer)]);
+    },
+    rgba: (g) => {
+        const rgba = new Uint8Array(g.memory.buffer, g.gs_get_rgba_data(g.w, g.h), g.w * g.h * 4);
+        const gray = image(g, 0);
+        for (let i = 0; i < rgba.length; i++) rgba[i] = gray[i >> 2] ^ (i * 37);
+        g.gs_rgba_to_gray_image(1);
+        g.gs_gray_to_rgba_image(1);
+        return rgba.slice();
+    },
+    rgba_half: (g) => {
+        const rgba = new Uint8Array(g.memory.buffer, g.gs_get_rgba_data(g.w, g.h), g.w * g.h * 4);
+        const gray = image(g, 0);
+        for (let i = 0; i < rgba.length; i++) rgba[i] = gray[i >> 2] ^ (i * 37);
+        g.gs_rgba_to_gray_half_image(1, g.w, g.h);
+        return new Uint8Array(g.memory.buffer, g.gs_get_image_data(1), (g.w >> 1) * (g.h >> 1)).slice();
+    },
+};
+
+function image(g, idx) {
+    return new Uint8Array(g.memory.buffer, g.gs_get_image_data(idx), g.w * g.h).slice();
+}
+
+function structs(g, n, get) {
+    if (n === 0) return new Uint8Array(0);
+    const size = get(1) - get(0);
+    return new Uint8Array(g.memory.buffer, get(0), n * size).slice();
+}
+
+function run(g, img, op) {
+    setImage(g, img);
+    return ops[op](g);
+}
+
+const scalar = await load('scalar');
+// 3 and 1 helpers split rows into 8 and 4 bands, the caller runs jobs alongside them
+const builds = {
+    simd: await load('simd'),
+    threads: await load('threads', 3),
+    threads1: await load('threads', 1),
+};
+const inputs = {
+    'aruco.pgm': readPGM('aruco.pgm'),
+    'lena.pgm': readPGM('lena.pgm'),
+    'noise 321x203': noise(321, 203, 1),
+};
+let failed = 0;
+for (const [name, img] of Object.entries(inputs)) {
+    for (const op of Object.keys(ops)) {
+        const a = run(scalar, img, op);
+        for (const [build, g] of Object.entries(builds)) {
+            const b = run(g, img, op);
+            const same = a.length === b.length && a.every((v, i) => v === b[i]);
+            if (!same) failed++;
+            console.log(`${same ? 'ok  ' : 'FAIL'} ${op.padEnd(10)} ${build.padEnd(8)} ${name}`);
+        }
+    }
+}
+process.exit(failed ? 1 : 0);
@@ -0,0 +1,26 @@
+// Worker of the threads build, every worker is an instance of grayskull-threads.wasm on the
+// shared memory with its own stack. The leader runs whole frames for the main thread, which is
+// not allowed to block, helpers park in gs_worker_loop() and take rows and scales from it.
+let wasm, memory;
+
+onmessage = async ({ data }) => {
+    if (data.type === 'init') {
+        memory = data.memory;
+        const instance = await WebAssembly.instantiate(data.module, { env: { memory } });
+        wasm = instance.exports;
+        wasm.__stack_pointer.value = data.stackTop;
+        if (data.role === 'helper') wasm.gs_worker_loop();  // never returns
+        postMessage({ type: 'ready' });
+    } else if (data.type === 'frame') {
+        // Same steps as runFrame() in grayskull.js
+        wasm.gs_rgba_to_gray_image(0);
+        let templateCount = 0;
+        if (data.captureTemplate) {
+            templateCount = wasm.gs_extract_orb_features(0, 20, 200);
+            if (templateCount > 0) wasm.gs_store_template_keypoints(templateCount);
+        }
+        const result = wasm.gs_run_pipeline();
+        wasm.gs_gray_to_rgba_image(new Uint32Array(memory.buffer, result, 1)[0]);
+        postMessage({ type: 'frame', result, templateCount });
+    }
+};
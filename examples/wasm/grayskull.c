@@ -1,20 +1,64 @@
 #include <stddef.h>
 
-// A simple bump allocator for our WASM module since we don't have stdlib.
-#define MEMORY_HEAP_SIZE (1024 * 1024 * 8)  // 8MB heap for a few buffers
-static unsigned char memory_heap[MEMORY_HEAP_SIZE];
-static size_t heap_ptr = 0;
+// Heap allocator for our WASM module since we don't have stdlib. Blocks are carved from the
+// memory above __heap_base, which grows with memory.grow, in size classes of 4/4, 5/4, 6/4 and
+// 7/4 times a power of two. Freed blocks go to the free list of their class and are reused as
+// is, so buffers reallocated for a new camera resolution don't leak. Not thread safe: only the
+// thread running a frame allocates.
+extern unsigned char __heap_base;
+
+#define HEAP_HEADER 16  // keeps blocks 16-byte aligned for SIMD
+#define HEAP_CLASSES 112
+
+static void* heap_free[HEAP_CLASSES];
+static size_t heap_top;
+
+static size_t heap_class_size(unsigned c) { return (size_t)(4 + (c & 3)) << (c >> 2); }
+
 void* gs_alloc(size_t size) {
-  size_t aligned_size = (size + 7) & ~7;
-  if (heap_ptr + aligned_size > MEMORY_HEAP_SIZE) return NULL;
-  void* ptr = &memory_heap[heap_ptr];
-  heap_ptr += aligned_size;
+  unsigned c = 16;  // 64 bytes
+  while (c < HEAP_CLASSES && heap_class_size(c) < size + HEAP_HEADER) c++;
+  if (c == HEAP_CLASSES) return NULL;
+  unsigned char* p = heap_free[c];
+  if (p) {
+    heap_free[c] = *(void**)p;
+  } else {
+    if (heap_top == 0) heap_top = ((size_t)&__heap_base + 15) & ~(size_t)15;
+    size_t end = heap_top + heap_class_size(c), mem = __builtin_wasm_memory_size(0) * 65536;
+    if (end < heap_top) return NULL;
+    if (end > mem && __builtin_wasm_memory_grow(0, (end - mem + 65535) / 65536) == (size_t)-1)
+      return NULL;
+    p = (unsigned char*)heap_top;
+    heap_top = end;
+  }
+  *(unsigned*)p = c;
+  return p + HEAP_HEADER;
+}
+
+void gs_free(void* ptr) {
+  if (ptr == NULL) return;
+  unsigned char* p = (unsigned char*)ptr - HEAP_HEADER;
+  unsigned c = *(unsigned*)p;
+  *(void**)p = heap_free[c];
+  heap_free[c] = p;
+}
+
+// Reallocates a buffer that only ever needs to hold the latest size, contents are not kept
+static void* gs_realloc_buffer(void* ptr, size_t* cap, size_t size) {
+  if (ptr != NULL && size <= *cap) return ptr;
+  gs_free(ptr);
+  ptr = gs_alloc(size);
+  *cap = ptr ? size : 0;
   return ptr;
 }
-void gs_free(void* ptr) { (void)ptr; /* No-op for bump allocator */ }
-void gs_reset_allocator(void) { heap_ptr = 0; }
 
-// Minimal standard library functions for WASM nostdlib build
+// Minimal standard library functions for WASM nostdlib build, the compiler may emit calls to
+// them. With -mbulk-memory the builtins are single memory.fill/memory.copy instructions.
+#ifdef __wasm_bulk_memory__
+void* memset(void* s, int c, size_t n) { return __builtin_memset(s, c, n); }
+void* memcpy(void* dest, const void* src, size_t n) { return __builtin_memcpy(dest, src, n); }
+void* memmove(void* dest, const void* src, size_t n) { return __builtin_memmove(dest, src, n); }
+#else
 void* memset(void* s, int c, size_t n) {
   unsigned char* p = (unsigned char*)s;
   for (size_t i = 0; i < n; i++) p[i] = (unsigned char)c;
@@ -28,6 +72,18 @@ void* memcpy(void* dest, const void* src, size_t n) {
   return dest;
 }
 
+void* memmove(void* dest, const void* src, size_t n) {
+  unsigned char* d = (unsigned char*)dest;
+  const unsigned char* s = (const unsigned char*)src;
+  if (d < s) {
+    for (size_t i = 0; i < n; i++) d[i] = s[i];
+  } else {
+    for (size_t i = n; i > 0; i--) d[i - 1] = s[i - 1];
+  }
+  return dest;
+}
+#endif
+
 #define gs_assert(cond)
 #define GS_NO_STDLIB
 #define GS_API
@@ -36,15 +92,177 @@ void* memcpy(void* dest, const void* src, size_t n) {
 
 #define NUM_BUFFERS 3
 static struct gs_image images[NUM_BUFFERS];
+static size_t images_cap[NUM_BUFFERS];
+
+//
+// Per-frame scratch arena for temporaries (visited maps, score maps, integral images, bands).
+// A call takes a mark and releases it when it returns, releasing mark 0 ends the frame: what
+// did not fit into the arena came from gs_alloc(), is freed, and the arena grows to fit the
+// whole frame next time. Memory stays bounded by the largest frame.
+//
+#define SCRATCH_OVERFLOW 16
+
+static struct {
+  unsigned char* base;
+  size_t size, used;  // used counts overflow blocks too, so it may exceed size
+  void* overflow[SCRATCH_OVERFLOW];
+  int noverflow;
+} scratch;
+
+static size_t scratch_mark(void) { return scratch.used; }
+
+static void* scratch_alloc(size_t size) {
+  size = (size + 15) & ~(size_t)15;
+  void* p;
+  if (scratch.used + size <= scratch.size) {
+    p = scratch.base + scratch.used;
+  } else if (scratch.noverflow < SCRATCH_OVERFLOW && (p = gs_alloc(size)) != NULL) {
+    scratch.overflow[scratch.noverflow++] = p;
+  } else {
+    return NULL;
+  }
+  scratch.used += size;
+  return p;
+}
+
+static void scratch_release(size_t mark) {
+  if (mark > 0) {
+    if (scratch.noverflow == 0) scratch.used = mark;  // else dropped when the frame ends
+    return;
+  }
+  for (int i = 0; i < scratch.noverflow; i++) gs_free(scratch.overflow[i]);
+  if (scratch.used > scratch.size) {
+    gs_free(scratch.base);
+    scratch.base = gs_alloc(scratch.used);
+    scratch.size = scratch.base ? scratch.used : 0;
+  }
+  scratch.used = 0;
+  scratch.noverflow = 0;
+}
+
+//
+// Worker pool of the threads build (-matomics, shared memory). Workers are extra instances of
+// this module on the same memory, each with its own stack, parked in gs_worker_loop().
+// gs_parallel() hands out items to them and to the calling thread, which must be a worker as
+// well: the browser main thread is not allowed to wait. Other builds run items in order.
+//
+typedef void (*task_fn)(int i, void* arg);
+
+static int pool_size;  // workers in gs_worker_loop(), not counting the caller of gs_parallel()
+
+void gs_set_workers(int n) { pool_size = n < 0 ? 0 : n; }
+
+#ifdef __wasm_atomics__
+#define atomic_load(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define atomic_store(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define atomic_add(p, v) __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+
+static task_fn job_fn;
+static void* job_arg;
+static int job_count, job_pending, job_gen;
+static int job_next = INT_MAX / 2;  // past any job_count while no job is posted
+
+static void run_jobs(void) {
+  int i;
+  // a claimed item belongs to the current job, the next one is posted only after it is done
+  while ((i = atomic_add(&job_next, 1) - 1) < atomic_load(&job_count)) {
+    atomic_load(&job_fn)(i, atomic_load(&job_arg));
+    if (atomic_add(&job_pending, -1) == 0) __builtin_wasm_memory_atomic_notify(&job_pending, 1);
+  }
+}
+
+void gs_worker_loop(void) {
+  int seen = atomic_load(&job_gen);
+  for (;;) {
+    int gen;
+    while ((gen = atomic_load(&job_gen)) == seen)
+      __builtin_wasm_memory_atomic_wait32(&job_gen, seen, -1);
+    seen = gen;
+    run_jobs();
+  }
+}
+
+static void gs_parallel(int n, task_fn fn, void* arg) {
+  if (pool_size == 0 || n < 2) {
+    for (int i = 0; i < n; i++) fn(i, arg);
+    return;
+  }
+  atomic_store(&job_fn, fn);
+  atomic_store(&job_arg, arg);
+  atomic_store(&job_count, n);
+  atomic_store(&job_pending, n);
+  atomic_store(&job_next, 0);
+  atomic_add(&job_gen, 1);
+  __builtin_wasm_memory_atomic_notify(&job_gen, pool_size);
+  run_jobs();
+  int pending;
+  while ((pending = atomic_load(&job_pending)) > 0)
+    __builtin_wasm_memory_atomic_wait32(&job_pending, pending, -1);
+  atomic_store(&job_next, INT_MAX / 2);
+}
+#else
+static void gs_parallel(int n, task_fn fn, void* arg) {
+  for (int i = 0; i < n; i++) fn(i, arg);
+}
+#endif
+
+// Row bands: blur reads a margin of radius rows around its band and goes through a scratch
+// band, Sobel never writes the first and last row of its input, so one row of margin is enough
+#define MAX_BANDS 16
+
+struct bands {
+  int op, arg, n;
+  struct gs_image dst, src;
+  uint8_t* scratch;
+};
+static struct bands bands;
+
+enum { BAND_BLUR, BAND_SOBEL, BAND_THRESHOLD };
+
+static struct gs_image image_rows(struct gs_image img, unsigned y0, unsigned y1) {
+  return (struct gs_image){img.w, y1 - y0, img.data + y0 * img.w};
+}
+
+static void band_task(int i, void* arg) {
+  struct bands* b = arg;
+  unsigned w = b->src.w, h = b->src.h, y0 = h * i / b->n, y1 = h * (i + 1) / b->n;
+  if (b->op == BAND_THRESHOLD) {
+    gs_threshold(image_rows(b->src, y0, y1), b->arg);
+  } else if (b->op == BAND_SOBEL) {
+    unsigned a = y0 > 0 ? y0 - 1 : 0, e = y1 < h ? y1 + 1 : h;
+    gs_sobel(image_rows(b->dst, a, e), image_rows(b->src, a, e));
+  } else {
+    unsigned r = b->arg, a = y0 > r ? y0 - r : 0, e = GS_MIN(h, y1 + r);
+    struct gs_image tmp = {w, e - a, b->scratch + (y0 + 2 * r * i) * w};
+    gs_blur(tmp, image_rows(b->src, a, e), r);
+    gs_crop(image_rows(b->dst, y0, y1), tmp, (struct gs_rect){0, y0 - a, w, y1 - y0});
+  }
+}
+
+static void run_bands(int op, struct gs_image dst, struct gs_image src, int arg) {
+  int n = GS_MIN(MAX_BANDS, (pool_size + 1) * 2);
+  if (n > (int)src.h) n = src.h;
+  size_t mark = scratch_mark();
+  uint8_t* tmp = NULL;
+  if (op == BAND_BLUR && pool_size > 0) tmp = scratch_alloc(((size_t)src.h + 2 * arg * n) * src.w);
+  if (pool_size == 0 || (op == BAND_BLUR && tmp == NULL)) {  // one band
+    if (op == BAND_BLUR) gs_blur(dst, src, arg);
+    if (op == BAND_SOBEL) gs_sobel(dst, src);
+    if (op == BAND_THRESHOLD) gs_threshold(src, arg);
+  } else {
+    bands = (struct bands){op, arg, n, dst, src, tmp};
+    gs_parallel(n, band_task, &bands);
+  }
+  scratch_release(mark);
+}
 
 // Functions to be exported to WASM
+// Can be called again when the camera resolution changes, the buffer grows if needed
 void gs_init_image(int idx, int w, int h) {
-  if (idx < 0 || idx >= NUM_BUFFERS) return;
-  // Simple bump allocation, so we just allocate once on first use.
-  // gs_reset_allocator() must be called from JS if sizes change.
-  if (images[idx].data == NULL) { images[idx].data = gs_alloc(w * h); }
-  images[idx].w = w;
-  images[idx].h = h;
+  if (idx < 0 || idx >= NUM_BUFFERS || w < 0 || h < 0) return;
+  images[idx].data = gs_realloc_buffer(images[idx].data, &images_cap[idx], (size_t)w * h);
+  images[idx].w = images[idx].data ? w : 0;
+  images[idx].h = images[idx].data ? h : 0;
 }
 
 uint8_t* gs_get_image_data(int idx) {
@@ -52,9 +270,56 @@ uint8_t* gs_get_image_data(int idx) {
   return images[idx].data;
 }
 
+// RGBA frame shared with JS: a canvas frame is copied in with one set() and the result is
+// shown with an ImageData on top of the same memory, so JS never touches single pixels.
+static uint8_t* rgba_buffer;
+static size_t rgba_size;
+
+uint8_t* gs_get_rgba_data(int w, int h) {
+  if (w < 0 || h < 0) return NULL;
+  rgba_buffer = gs_realloc_buffer(rgba_buffer, &rgba_size, (size_t)w * h * 4);
+  return rgba_buffer;
+}
+
+// A w x h image fits in the RGBA frame from the last gs_get_rgba_data()
+static int rgba_fits(unsigned w, unsigned h) {
+  return rgba_buffer != NULL && w > 0 && h > 0 && (size_t)w * h * 4 <= rgba_size;
+}
+
+void gs_rgba_to_gray_image(int dst_idx) {
+  if (dst_idx < 0 || dst_idx >= NUM_BUFFERS || !gs_valid(images[dst_idx])) return;
+  if (!rgba_fits(images[dst_idx].w, images[dst_idx].h)) return;
+  gs_rgba_to_gray(images[dst_idx], rgba_buffer);
+}
+
+// Converts and downsamples a w x h frame at once, dst becomes w/2 x h/2
+void gs_rgba_to_gray_half_image(int dst_idx, int w, int h) {
+  if (dst_idx < 0 || dst_idx >= NUM_BUFFERS || w < 2 || h < 2 || !rgba_fits(w, h)) return;
+  gs_init_image(dst_idx, w / 2, h / 2);
+  if (!gs_valid(images[dst_idx])) return;
+  gs_rgba_to_gray_half(images[dst_idx], rgba_buffer, w);
+}
+
+void gs_gray_to_rgba_image(int src_idx) {
+  if (src_idx < 0 || src_idx >= NUM_BUFFERS || !gs_valid(images[src_idx])) return;
+  if (!rgba_fits(images[src_idx].w, images[src_idx].h)) return;
+  gs_gray_to_rgba(rgba_buffer, images[src_idx]);
+}
+
 void gs_copy_image(int dst_idx, int src_idx) {
   if (dst_idx < 0 || dst_idx >= NUM_BUFFERS || src_idx < 0 || src_idx >= NUM_BUFFERS) return;
-  gs_copy(images[dst_idx], images[src_idx]);
+  struct gs_image dst = images[dst_idx], src = images[src_idx];
+  if (dst.w != src.w || dst.h != src.h) return;
+  gs_copy(dst, src);
+}
+
+// dst becomes w x h, bilinear
+void gs_resize_image(int dst_idx, int src_idx, int w, int h) {
+  if (dst_idx < 0 || dst_idx >= NUM_BUFFERS || src_idx < 0 || src_idx >= NUM_BUFFERS) return;
+  if (dst_idx == src_idx) return;
+  gs_init_image(dst_idx, w, h);
+  if (!gs_valid(images[dst_idx]) || !gs_valid(images[src_idx])) return;
+  gs_resize(images[dst_idx], images[src_idx]);
 }
 
 void gs_blur_image(int dst_idx, int src_idx, int radius) {
@@ -136,17 +401,20 @@ void gs_sobel_image(int dst_idx, int src_idx) {
   gs_sobel(images[dst_idx], images[src_idx]);
 }
 
-// Blob detection functions
-static gs_label labels_buffer[640 * 480];  // Max image size buffer for labels
-static struct gs_blob blobs_buffer[200];   // Buffer for blob storage
+// Blob detection functions, labels outlive the call for blob corners and contours
+static gs_label* labels_buffer;
+static size_t labels_cap;
+static struct gs_blob blobs_buffer[200];  // Buffer for blob storage
 
 unsigned gs_detect_blobs(int src_idx, unsigned max_blobs) {
   if (src_idx < 0 || src_idx >= NUM_BUFFERS) return 0;
   if (max_blobs > 200) max_blobs = 200;  // Limit to buffer size
 
   unsigned size = images[src_idx].w * images[src_idx].h;
-  for (unsigned i = 0; i < size; i++) labels_buffer[i] = 0;
-  for (unsigned i = 0; i < max_blobs; i++) blobs_buffer[i] = (struct gs_blob){0};
+  labels_buffer = gs_realloc_buffer(labels_buffer, &labels_cap, size * sizeof(gs_label));
+  if (labels_buffer == NULL) return 0;
+  memset(labels_buffer, 0, size * sizeof(gs_label));
+  memset(blobs_buffer, 0, max_blobs * sizeof(struct gs_blob));
 
   return gs_blobs(images[src_idx], labels_buffer, blobs_buffer, max_blobs);
 }
@@ -162,7 +430,7 @@ gs_label* gs_get_labels_buffer(void) { return labels_buffer; }
 static struct gs_point blob_corners_buffer[4];
 
 void gs_get_blob_corners(unsigned blob_idx) {
-  if (blob_idx >= 200) return;
+  if (blob_idx >= 200 || labels_buffer == NULL) return;
   gs_blob_corners(images[0], labels_buffer, &blobs_buffer[blob_idx], blob_corners_buffer);
 }
 
@@ -173,7 +441,6 @@ struct gs_point* gs_get_blob_corner(unsigned corner_idx) {
 
 // Contour tracing for largest blob
 static struct gs_contour largest_blob_contour;
-static uint8_t contour_visited_buffer[640 * 480];
 
 void gs_trace_largest_blob_contour(int src_idx) {
   if (src_idx < 0 || src_idx >= NUM_BUFFERS) return;
@@ -187,8 +454,10 @@ void gs_trace_largest_blob_contour(int src_idx) {
   if (blobs_buffer[largest_idx].area == 0) return;
 
   // Set up visited buffer
-  struct gs_image visited = {images[src_idx].w, images[src_idx].h, contour_visited_buffer};
-  for (unsigned i = 0; i < visited.w * visited.h; i++) { visited.data[i] = 0; }
+  size_t mark = scratch_mark();
+  struct gs_image visited = {images[src_idx].w, images[src_idx].h, NULL};
+  if ((visited.data = scratch_alloc(visited.w * visited.h)) == NULL) return;
+  memset(visited.data, 0, visited.w * visited.h);
 
   // Find a starting point on the blob boundary
   largest_blob_contour.start =
@@ -209,20 +478,24 @@ void gs_trace_largest_blob_contour(int src_idx) {
 
 found_start:
   gs_trace_contour(images[src_idx], visited, &largest_blob_contour);
+  scratch_release(mark);
 }
 
 struct gs_contour* gs_get_largest_blob_contour(void) { return &largest_blob_contour; }
 
 // FAST keypoint detection
 static struct gs_keypoint keypoints_buffer[500];
-static uint8_t scoremap_buffer[640 * 480];
 
 unsigned gs_detect_fast_keypoints(int src_idx, unsigned threshold, unsigned max_keypoints) {
   if (src_idx < 0 || src_idx >= NUM_BUFFERS) return 0;
   if (max_keypoints > 500) max_keypoints = 500;
 
-  struct gs_image scoremap = {images[src_idx].w, images[src_idx].h, scoremap_buffer};
-  return gs_fast(images[src_idx], scoremap, keypoints_buffer, max_keypoints, threshold);
+  size_t mark = scratch_mark();
+  struct gs_image scoremap = {images[src_idx].w, images[src_idx].h, NULL};
+  if ((scoremap.data = scratch_alloc(scoremap.w * scoremap.h)) == NULL) return 0;
+  unsigned n = gs_fast(images[src_idx], scoremap, keypoints_buffer, max_keypoints, threshold);
+  scratch_release(mark);
+  return n;
 }
 
 struct gs_keypoint* gs_get_keypoint(unsigned idx) {
@@ -239,8 +512,13 @@ unsigned gs_extract_orb_features(int src_idx, unsigned threshold, unsigned max_k
   if (src_idx < 0 || src_idx >= NUM_BUFFERS) return 0;
   if (max_keypoints > 300) max_keypoints = 300;
 
-  return gs_orb_extract(images[src_idx], orb_keypoints_buffer, max_keypoints, threshold,
-                        scoremap_buffer);
+  size_t mark = scratch_mark();
+  uint8_t* scoremap = scratch_alloc(images[src_idx].w * images[src_idx].h);
+  if (scoremap == NULL) return 0;
+  unsigned n =
+      gs_orb_extract(images[src_idx], orb_keypoints_buffer, max_keypoints, threshold, scoremap);
+  scratch_release(mark);
+  return n;
 }
 
 struct gs_keypoint* gs_get_orb_keypoint(unsigned idx) {
@@ -248,8 +526,11 @@ struct gs_keypoint* gs_get_orb_keypoint(unsigned idx) {
   return &orb_keypoints_buffer[idx];
 }
 
+static unsigned template_count;
+
 void gs_store_template_keypoints(unsigned count) {
   if (count > 300) count = 300;
+  template_count = count;
   for (unsigned i = 0; i < count; i++) { template_keypoints_buffer[i] = orb_keypoints_buffer[i]; }
 }
 
@@ -258,7 +539,7 @@ unsigned gs_match_orb_features(unsigned template_count, unsigned scene_count, fl
   if (scene_count > 300) scene_count = 300;
 
   return gs_match_orb(template_keypoints_buffer, template_count, orb_keypoints_buffer, scene_count,
-                      matches_buffer, 200, max_distance);
+                      matches_buffer, 200, (unsigned)max_distance);
 }
 
 struct gs_match* gs_get_match(unsigned idx) {
@@ -273,7 +554,6 @@ struct gs_keypoint* gs_get_template_keypoint(unsigned idx) {
 
 // Contour detection for largest blob
 static struct gs_contour contour_buffer;
-static uint8_t visited_buffer[640 * 480];
 
 int gs_detect_largest_blob_contour(int src_idx, unsigned max_blobs) {
   if (src_idx < 0 || src_idx >= NUM_BUFFERS) return 0;
@@ -295,8 +575,11 @@ int gs_detect_largest_blob_contour(int src_idx, unsigned max_blobs) {
   if (largest_area < 100) return 0;  // Skip very small blobs
 
   // Initialize visited map
+  size_t mark = scratch_mark();
   unsigned size = images[src_idx].w * images[src_idx].h;
-  for (unsigned i = 0; i < size; i++) visited_buffer[i] = 0;
+  uint8_t* visited_buffer = scratch_alloc(size);
+  if (visited_buffer == NULL) return 0;
+  memset(visited_buffer, 0, size);
 
   struct gs_image visited = {images[src_idx].w, images[src_idx].h, visited_buffer};
 
@@ -317,30 +600,178 @@ int gs_detect_largest_blob_contour(int src_idx, unsigned max_blobs) {
     }
   }
 
-  if (!found) return 0;
+  if (found) gs_trace_contour(images[src_idx], visited, &contour_buffer);
+  scratch_release(mark);
 
-  // Trace contour
-  gs_trace_contour(images[src_idx], visited, &contour_buffer);
-
-  return contour_buffer.length > 0 ? 1 : 0;
+  return found && contour_buffer.length > 0 ? 1 : 0;
 }
 
 struct gs_contour* gs_get_contour(void) { return &contour_buffer; }
 
 // LBP Face detection
-static uint32_t integral_buffer[640 * 480];
+#define MAX_SCALES 16
 static struct gs_rect faces_buffer[100];
 
+// Each scale is scanned by its own worker, results are merged in the order of gs_lbp_detect()
+struct face_scales {
+  struct gs_image img;
+  uint32_t* ii;
+  int step;
+  gs_real scale[MAX_SCALES];
+  unsigned n[MAX_SCALES];
+  struct gs_rect rects[MAX_SCALES][100];
+};
+static struct face_scales face_scales;
+
+static void face_scale_task(int i, void* arg) {
+  struct face_scales* f = arg;
+  f->n[i] = gs_lbp_detect_scale(&frontalface, f->ii, f->img.w, f->img.h, f->rects[i],
+                                100, f->scale[i], f->step);
+}
+
+// Images larger than 640x480 are scanned in 512x512 tiles to keep the integral image small
 unsigned gs_detect_faces(int src_idx, int min_neighbors) {
   if (src_idx < 0 || src_idx >= NUM_BUFFERS) return 0;
-  if (images[src_idx].w * images[src_idx].h > 640 * 480) return 0;
+  if (min_neighbors <= 0) return 0;
+
+  struct gs_image img = images[src_idx];
+  int tiled = img.w * img.h > 640 * 480;
+  size_t mark = scratch_mark();
+  uint32_t* ii = scratch_alloc((tiled ? 512 * 512 : img.w * img.h) * sizeof(uint32_t));
+  if (ii == NULL) return 0;
+  if (tiled) {
+    unsigned n = gs_lbp_detect_tiled(&frontalface, img, ii, 512, 512, faces_buffer, 100,
+                                     GS_REAL(1.2f), GS_REAL(1.0f), GS_REAL(4.0f), min_neighbors);
+    scratch_release(mark);
+    return n;
+  }
 
-  gs_integral(images[src_idx], integral_buffer);
-  return gs_lbp_detect(&frontalface, integral_buffer, images[src_idx].w, images[src_idx].h,
-                       faces_buffer, 100, 1.2f, 1.0f, 4.0f, min_neighbors);
+  struct face_scales* f = &face_scales;
+  int nscales = 0;
+  for (gs_real scale = GS_REAL(1.0f); scale <= GS_REAL(4.0f) && nscales < MAX_SCALES;
+       scale = gs_real_mul(scale, GS_REAL(1.2f))) {
+    int win_w = GS_REAL_INT(frontalface.window_w * scale);
+    int win_h = GS_REAL_INT(frontalface.window_h * scale);
+    if (win_w > (int)img.w || win_h > (int)img.h) break;
+    f->scale[nscales++] = scale;
+  }
+  f->img = img, f->ii = ii, f->step = min_neighbors;
+  gs_integral(img, ii);
+  gs_parallel(nscales, face_scale_task, f);
+  unsigned n = 0;
+  for (int i = 0; i < nscales; i++)
+    for (unsigned j = 0; j < f->n[i] && n < 100; j++) faces_buffer[n++] = f->rects[i][j];
+  scratch_release(mark);
+  return n;
 }
 
 struct gs_rect* gs_get_face(unsigned idx) {
   if (idx >= 100) return NULL;
   return &faces_buffer[idx];
-}
\ No newline at end of file
+}
+
+//
+// Pipeline bytecode: JS writes the op list once with gs_get_pipeline() and
+// gs_set_pipeline_length(), then one gs_run_pipeline() call per frame runs every step. Filters
+// ping-pong between buffers 1 and 2 (the camera frame is in 0), thresholds work in place and
+// detectors only read the current image, so no step copies pixels.
+//
+enum {
+  OP_BLUR = 1,
+  OP_SOBEL,
+  OP_OTSU,
+  OP_THRESH,
+  OP_ADAPTIVE,
+  OP_ERODE,
+  OP_DILATE,
+  OP_BLOBS,
+  OP_CONTOUR,
+  OP_KEYPOINTS,
+  OP_ORB,
+  OP_FACES,
+};
+
+#define MAX_OPS 32
+
+struct op {
+  int code, a, b;  // op code and up to two arguments, 0 means default
+};
+
+// All 32-bit fields, so JS reads it as a Uint32Array
+struct pipeline_result {
+  unsigned image;  // buffer holding the output image
+  unsigned nblobs;
+  struct gs_blob* blobs;
+  unsigned has_contour;
+  struct gs_contour* contour;
+  unsigned nkeypoints;
+  struct gs_keypoint* keypoints;
+  unsigned norb;
+  struct gs_keypoint* orb;
+  unsigned nmatches;
+  struct gs_match* matches;
+  unsigned nfaces;
+  struct gs_rect* faces;
+};
+
+static struct op pipeline[MAX_OPS];
+static int pipeline_len;
+static struct pipeline_result pipeline_result;
+
+struct op* gs_get_pipeline(void) { return pipeline; }
+
+void gs_set_pipeline_length(int n) { pipeline_len = n < 0 ? 0 : (n > MAX_OPS ? MAX_OPS : n); }
+
+struct pipeline_result* gs_run_pipeline(void) {
+  struct pipeline_result* r = &pipeline_result;
+  *r = (struct pipeline_result){0};
+  r->blobs = blobs_buffer, r->contour = &contour_buffer, r->keypoints = keypoints_buffer;
+  r->orb = orb_keypoints_buffer, r->matches = matches_buffer, r->faces = faces_buffer;
+  int cur = 0;
+  for (int i = 0; i < pipeline_len; i++) {
+    struct op* op = &pipeline[i];
+    int next = (cur == 1) ? 2 : 1;
+    switch (op->code) {
+      case OP_BLUR:
+        run_bands(BAND_BLUR, images[next], images[cur], op->a);
+        cur = next;
+        break;
+      case OP_SOBEL:
+        run_bands(BAND_SOBEL, images[next], images[cur], 0);
+        cur = next;
+        break;
+      case OP_OTSU:
+        run_bands(BAND_THRESHOLD, images[cur], images[cur], gs_otsu_threshold(images[cur]));
+        break;
+      case OP_THRESH: run_bands(BAND_THRESHOLD, images[cur], images[cur], op->a); break;
+      case OP_ADAPTIVE:
+        gs_adaptive_threshold(images[next], images[cur], op->a | 1, 2);
+        cur = next;
+        break;
+      case OP_ERODE:
+      case OP_DILATE:
+        for (int k = 0; k < (op->a > 0 ? op->a : 1); k++) {
+          next = (cur == 1) ? 2 : 1;
+          gs_morph(images[next], images[cur], op->code == OP_ERODE ? GS_ERODE : GS_DILATE);
+          cur = next;
+        }
+        break;
+      case OP_BLOBS: r->nblobs = gs_detect_blobs(cur, op->a > 0 ? op->a : 10); break;
+      case OP_CONTOUR:
+        r->has_contour = gs_detect_largest_blob_contour(cur, 50);
+        r->nblobs = 0;  // blobs of the contour search are not an overlay
+        break;
+      case OP_KEYPOINTS:
+        r->nkeypoints =
+            gs_detect_fast_keypoints(cur, op->a > 0 ? op->a : 20, op->b > 0 ? op->b : 100);
+        break;
+      case OP_ORB:
+        r->norb = gs_extract_orb_features(cur, op->a > 0 ? op->a : 20, op->b > 0 ? op->b : 100);
+        if (template_count > 0) r->nmatches = gs_match_orb_features(template_count, r->norb, 60.0f);
+        break;
+      case OP_FACES: r->nfaces = gs_detect_faces(cur, op->a > 0 ? op->a : 1); break;
+    }
+  }
+  r->image = cur;
+  return r;
+}
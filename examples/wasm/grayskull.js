@@ -29,43 +29,57 @@ const operations = {
     "faces": { params: [{ name: "min_neighbors", type: "range", default: 1, min: 0, max: 10 }] },
 };
 
-// --- Grayscale Conversion in JavaScript ---
-function rgbaToGray(rgba, gray) {
-    for (let i = 0; i < gray.length; i++) {
-        const r = rgba[i * 4], g = rgba[i * 4 + 1], b = rgba[i * 4 + 2];
-        gray[i] = 0.299 * r + 0.587 * g + 0.114 * b;
-    }
+// --- Frame transfer: one copy in, grayscale conversion happens in WASM ---
+let rgbaBuffer = null;  // Pointer to the RGBA frame in WASM memory
+
+function uploadFrame(width, height) {
+    ctx.drawImage(video, 0, 0, width, height);
+    const frame = ctx.getImageData(0, 0, width, height).data;
+    new Uint8ClampedArray(memory.buffer, rgbaBuffer, frame.length).set(frame);
 }
 
-function grayToRgba(gray, rgba) {
-    for (let i = 0; i < gray.length; i++) {
-        rgba[i * 4] = rgba[i * 4 + 1] = rgba[i * 4 + 2] = gray[i];
-        rgba[i * 4 + 3] = 255; // Alpha
+// The RGBA buffer holds the result after runFrame(). ImageData can't wrap shared memory.
+function showImage(width, height) {
+    const pixels = new Uint8ClampedArray(memory.buffer, rgbaBuffer, width * height * 4);
+    ctx.putImageData(new ImageData(leader ? pixels.slice() : pixels, width, height), 0, 0);
+}
+
+// Converts the uploaded frame, runs the pipeline and converts the result image back to RGBA.
+// The threads build does this on the leader worker, see grayskull-worker.js.
+let leader = null;  // Worker running frames of the threads build
+let frameDone = null;  // Resolves the frame posted to the leader
+
+function runFrame(captureTemplate) {
+    if (leader) {
+        return new Promise((resolve) => {
+            frameDone = resolve;
+            leader.postMessage({ type: 'frame', captureTemplate });
+        });
+    }
+    wasm.gs_rgba_to_gray_image(0);
+    let templateCount = 0;
+    if (captureTemplate) {
+        templateCount = wasm.gs_extract_orb_features(0, 20, 200);
+        if (templateCount > 0) wasm.gs_store_template_keypoints(templateCount);
     }
+    const result = wasm.gs_run_pipeline();
+    wasm.gs_gray_to_rgba_image(new Uint32Array(memory.buffer, result, 1)[0]);
+    return Promise.resolve({ result, templateCount });
 }
 
-// Template capture functionality
+// Template capture functionality: ORB features of the next frame become the template
+let captureRequested = false;
+
 function captureTemplate() {
     if (!wasm || !imageBuffers[0]) {
         alert('Camera not running');
         return;
     }
+    captureRequested = true;
+}
 
-    const width = canvas.width;
-    const height = canvas.height;
-    const imageSize = width * height;
-
-    // Capture current frame as template
-    ctx.drawImage(video, 0, 0, width, height);
-    const imageData = ctx.getImageData(0, 0, width, height);
-    const gray = new Uint8Array(imageSize);
-    rgbaToGray(imageData.data, gray);
-    new Uint8Array(memory.buffer, imageBuffers[0], imageSize).set(gray);
-
-    // Extract ORB features from template
-    const templateFeatures = wasm.gs_extract_orb_features(0, 20, 200);
+function templateCaptured(templateFeatures) {
     if (templateFeatures > 0) {
-        wasm.gs_store_template_keypoints(templateFeatures);
         templateKeypoints = { count: templateFeatures };
         document.getElementById('template-status').textContent = `Template captured: ${templateFeatures} features`;
         console.log(`Template captured with ${templateFeatures} ORB features`);
@@ -74,29 +88,78 @@ function captureTemplate() {
     }
 }
 
+// Smallest module using a v128 instruction (i8x16.popcnt), only validates if SIMD is supported
+const simdSupported = WebAssembly.validate(new Uint8Array([
+    0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11
+]));
+
+// Workers need shared memory, which browsers only give to cross-origin isolated pages
+// (COOP/COEP headers), e.g. GitHub Pages isn't, so the demo falls back to the SIMD build there
+const threadsSupported = simdSupported && typeof SharedArrayBuffer !== 'undefined' &&
+    self.crossOriginIsolated === true;
+const STACK_SIZE = 128 * 1024;  // Per worker, allocated from the WASM heap
+
+async function initThreads() {
+    const module = await WebAssembly.compileStreaming(fetch('grayskull-threads.wasm'));
+    // Must match --initial-memory and --max-memory of the threads build
+    memory = new WebAssembly.Memory({ initial: 256, maximum: 4096, shared: true });
+    wasm = (await WebAssembly.instantiate(module, { env: { memory } })).exports;
+
+    const threads = Math.min(navigator.hardwareConcurrency || 4, 8);
+    const workers = [];
+    for (let i = 0; i < threads; i++) {
+        const worker = new Worker('grayskull-worker.js');
+        const stackTop = wasm.gs_alloc(STACK_SIZE) + STACK_SIZE;
+        worker.postMessage({ type: 'init', role: i ? 'helper' : 'leader', module, memory, stackTop });
+        workers.push(worker);
+    }
+    await new Promise((resolve, reject) => {
+        workers[0].onmessage = ({ data }) => data.type === 'ready' ? resolve() : reject(data);
+        workers[0].onerror = reject;
+    });
+    workers[0].onmessage = ({ data }) => frameDone(data);
+    leader = workers[0];
+    wasm.gs_set_workers(threads - 1);
+    console.log(`WebAssembly module loaded (grayskull-threads.wasm, ${threads} threads).`);
+}
+
 async function init() {
+    const wasmFile = simdSupported ? 'grayskull-simd.wasm' : 'grayskull.wasm';
+    if (threadsSupported) {
+        try {
+            await initThreads();
+        } catch (e) {
+            console.warn("Threads build failed, falling back to a single thread.", e);
+            leader = null;
+        }
+        if (leader) return initDemo();
+    }
     try {
         const importObject = { env: {} };
         // Fallback for WASM loading if streaming fails (MIME type issues)
         let wasmModule;
         try {
-            const { instance } = await WebAssembly.instantiateStreaming(fetch('grayskull.wasm'), importObject);
+            const { instance } = await WebAssembly.instantiateStreaming(fetch(wasmFile), importObject);
             wasmModule = instance;
         } catch (streamError) {
             console.warn("Streaming failed, trying fallback:", streamError);
-            const response = await fetch('grayskull.wasm');
+            const response = await fetch(wasmFile);
             const bytes = await response.arrayBuffer();
             const { instance } = await WebAssembly.instantiate(bytes, importObject);
             wasmModule = instance;
         }
         wasm = wasmModule.exports;
         memory = wasm.memory;
-        console.log("WebAssembly module loaded.");
+        console.log(`WebAssembly module loaded (${wasmFile}).`);
     } catch (e) {
         console.warn("WASM initialization failed.", e);
-        alert("Failed to load grayskull.wasm. Make sure the file is present and the server is running correctly.");
+        alert(`Failed to load ${wasmFile}. Make sure the file is present and the server is running correctly.`);
         return;
     }
+    await initDemo();
+}
+
+async function initDemo() {
     await populateCameraList();
     addStepButton.onclick = () => addPipelineStep();
     document.getElementById('capture-template').onclick = captureTemplate;
@@ -149,6 +212,7 @@ async function populateCameraList() {
 
 startButton.onclick = async () => {
     if (videoStream) stopCamera();
+    await frameInFlight;  // Buffers are reallocated below
     try {
         // More flexible constraints - prefer 320x240 but allow fallback
         const constraints = {
@@ -174,12 +238,13 @@ startButton.onclick = async () => {
 
         console.log(`Video resolution: ${canvas.width}x${canvas.height}`);
 
+        // Buffers are reallocated in WASM when the resolution changes
         if (wasm) {
-            wasm.gs_reset_allocator();
             for (let i = 0; i < imageBuffers.length; i++) {
                 wasm.gs_init_image(i, canvas.width, canvas.height);
                 imageBuffers[i] = wasm.gs_get_image_data(i);
             }
+            rgbaBuffer = wasm.gs_get_rgba_data(canvas.width, canvas.height);
         }
 
         animationFrameId = requestAnimationFrame(processFrame);
@@ -254,142 +319,88 @@ function updateStepControls(container, opName) {
     });
 }
 
+// Op codes of the pipeline bytecode in grayskull.c, each op is [code, param0, param1]
+const opCodes = {
+    blur: 1, sobel: 2, otsu: 3, thresh: 4, adaptive: 5, erode: 6, dilate: 7,
+    blobs: 8, contour: 9, keypoints: 10, orb: 11, faces: 12,
+};
+const MAX_OPS = 32;
+let pipelineDirty = true;  // Upload the op list again after the UI changes
+
+pipelineStepsContainer.addEventListener('input', () => pipelineDirty = true);
+pipelineStepsContainer.addEventListener('change', () => pipelineDirty = true);
+new MutationObserver(() => pipelineDirty = true).observe(pipelineStepsContainer, { childList: true });
+
+function uploadPipeline() {
+    const steps = Array.from(pipelineStepsContainer.querySelectorAll('.pipeline-step')).slice(0, MAX_OPS);
+    const ops = new Int32Array(memory.buffer, wasm.gs_get_pipeline(), MAX_OPS * 3);
+    steps.forEach((stepDiv, i) => {
+        const params = Array.from(stepDiv.querySelectorAll('input')).map(input => parseInt(input.value, 10));
+        ops.set([opCodes[stepDiv.querySelector('select').value], params[0] || 0, params[1] || 0], i * 3);
+    });
+    wasm.gs_set_pipeline_length(steps.length);
+    pipelineDirty = false;
+}
+
+// Frames are skipped while the previous one is still running on the workers
+let frameInFlight = Promise.resolve();
+let busy = false;
+
 function processFrame() {
-    if (!videoStream || video.paused || video.ended || !wasm) {
-        if (animationFrameId) requestAnimationFrame(processFrame);
+    if (!videoStream || video.paused || video.ended || !wasm || busy) {
+        if (animationFrameId) animationFrameId = requestAnimationFrame(processFrame);
         return;
     }
 
     const width = canvas.width;
     const height = canvas.height;
-    const imageSize = width * height;
 
-    // 1. Get video frame and convert to grayscale, placing it in buffer 0
-    ctx.drawImage(video, 0, 0, width, height);
-    const imageData = ctx.getImageData(0, 0, width, height);
-    const gray = new Uint8Array(imageSize);
-    rgbaToGray(imageData.data, gray);
-    new Uint8Array(memory.buffer, imageBuffers[0], imageSize).set(gray);
-
-    // 2. Execute pipeline
-    let readIdx = 0;
-    let writeIdx = 1;
-    let overlayData = [];  // Store data for overlays
-
-    pipelineStepsContainer.querySelectorAll('.pipeline-step').forEach(stepDiv => {
-        const op = stepDiv.querySelector('select').value;
-        const inputs = stepDiv.querySelectorAll('input');
-        const params = Array.from(inputs).map(i => parseInt(i.value, 10));
-
-        switch (op) {
-            case 'blur': wasm.gs_blur_image(writeIdx, readIdx, params[0]); break;
-            case 'thresh':
-                wasm.gs_copy_image(writeIdx, readIdx);
-                wasm.gs_threshold_image(writeIdx, params[0]);
-                break;
-            case 'adaptive': wasm.gs_adaptive_threshold_image(writeIdx, readIdx, params[0]); break;
-            case 'erode': wasm.gs_erode_image_iterations(writeIdx, readIdx, params[0] || 1); break;
-            case 'dilate': wasm.gs_dilate_image_iterations(writeIdx, readIdx, params[0] || 1); break;
-            case 'sobel': wasm.gs_sobel_image(writeIdx, readIdx); break;
-            case 'otsu':
-                const threshold = wasm.gs_otsu_threshold_image(readIdx);
-                wasm.gs_copy_image(writeIdx, readIdx);
-                wasm.gs_threshold_image(writeIdx, threshold);
-                break;
-            case 'blobs':
-                wasm.gs_copy_image(writeIdx, readIdx);
-                const numBlobs = wasm.gs_detect_blobs(readIdx, params[0] || 10);
-                overlayData.push({ type: 'blobs', count: numBlobs });
-                break;
-            case 'contour':
-                wasm.gs_copy_image(writeIdx, readIdx);
-                const hasContour = wasm.gs_detect_largest_blob_contour(readIdx, 50);
-                if (hasContour) {
-                    overlayData.push({ type: 'contour', hasContour: true });
-                }
-                break;
-            case 'keypoints':
-                wasm.gs_copy_image(writeIdx, readIdx);
-                const numKeypoints = wasm.gs_detect_fast_keypoints(readIdx, params[0] || 20, params[1] || 100);
-                overlayData.push({ type: 'keypoints', count: numKeypoints });
-                break;
-            case 'orb':
-                wasm.gs_copy_image(writeIdx, readIdx);
-                const numOrbFeatures = wasm.gs_extract_orb_features(readIdx, params[0] || 20, params[1] || 100);
-                overlayData.push({ type: 'orb', count: numOrbFeatures });
-
-                // If we have template keypoints, try to match
-                if (templateKeypoints && templateKeypoints.count > 0) {
-                    const numMatches = wasm.gs_match_orb_features(templateKeypoints.count, numOrbFeatures, 60.0);
-                    overlayData.push({ type: 'matches', count: numMatches });
-                }
-                break;
-            case 'faces':
-                wasm.gs_copy_image(writeIdx, readIdx);
-                const numFaces = wasm.gs_detect_faces(readIdx, params[0] || 1);
-                overlayData.push({ type: 'faces', count: numFaces });
-                break;
-        }
-        // Swap buffers
-        [readIdx, writeIdx] = [writeIdx, (writeIdx + 1) % 3 === readIdx ? (writeIdx + 2) % 3 : (writeIdx + 1) % 3];
-    });
+    // 1. Get video frame into WASM memory
+    uploadFrame(width, height);
+
+    // 2. Execute the whole pipeline in one call
+    if (pipelineDirty) uploadPipeline();
+    const capture = captureRequested;
+    captureRequested = false;
+    busy = true;
+    frameInFlight = runFrame(capture).then(({ result, templateCount }) => {
+        busy = false;
+        if (capture) templateCaptured(templateCount);
 
-    // 3. Display result from the last read buffer
-    const resultGray = new Uint8Array(memory.buffer, imageBuffers[readIdx], imageSize);
-    const imageDataOut = ctx.createImageData(width, height);
-    grayToRgba(resultGray, imageDataOut.data);
-    ctx.putImageData(imageDataOut, 0, 0);
+        // 3. Display result from the output buffer
+        showImage(width, height);
 
-    // 4. Draw overlays
-    drawOverlays(overlayData, width, height);
+        // 4. Draw overlays
+        drawOverlays(new Uint32Array(memory.buffer, result, 13));
+    });
 
     animationFrameId = requestAnimationFrame(processFrame);
 }
 
-function drawOverlays(overlayData, width, height) {
-    if (!overlayData.length) return;
+// struct pipeline_result: image, then a count and a pointer for each detector
+function drawOverlays(result) {
+    const [, nblobs, blobs, hasContour, contour, nkeypoints, keypoints, norb, orb, nmatches, matches, nfaces, faces] = result;
 
-    // Create overlay canvas for drawing annotations
     ctx.strokeStyle = '#ff0000';
     ctx.fillStyle = '#ff0000';
     ctx.lineWidth = 2;
 
-    overlayData.forEach(overlay => {
-        switch (overlay.type) {
-            case 'blobs':
-                drawBlobs(overlay.count);
-                break;
-            case 'contour':
-                if (overlay.hasContour) {
-                    drawContour();
-                }
-                break;
-            case 'keypoints':
-                drawKeypoints(overlay.count, '#00ff00');
-                break;
-            case 'orb':
-                drawKeypoints(overlay.count, '#0080ff', true);
-                break;
-            case 'matches':
-                drawMatches(overlay.count);
-                break;
-            case 'faces':
-                drawFaces(overlay.count);
-                break;
-        }
-    });
+    if (nblobs) drawBlobs(blobs, nblobs);
+    if (hasContour) drawContour(contour);
+    if (nkeypoints) drawKeypoints(keypoints, nkeypoints, '#00ff00');
+    if (norb) drawKeypoints(orb, norb, '#0080ff', true);
+    if (nmatches) drawMatches(matches, nmatches, orb);
+    if (nfaces) drawFaces(faces, nfaces);
 }
 
-function drawBlobs(count) {
+// Struct sizes in 32-bit words: gs_blob 8, gs_contour 7, gs_keypoint 12, gs_match 3, gs_rect 4
+function drawBlobs(blobsPtr, count) {
     ctx.strokeStyle = '#ff0000';
     ctx.lineWidth = 2;
 
     for (let i = 0; i < count; i++) {
-        const blobPtr = wasm.gs_get_blob(i);
-        if (!blobPtr) continue;
-
         // Read blob data from WASM memory
-        const blobData = new Uint32Array(memory.buffer, blobPtr, 8); // gs_blob struct
+        const blobData = new Uint32Array(memory.buffer, blobsPtr + i * 32, 8); // gs_blob struct
         const area = blobData[1];
         if (area < 50) continue; // Skip very small blobs
 
@@ -413,29 +424,12 @@ function drawBlobs(count) {
         // Draw area text
         ctx.fillStyle = '#ffffff';
         ctx.fillText(`${area}`, x, y - 5);
-
-        // Draw corners
-        const cornersPtr = wasm.gs_get_blob_corners(i);
-        if (cornersPtr) {
-            ctx.fillStyle = '#00ff00';
-            const cornersData = new Uint32Array(memory.buffer, cornersPtr, 8); // 4 points, 2 coords each
-            for (let j = 0; j < 4; j++) {
-                const cornerX = cornersData[j * 2];
-                const cornerY = cornersData[j * 2 + 1];
-                ctx.beginPath();
-                ctx.arc(cornerX, cornerY, 2, 0, 2 * Math.PI);
-                ctx.fill();
-            }
-        }
     }
 }
 
-function drawContour() {
-    const contourPtr = wasm.gs_get_contour();
-    if (!contourPtr) return;
-
+function drawContour(contourPtr) {
     // Read contour data
-    const contourData = new Uint32Array(memory.buffer, contourPtr, 6); // gs_contour struct
+    const contourData = new Uint32Array(memory.buffer, contourPtr, 7); // gs_contour struct
     const startX = contourData[4];
     const startY = contourData[5];
     const length = contourData[6];
@@ -456,14 +450,13 @@ function drawContour() {
     ctx.fillText(`Contour: ${length}px`, startX + 10, startY - 10);
 }
 
-function drawKeypoints(count, color, withOrientation = false) {
+function drawKeypoints(keypointsPtr, count, color, withOrientation = false) {
     ctx.strokeStyle = color;
     ctx.fillStyle = color;
     ctx.lineWidth = 1;
 
     for (let i = 0; i < count; i++) {
-        const kpPtr = withOrientation ? wasm.gs_get_orb_keypoint(i) : wasm.gs_get_keypoint(i);
-        if (!kpPtr) continue;
+        const kpPtr = keypointsPtr + i * 48;
 
         // Read keypoint data (x, y, response, angle)
         const kpData = new Uint32Array(memory.buffer, kpPtr, 3);
@@ -494,7 +487,7 @@ function drawKeypoints(count, color, withOrientation = false) {
     }
 }
 
-function drawMatches(count) {
+function drawMatches(matchesPtr, count, orbPtr) {
     // Yellow circles show ORB feature matches between the captured template and current scene
     // Lower distance numbers indicate better matches (more similar features)
     // Use "Capture Template" button to set a reference image for matching
@@ -504,11 +497,8 @@ function drawMatches(count) {
     ctx.lineWidth = 1;
 
     for (let i = 0; i < count; i++) {
-        const matchPtr = wasm.gs_get_match(i);
-        if (!matchPtr) continue;
-
         // Read match data (idx1, idx2, distance)
-        const matchData = new Uint32Array(memory.buffer, matchPtr, 3);
+        const matchData = new Uint32Array(memory.buffer, matchesPtr + i * 12, 3);
         const templateIdx = matchData[0];
         const sceneIdx = matchData[1];
         const distance = matchData[2];
@@ -516,10 +506,7 @@ function drawMatches(count) {
         if (distance > 40) continue; // Skip poor matches
 
         // Get scene keypoint
-        const sceneKpPtr = wasm.gs_get_orb_keypoint(sceneIdx);
-        if (!sceneKpPtr) continue;
-
-        const sceneKpData = new Uint32Array(memory.buffer, sceneKpPtr, 2);
+        const sceneKpData = new Uint32Array(memory.buffer, orbPtr + sceneIdx * 48, 2);
         const sceneX = sceneKpData[0];
         const sceneY = sceneKpData[1];
 
@@ -537,16 +524,13 @@ function drawMatches(count) {
     }
 }
 
-function drawFaces(count) {
+function drawFaces(facesPtr, count) {
     ctx.strokeStyle = '#00ff00';
     ctx.lineWidth = 2;
 
     for (let i = 0; i < count; i++) {
-        const facePtr = wasm.gs_get_face(i);
-        if (!facePtr) continue;
-
         // Read rect data (x, y, w, h)
-        const rectData = new Uint32Array(memory.buffer, facePtr, 4);
+        const rectData = new Uint32Array(memory.buffer, facesPtr + i * 16, 4);
         const x = rectData[0];
         const y = rectData[1];
         const w = rectData[2];
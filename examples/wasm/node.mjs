@@ -0,0 +1,74 @@
+// Loads the WASM builds and test images in Node, shared by check.mjs and bench.mjs
+import { existsSync, readdirSync, readFileSync } from 'node:fs';
+import { Worker } from 'node:worker_threads';
+
+const dir = new URL('.', import.meta.url);
+const testdata = new URL('../../testdata/', dir);
+
+export const builds = {
+    scalar: 'grayskull.wasm',
+    simd: 'grayskull-simd.wasm',
+    threads: 'grayskull-threads.wasm',
+};
+
+export function buildExists(name) {
+    return existsSync(new URL(builds[name], dir));
+}
+
+// Helpers of the threads build wait in gs_worker_loop(), Node lets the main thread block, so
+// it runs the operations itself like the leader worker in the browser
+const helperSource = `
+const { workerData: { module, memory, stackTop } } = require('node:worker_threads');
+WebAssembly.instantiate(module, { env: { memory } }).then((instance) => {
+    instance.exports.__stack_pointer.value = stackTop;
+    instance.exports.gs_worker_loop();
+});`;
+
+// Returns the exports with .memory set for all builds, helpers only apply to the threads build
+export async function load(name, helpers = 3) {
+    const bytes = readFileSync(new URL(builds[name], dir));
+    if (name !== 'threads') {
+        const { instance } = await WebAssembly.instantiate(bytes, { env: {} });
+        return { ...instance.exports };
+    }
+    const module = await WebAssembly.compile(bytes);
+    const memory = new WebAssembly.Memory({ initial: 256, maximum: 4096, shared: true });
+    const { exports } = await WebAssembly.instantiate(module, { env: { memory } });
+    for (let i = 0; i < helpers; i++) {
+        const stackTop = exports.gs_alloc(128 * 1024) + 128 * 1024;
+        new Worker(helperSource, { eval: true, workerData: { module, memory, stackTop } }).unref();
+    }
+    exports.gs_set_workers(helpers);
+    return { ...exports, memory };
+}
+
+export function readPGM(file) {
+    const bytes = readFileSync(new URL(file, testdata));
+    const header = new TextDecoder().decode(bytes.subarray(0, 64)).match(/^P5\s+(\d+)\s+(\d+)\s+255\s/);
+    const [w, h] = [Number(header[1]), Number(header[2])];
+    return { w, h, data: bytes.subarray(header[0].length, header[0].length + w * h) };
+}
+
+export function testImages() {
+    return readdirSync(testdata).filter((f) => f.endsWith('.pgm')).sort();
+}
+
+export function noise(w, h, seed) {
+    const data = new Uint8Array(w * h);
+    for (let i = 0; i < data.length; i++) data[i] = (seed = (seed * 1103515245 + 12345) >>> 0) >>> 24;
+    return { w, h, data };
+}
+
+// Allocates the three image buffers and copies img into buffer 0
+export function setImage(g, img) {
+    for (let i = 0; i < 3; i++) g.gs_init_image(i, img.w, img.h);
+    new Uint8Array(g.memory.buffer, g.gs_get_image_data(0), img.w * img.h).set(img.data);
+    g.w = img.w, g.h = img.h;
+}
+
+// Writes a pipeline of [code, a, b] ops and runs it, returns the pipeline_result words
+export function runPipeline(g, ops) {
+    new Int32Array(g.memory.buffer, g.gs_get_pipeline(), ops.length * 3).set(ops.flat());
+    g.gs_set_pipeline_length(ops.length);
+    return new Uint32Array(g.memory.buffer, g.gs_run_pipeline(), 13);
+}
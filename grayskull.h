@@ -4,6 +4,11 @@
 #include <limits.h>
 #include <stdint.h>
 
+// Built with -msimd128 the hot loops use WebAssembly SIMD, results are the same as scalar code
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
 #ifndef GS_API
 #define GS_API static inline
 #endif
@@ -11,6 +16,41 @@
 #define GS_MIN(a, b) ((a) < (b) ? (a) : (b))
 #define GS_MAX(a, b) ((a) > (b) ? (a) : (b))
 
+// Scales and angles are gs_real: float, or Q16 fixed point with GS_NO_FLOAT for MCUs without
+// FPU, where every function is integer-only. GS_REAL() converts constants.
+#ifdef GS_NO_FLOAT
+typedef int32_t gs_real;
+#define GS_REAL(x) ((gs_real)((x) * 65536.0 + ((x) < 0 ? -0.5 : 0.5)))
+#define GS_REAL_INT(x) ((int)((x) / 65536))  // truncates like a float to int cast
+static inline gs_real gs_real_mul(gs_real a, gs_real b) {
+  return (gs_real)(((int64_t)a * b) >> 16);
+}
+static inline unsigned gs_real_div(unsigned a, gs_real b) {  // a / b truncated
+  return (unsigned)(((uint64_t)a << 16) / (uint64_t)b);
+}
+static inline int32_t gs_real_to_q16(gs_real x) { return x; }
+static inline gs_real gs_real_from_q16(int32_t x) { return x; }
+#else
+typedef float gs_real;
+#define GS_REAL(x) ((float)(x))
+#define GS_REAL_INT(x) ((int)(x))
+static inline gs_real gs_real_mul(gs_real a, gs_real b) { return a * b; }
+static inline unsigned gs_real_div(unsigned a, gs_real b) { return (unsigned)(a / b); }
+static inline int32_t gs_real_to_q16(gs_real x) {
+  return (int32_t)(x * 65536.0f + (x < 0 ? -0.5f : 0.5f));
+}
+static inline gs_real gs_real_from_q16(int32_t x) { return x / 65536.0f; }
+#endif
+
+// Optional profiling hooks around public functions and their main phases, compiled out unless
+// defined before including this header. npixels is the amount of work, for throughput reports.
+#ifndef GS_TRACE_BEGIN
+#define GS_TRACE_BEGIN(name, npixels)
+#endif
+#ifndef GS_TRACE_END
+#define GS_TRACE_END(name)
+#endif
+
 struct gs_image {
   unsigned w, h;
   uint8_t *data;
@@ -42,7 +82,7 @@ struct gs_contour {
 struct gs_keypoint {
   struct gs_point pt;
   unsigned response;
-  float angle;
+  gs_real angle;
   uint32_t descriptor[8];
 };
 
@@ -51,22 +91,134 @@ struct gs_match {
   unsigned distance;
 };
 
+// Hough line x * cos(theta) + y * sin(theta) = rho, theta in degrees [0, 180)
+struct gs_line {
+  int rho;
+  unsigned theta, votes;
+};
+
+struct gs_segment {
+  struct gs_point p0, p1;
+};
+
+// QR finder pattern: center, width of its 7 modules in pixels and how many scans confirmed it
+struct gs_finder {
+  struct gs_point center;
+  unsigned size, count;
+};
+
+// QR code candidate: outer corners tl, tr, br, bl as gs_perspective_correct() takes them, and
+// the estimated number of modules per side (21, 25, ...)
+struct gs_qr {
+  struct gs_point corners[4];
+  unsigned modules;
+};
+
 struct gs_lbp_cascade {
   uint16_t window_w, window_h;
   uint16_t nfeatures, nweaks, nstages;
   const int8_t *features; /* [nfeatures * 4] */
   const uint16_t *weak_feature_idx;
-  const float *weak_left_val, *weak_right_val;
+  const gs_real *weak_left_val, *weak_right_val;
   const uint16_t *weak_subset_offset, *weak_num_subsets;
   const int32_t *subsets;
   const uint16_t *stage_weak_start, *stage_nweaks;
-  const float *stage_threshold;
+  const gs_real *stage_threshold;
+};
+
+// Linear classifier of HOG windows of win_w x win_h cells of cell x cell pixels. weights holds 36
+// values per block of 2x2 cells (9 bins of the top-left, top-right, bottom-left and bottom-right
+// cell), for win_h - 1 rows of win_w - 1 blocks.
+struct gs_hog_model {
+  uint16_t cell, win_w, win_h;
+  const int8_t *weights;
+  int32_t bias;
+};
+
+// Processes a frame row by row as a camera delivers it, without a frame buffer: optional 2x2
+// downsample, box blur and threshold, then histogram, integral image and blobs of the result.
+// Set the configuration, call gs_stream_init() with gs_stream_size() bytes of work memory, then
+// push h rows per frame. Results match the whole-image functions on the same frame.
+struct gs_stream {
+  unsigned w, h;                // input frame size
+  unsigned downsample;          // 1: gs_downsample(), output is w/2 x h/2
+  unsigned blur;                // gs_blur() radius, 0: off
+  int threshold;                // gs_threshold() value, -1: off
+  unsigned *hist;               // gs_histogram() before threshold, 256 bins, NULL: off
+  unsigned *ii;                 // gs_integral() before threshold, out_w * out_h, NULL: off
+  struct gs_blob *blobs;        // gs_blobs() after threshold, NULL: off
+  unsigned max_blobs, nblobs;   // nblobs is set at the end of each frame
+  void (*row_cb)(void *arg, unsigned y, const uint8_t *row);  // each output row, optional
+  void *arg;
+  // internal state, set by gs_stream_init()
+  unsigned out_w, out_h, y, blur_y, blur_top, out_y;
+  unsigned *colsum, *cx, *cy;
+  gs_label *labels, *parents, next;
+  uint8_t *prev, *rows, *out;
+};
+
+#ifndef GS_NO_FLOAT
+// MOSSE correlation filter tracker, float only: the box is sampled to an n x n patch and a filter
+// trained on it in the frequency domain finds the box again in the next frame. Set the
+// configuration, call gs_mosse_init() with gs_mosse_size() bytes of work memory, then
+// gs_mosse_update() on each frame.
+struct gs_mosse {
+  unsigned n;          // patch size, a power of 2: 32, or 64 for more context
+  float rate;          // learning rate, e.g. 0.125
+  float min_psr;       // the target is lost below this peak to sidelobe ratio, e.g. 7
+  struct gs_rect box;  // tracked box, moved by each update, its size stays the same
+  float psr;           // of the last update
+  // internal state, set by gs_mosse_init()
+  float cx, cy;
+  float *a, *b, *g, *f, *win, *tw, *lut;
 };
+#endif
 
 static inline int gs_valid(struct gs_image img) { return img.data && img.w > 0 && img.h > 0; }
 
+#ifdef GS_NO_FLOAT
+// CORDIC in vectoring mode, the result is in Q16 radians like gs_real angles
+static inline gs_real gs_atan2(int32_t y, int32_t x) {
+  static const int32_t atans[16] = {51472, 30386, 16055, 8150, 4091, 2047, 1024, 512,
+                                    256,   128,   64,    32,   16,   8,    4,    2};
+  if (x == 0 && y == 0) return 0;
+  gs_real angle = 0;
+  if (x < 0) angle = y >= 0 ? 205887 : -205887, x = -x, y = -y;  // rotate by pi
+  while (x >= (1 << 29) || y >= (1 << 29) || y <= -(1 << 29)) x /= 2, y /= 2;  // no overflow
+  while (x < (1 << 28) && y < (1 << 28) && y > -(1 << 28)) x *= 2, y *= 2;      // precision
+  for (int i = 0; i < 16; i++) {
+    int32_t nx = y > 0 ? x + (y >> i) : x - (y >> i);
+    if (y > 0)
+      y -= x >> i, angle += atans[i];
+    else
+      y += x >> i, angle -= atans[i];
+    x = nx;
+  }
+  return angle;
+}
+
+// Quarter sine wave in 64 steps, linearly interpolated, Q16 in and out
+static inline gs_real gs_sin(gs_real x) {
+  static const uint16_t lut[65] = {
+      0,     1608,  3216,  4821,  6424,  8022,  9616,  11204, 12785, 14359, 15924, 17479, 19024,
+      20557, 22078, 23586, 25079, 26557, 28020, 29465, 30893, 32302, 33692, 35061, 36409, 37736,
+      39039, 40319, 41575, 42806, 44011, 45189, 46340, 47464, 48558, 49624, 50659, 51664, 52638,
+      53580, 54490, 55367, 56211, 57021, 57797, 58537, 59243, 59913, 60546, 61144, 61704, 62227,
+      62713, 63161, 63571, 63943, 64276, 64570, 64826, 65042, 65219, 65357, 65456, 65515, 65535};
+  x %= 411775;  // 2 pi
+  if (x < 0) x += 411775;
+  int32_t p = (int32_t)(((int64_t)x << 24) / 411775);  // 256 steps per turn, 16 bit fraction
+  int32_t q = p >> 22, f = p & ((1 << 22) - 1);
+  if (q & 1) f = (1 << 22) - f;
+  int32_t i = f >> 16, frac = f & 0xffff;
+  int32_t v = lut[i] + (i < 64 ? ((lut[i + 1] - lut[i]) * frac) >> 16 : 0);
+  return q & 2 ? -v : v;
+}
+#endif
+
 #ifdef GS_NO_STDLIB  // no asserts, no memory allocation, no file I/O
 #define gs_assert(cond)
+#ifndef GS_NO_FLOAT
 static inline float gs_atan2(float y, float x) {
   if (x == 0.0f) { return (y > 0.0f ? 1.570796f : (y < 0.0f ? -1.570796f : 0.0f)); }
   float r, angle, abs_y = (y >= 0.0f ? y : -y);
@@ -86,10 +238,64 @@ static inline float gs_sin(float x) {
   float x2 = x * x, res = x * (1.0f - x2 * (0.16666667f - 0.0083333310f * x2));
   return sign * res;
 }
+
+// Newton steps from an initial guess with half the exponent
+static inline float gs_sqrt(float x) {
+  if (x <= 0.0f) return 0.0f;
+  union { float f; uint32_t u; } v = {x};
+  v.u = (v.u >> 1) + 0x1fc00000;
+  float r = v.f;
+  for (int i = 0; i < 3; i++) r = 0.5f * (r + x / r);
+  return r;
+}
+
+// x = 2^e * m with m in [0.707, 1.414], log(m) = 2 atanh((m - 1) / (m + 1)), x > 0
+static inline float gs_log(float x) {
+  union { float f; uint32_t u; } v = {x};
+  int e = (int)((v.u >> 23) & 255) - 127;
+  v.u = (v.u & 0x7fffff) | 0x3f800000;
+  if (v.f > 1.414214f) v.f *= 0.5f, e++;
+  float t = (v.f - 1.0f) / (v.f + 1.0f), t2 = t * t;
+  return e * 0.693147f + 2.0f * t * (1.0f + t2 * (0.333333f + t2 * (0.2f + t2 * 0.142857f)));
+}
+
+// x = k ln 2 + r with |r| <= ln 2 / 2, 2^k from the exponent bits, e^r as a series
+static inline float gs_exp(float x) {
+  if (x < -87.0f) return 0.0f;
+  if (x > 88.0f) x = 88.0f;
+  int k = (int)(x * 1.442695f + (x < 0.0f ? -0.5f : 0.5f));
+  float r = x - k * 0.693147f;
+  union { float f; uint32_t u; } v = {0};
+  v.u = (uint32_t)(k + 127) << 23;
+  float p = 0.041667f + r * 0.008333f;
+  return v.f * (1.0f + r * (1.0f + r * (0.5f + r * (0.166667f + r * p))));
+}
+#endif
+
+// Copies n bytes, ranges may overlap if dst <= src. With -mbulk-memory this is memory.copy,
+// otherwise a forward copy, word by word when src and dst are equally aligned. Words go through
+// a fixed size __builtin_memcpy, which compiles to a plain load/store without aliasing issues.
+static inline void gs_copy_bytes(void *dst, const void *src, unsigned n) {
+#ifdef __wasm_bulk_memory__
+  __builtin_memmove(dst, src, n);
+#else
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = (const uint8_t *)src;
+  if (((uintptr_t)d & 3) == ((uintptr_t)s & 3)) {
+    for (; n > 0 && ((uintptr_t)d & 3); n--) *d++ = *s++;
+    for (uint32_t w; n >= 4; n -= 4, d += 4, s += 4) {
+      __builtin_memcpy(&w, s, 4);
+      __builtin_memcpy(d, &w, 4);
+    }
+  }
+  for (; n > 0; n--) *d++ = *s++;
+#endif
+}
 #else
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define gs_assert(cond)                               \
   if (!(cond)) {                                      \
@@ -97,8 +303,14 @@ static inline float gs_sin(float x) {
     abort();                                          \
   }
 
+#ifndef GS_NO_FLOAT
 static inline float gs_atan2(float y, float x) { return atan2f(y, x); }
 static inline float gs_sin(float x) { return sinf(x); }
+static inline float gs_sqrt(float x) { return sqrtf(x); }
+static inline float gs_log(float x) { return logf(x); }
+static inline float gs_exp(float x) { return expf(x); }
+#endif
+static inline void gs_copy_bytes(void *dst, const void *src, unsigned n) { memmove(dst, src, n); }
 
 GS_API struct gs_image gs_alloc(unsigned w, unsigned h) {
   if (w == 0 || h == 0) return (struct gs_image){0, 0, NULL};
@@ -147,30 +359,339 @@ GS_API void gs_set(struct gs_image img, unsigned x, unsigned y, uint8_t value) {
   if (gs_valid(img) && x < img.w && y < img.h) img.data[y * img.w + x] = value;
 }
 
+//
+// Color conversion
+//
+
+// BT.601 luma with integer weights, (77 * r + 150 * g + 29 * b + 128) >> 8
+GS_API uint8_t gs_luma(uint8_t r, uint8_t g, uint8_t b) {
+  return (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+}
+
+#ifdef __wasm_simd128__
+// Luma of 16 pixels given as 4 vectors of 4 RGBx pixels, the 4th byte is ignored
+static inline v128_t gs_luma16(const v128_t px4[4]) {
+  v128_t k = wasm_i16x8_make(77, 150, 29, 0, 77, 150, 29, 0), round = wasm_i32x4_splat(128), y[4];
+  for (int i = 0; i < 4; i++) {
+    v128_t px = px4[i];  // 4 pixels, 2 per 16-bit half
+    v128_t lo = wasm_i32x4_dot_i16x8(wasm_u16x8_extend_low_u8x16(px), k);
+    v128_t hi = wasm_i32x4_dot_i16x8(wasm_u16x8_extend_high_u8x16(px), k);
+    v128_t sum = wasm_i32x4_add(wasm_i32x4_shuffle(lo, hi, 0, 2, 4, 6),
+                                wasm_i32x4_shuffle(lo, hi, 1, 3, 5, 7));
+    y[i] = wasm_u32x4_shr(wasm_i32x4_add(sum, round), 8);
+  }
+  return wasm_u8x16_narrow_i16x8(wasm_u16x8_narrow_i32x4(y[0], y[1]),
+                                 wasm_u16x8_narrow_i32x4(y[2], y[3]));
+}
+
+// Luma of 16 RGBA pixels
+static inline v128_t gs_rgba_luma16(const uint8_t *rgba) {
+  v128_t px[4] = {wasm_v128_load(rgba), wasm_v128_load(rgba + 16), wasm_v128_load(rgba + 32),
+                  wasm_v128_load(rgba + 48)};
+  return gs_luma16(px);
+}
+#endif
+
+// Converts a packed RGBA frame (e.g. canvas ImageData) of dst.w x dst.h pixels
+GS_API void gs_rgba_to_gray(struct gs_image dst, const uint8_t *rgba) {
+  gs_assert(gs_valid(dst) && rgba);
+  GS_TRACE_BEGIN("gs_rgba_to_gray", dst.w * dst.h);
+  unsigned i = 0, n = dst.w * dst.h;
+#ifdef __wasm_simd128__
+  for (; i + 16 <= n; i += 16) wasm_v128_store(&dst.data[i], gs_rgba_luma16(&rgba[i * 4]));
+#endif
+  for (; i < n; i++) dst.data[i] = gs_luma(rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2]);
+  GS_TRACE_END("gs_rgba_to_gray");
+}
+
+// Same as gs_rgba_to_gray() followed by gs_downsample() in one pass, the RGBA frame is
+// (dst.w * 2) x (dst.h * 2) pixels with the given stride in pixels
+GS_API void gs_rgba_to_gray_half(struct gs_image dst, const uint8_t *rgba, unsigned stride) {
+  gs_assert(gs_valid(dst) && rgba && stride >= dst.w * 2);
+  GS_TRACE_BEGIN("gs_rgba_to_gray_half", dst.w * dst.h * 4);
+  for (unsigned y = 0; y < dst.h; y++) {
+    const uint8_t *r0 = &rgba[(y * 2) * stride * 4], *r1 = r0 + stride * 4;
+    unsigned x = 0;
+#ifdef __wasm_simd128__
+    for (; x + 8 <= dst.w; x += 8) {
+      v128_t s = wasm_i16x8_add(wasm_u16x8_extadd_pairwise_u8x16(gs_rgba_luma16(&r0[x * 8])),
+                                wasm_u16x8_extadd_pairwise_u8x16(gs_rgba_luma16(&r1[x * 8])));
+      s = wasm_u16x8_shr(s, 2);
+      wasm_v128_store64_lane(&dst.data[y * dst.w + x], wasm_u8x16_narrow_i16x8(s, s), 0);
+    }
+#endif
+    for (; x < dst.w; x++) {
+      const uint8_t *a = &r0[x * 8], *b = &r1[x * 8];
+      unsigned sum = gs_luma(a[0], a[1], a[2]) + gs_luma(a[4], a[5], a[6]) +
+                     gs_luma(b[0], b[1], b[2]) + gs_luma(b[4], b[5], b[6]);
+      dst.data[y * dst.w + x] = (uint8_t)(sum / 4);
+    }
+  }
+  GS_TRACE_END("gs_rgba_to_gray_half");
+}
+
+// Writes src as opaque gray RGBA pixels, ready to be shown on a canvas
+GS_API void gs_gray_to_rgba(uint8_t *rgba, struct gs_image src) {
+  gs_assert(gs_valid(src) && rgba);
+  GS_TRACE_BEGIN("gs_gray_to_rgba", src.w * src.h);
+  unsigned i = 0, n = src.w * src.h;
+#ifdef __wasm_simd128__
+  for (v128_t a = wasm_u8x16_splat(255); i + 16 <= n; i += 16) {
+    v128_t g = wasm_v128_load(&src.data[i]);
+    uint8_t *p = &rgba[i * 4];
+    wasm_v128_store(p, wasm_i8x16_shuffle(g, a, 0, 0, 0, 16, 1, 1, 1, 16, 2, 2, 2, 16, 3, 3, 3,
+                                          16));
+    wasm_v128_store(p + 16, wasm_i8x16_shuffle(g, a, 4, 4, 4, 16, 5, 5, 5, 16, 6, 6, 6, 16, 7, 7,
+                                               7, 16));
+    wasm_v128_store(p + 32, wasm_i8x16_shuffle(g, a, 8, 8, 8, 16, 9, 9, 9, 16, 10, 10, 10, 16, 11,
+                                               11, 11, 16));
+    wasm_v128_store(p + 48, wasm_i8x16_shuffle(g, a, 12, 12, 12, 16, 13, 13, 13, 16, 14, 14, 14,
+                                               16, 15, 15, 15, 16));
+  }
+#endif
+  for (; i < n; i++) {
+    rgba[i * 4] = rgba[i * 4 + 1] = rgba[i * 4 + 2] = src.data[i];
+    rgba[i * 4 + 3] = 255;
+  }
+  GS_TRACE_END("gs_gray_to_rgba");
+}
+
+// Sensor formats: strides are in pixels of the source format. The Y plane of NV12, NV21, I420
+// and YV12 frames is already a gray image, gs_yuv420_luma() returns it without a copy.
+GS_API struct gs_image gs_yuv420_luma(uint8_t *yuv, unsigned w, unsigned h) {
+  return (struct gs_image){w, h, yuv};
+}
+
+// Copies a gray plane with padded rows, e.g. a Y plane with stride > width
+GS_API void gs_plane_to_gray(struct gs_image dst, const uint8_t *plane, unsigned stride) {
+  gs_assert(gs_valid(dst) && plane && stride >= dst.w);
+  GS_TRACE_BEGIN("gs_plane_to_gray", dst.w * dst.h);
+  for (unsigned y = 0; y < dst.h; y++)
+    gs_copy_bytes(&dst.data[y * dst.w], &plane[y * stride], dst.w);
+  GS_TRACE_END("gs_plane_to_gray");
+}
+
+// Luma of packed YUYV (YUY2) frames, pass uyvy + 1 for UYVY
+GS_API void gs_yuyv_to_gray(struct gs_image dst, const uint8_t *yuyv, unsigned stride) {
+  gs_assert(gs_valid(dst) && yuyv && stride >= dst.w);
+  GS_TRACE_BEGIN("gs_yuyv_to_gray", dst.w * dst.h);
+  for (unsigned y = 0; y < dst.h; y++) {
+    const uint8_t *p = &yuyv[y * stride * 2];
+    uint8_t *d = &dst.data[y * dst.w];
+    unsigned x = 0;
+#ifdef __wasm_simd128__
+    // vectors read up to the last luma byte, not the byte after it: uyvy + 1 ends 1 byte earlier
+    for (; x * 2 + 32 <= dst.w * 2 - 1; x += 16) {
+      v128_t a = wasm_v128_load(&p[x * 2]), b = wasm_v128_load(&p[x * 2 + 16]);
+      wasm_v128_store(&d[x], wasm_i8x16_shuffle(a, b, 0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22,
+                                                24, 26, 28, 30));
+    }
+#endif
+    for (; x < dst.w; x++) d[x] = p[x * 2];
+  }
+  GS_TRACE_END("gs_yuyv_to_gray");
+}
+
+// Packed 24-bit RGB888 frames, R first
+GS_API void gs_rgb_to_gray(struct gs_image dst, const uint8_t *rgb, unsigned stride) {
+  gs_assert(gs_valid(dst) && rgb && stride >= dst.w);
+  GS_TRACE_BEGIN("gs_rgb_to_gray", dst.w * dst.h);
+  for (unsigned y = 0; y < dst.h; y++) {
+    const uint8_t *p = &rgb[y * stride * 3];
+    uint8_t *d = &dst.data[y * dst.w];
+    unsigned x = 0;
+#ifdef __wasm_simd128__
+    for (; x + 16 <= dst.w; x += 16) {  // 48 bytes into 4 vectors of 4 RGBx pixels
+      v128_t a = wasm_v128_load(&p[x * 3]), b = wasm_v128_load(&p[x * 3 + 16]);
+      v128_t c = wasm_v128_load(&p[x * 3 + 32]), px[4];
+      px[0] = wasm_i8x16_shuffle(a, a, 0, 1, 2, 0, 3, 4, 5, 0, 6, 7, 8, 0, 9, 10, 11, 0);
+      px[1] = wasm_i8x16_shuffle(a, b, 12, 13, 14, 0, 15, 16, 17, 0, 18, 19, 20, 0, 21, 22, 23, 0);
+      px[2] = wasm_i8x16_shuffle(b, c, 8, 9, 10, 0, 11, 12, 13, 0, 14, 15, 16, 0, 17, 18, 19, 0);
+      px[3] = wasm_i8x16_shuffle(c, c, 4, 5, 6, 0, 7, 8, 9, 0, 10, 11, 12, 0, 13, 14, 15, 0);
+      wasm_v128_store(&d[x], gs_luma16(px));
+    }
+#endif
+    for (; x < dst.w; x++) d[x] = gs_luma(p[x * 3], p[x * 3 + 1], p[x * 3 + 2]);
+  }
+  GS_TRACE_END("gs_rgb_to_gray");
+}
+
+// 16-bit RGB565 frames in native byte order, channels are widened to 8 bits before gs_luma()
+GS_API void gs_rgb565_to_gray(struct gs_image dst, const uint16_t *rgb565, unsigned stride) {
+  gs_assert(gs_valid(dst) && rgb565 && stride >= dst.w);
+  GS_TRACE_BEGIN("gs_rgb565_to_gray", dst.w * dst.h);
+  for (unsigned y = 0; y < dst.h; y++) {
+    const uint16_t *p = &rgb565[y * stride];
+    uint8_t *d = &dst.data[y * dst.w];
+    unsigned x = 0;
+#ifdef __wasm_simd128__
+    for (; x + 8 <= dst.w; x += 8) {  // the weighted sum fits in 16 bits
+      v128_t v = wasm_v128_load(&p[x]);
+      v128_t r = wasm_u16x8_shr(v, 11), b = wasm_v128_and(v, wasm_i16x8_splat(31));
+      v128_t g = wasm_v128_and(wasm_u16x8_shr(v, 5), wasm_i16x8_splat(63));
+      r = wasm_v128_or(wasm_i16x8_shl(r, 3), wasm_u16x8_shr(r, 2));
+      g = wasm_v128_or(wasm_i16x8_shl(g, 2), wasm_u16x8_shr(g, 4));
+      b = wasm_v128_or(wasm_i16x8_shl(b, 3), wasm_u16x8_shr(b, 2));
+      v128_t l = wasm_i16x8_add(wasm_i16x8_mul(r, wasm_i16x8_splat(77)), wasm_i16x8_splat(128));
+      l = wasm_i16x8_add(l, wasm_i16x8_mul(g, wasm_i16x8_splat(150)));
+      l = wasm_u16x8_shr(wasm_i16x8_add(l, wasm_i16x8_mul(b, wasm_i16x8_splat(29))), 8);
+      wasm_v128_store64_lane(&d[x], wasm_u8x16_narrow_i16x8(l, l), 0);
+    }
+#endif
+    for (; x < dst.w; x++) {
+      unsigned r = p[x] >> 11, g = (p[x] >> 5) & 63, b = p[x] & 31;
+      d[x] = gs_luma((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+    }
+  }
+  GS_TRACE_END("gs_rgb565_to_gray");
+}
+
+// Bayer patterns, the value is the position of R in the 2x2 cell (y * 2 + x), B is opposite
+enum { GS_BAYER_RGGB, GS_BAYER_GRBG, GS_BAYER_GBRG, GS_BAYER_BGGR };
+
+// Raw 8-bit Bayer frames of (dst.w * 2) x (dst.h * 2) pixels, each 2x2 cell becomes one gray
+// pixel: gs_luma() of R, the mean of both G and B, no demosaicing
+GS_API void gs_bayer_to_gray_half(struct gs_image dst, const uint8_t *raw, unsigned stride,
+                                  int pattern) {
+  gs_assert(gs_valid(dst) && raw && stride >= dst.w * 2 && pattern >= 0 && pattern < 4);
+  GS_TRACE_BEGIN("gs_bayer_to_gray_half", dst.w * dst.h * 4);
+  unsigned ri = pattern, bi = 3 - pattern;
+  for (unsigned y = 0; y < dst.h; y++) {
+    const uint8_t *r0 = &raw[y * 2 * stride], *r1 = r0 + stride;
+    uint8_t *d = &dst.data[y * dst.w];
+    unsigned x = 0;
+#ifdef __wasm_simd128__
+    for (; x + 8 <= dst.w; x += 8) {  // 77 * r + 75 * (g0 + g1) + 29 * b + 128 fits in 16 bits
+      v128_t a = wasm_v128_load(&r0[x * 2]), b = wasm_v128_load(&r1[x * 2]);
+      v128_t m = wasm_i16x8_splat(0xff), c[4] = {wasm_v128_and(a, m), wasm_u16x8_shr(a, 8),
+                                                  wasm_v128_and(b, m), wasm_u16x8_shr(b, 8)};
+      v128_t g = wasm_i16x8_add(c[ri ^ 1], c[ri ^ 2]);
+      v128_t l = wasm_i16x8_add(wasm_i16x8_mul(c[ri], wasm_i16x8_splat(77)), wasm_i16x8_splat(128));
+      l = wasm_i16x8_add(l, wasm_i16x8_mul(g, wasm_i16x8_splat(75)));
+      l = wasm_u16x8_shr(wasm_i16x8_add(l, wasm_i16x8_mul(c[bi], wasm_i16x8_splat(29))), 8);
+      wasm_v128_store64_lane(&d[x], wasm_u8x16_narrow_i16x8(l, l), 0);
+    }
+#endif
+    for (; x < dst.w; x++) {
+      const uint8_t c[4] = {r0[x * 2], r0[x * 2 + 1], r1[x * 2], r1[x * 2 + 1]};
+      d[x] = (uint8_t)((77 * c[ri] + 75 * (c[ri ^ 1] + c[ri ^ 2]) + 29 * c[bi] + 128) >> 8);
+    }
+  }
+  GS_TRACE_END("gs_bayer_to_gray_half");
+}
+
 //
 // Image processing
 //
 
+// Clips r to a w x h image, so with gs_assert() compiled out a crop or copy of mismatched sizes
+// still only touches the overlap of both images
+static inline struct gs_rect gs_clip_rect(struct gs_rect r, unsigned w, unsigned h) {
+  r.w = r.x < w ? GS_MIN(r.w, w - r.x) : 0;
+  r.h = r.y < h ? GS_MIN(r.h, h - r.y) : 0;
+  return r;
+}
+
 GS_API void gs_crop(struct gs_image dst, struct gs_image src, struct gs_rect roi) {
   gs_assert(gs_valid(dst) && gs_valid(src) && roi.x + roi.w <= src.w && roi.y + roi.h <= src.h &&
             dst.w == roi.w && dst.h == roi.h);
-  gs_for(roi, x, y) gs_set(dst, x, y, gs_get(src, roi.x + x, roi.y + y));
+  if (!gs_valid(dst) || !gs_valid(src)) return;
+  GS_TRACE_BEGIN("gs_crop", roi.w * roi.h);
+  roi = gs_clip_rect(roi, src.w, src.h);
+  unsigned w = GS_MIN(roi.w, dst.w), h = GS_MIN(roi.h, dst.h);
+  const uint8_t *row = &src.data[roi.y * src.w + roi.x];
+  if (w == src.w && w == dst.w) {  // rows are contiguous
+    gs_copy_bytes(dst.data, row, w * h);
+  } else {
+    for (unsigned y = 0; y < h; y++) gs_copy_bytes(&dst.data[y * dst.w], &row[y * src.w], w);
+  }
+  GS_TRACE_END("gs_crop");
 }
 
 GS_API void gs_copy(struct gs_image dst, struct gs_image src) {
   gs_crop(dst, src, (struct gs_rect){0, 0, src.w, src.h});
 }
 
+// Crops without a second buffer, rows move up within img.data which becomes roi.w x roi.h
+GS_API struct gs_image gs_crop_inplace(struct gs_image img, struct gs_rect roi) {
+  gs_assert(gs_valid(img) && roi.x + roi.w <= img.w && roi.y + roi.h <= img.h);
+  roi = gs_clip_rect(roi, img.w, img.h);
+  GS_TRACE_BEGIN("gs_crop_inplace", roi.w * roi.h);
+  for (unsigned y = 0; y < roi.h; y++)
+    gs_copy_bytes(&img.data[y * roi.w], &img.data[(roi.y + y) * img.w + roi.x], roi.w);
+  GS_TRACE_END("gs_crop_inplace");
+  return (struct gs_image){roi.w, roi.h, img.data};
+}
+
 GS_API void gs_resize_nn(struct gs_image dst, struct gs_image src) {
+  GS_TRACE_BEGIN("gs_resize_nn", dst.w * dst.h);
   gs_for(dst, x, y) {
     unsigned sx = x * src.w / dst.w, sy = y * src.h / dst.h;
     gs_set(dst, x, y, gs_get(src, sx, sy));
   }
+  GS_TRACE_END("gs_resize_nn");
+}
+
+// Bilinear sample at Q16 coordinates, clamped to the image, truncated like the float code
+static inline uint8_t gs_sample_q16(struct gs_image img, int64_t sx, int64_t sy) {
+  sx = GS_MAX(0, GS_MIN(sx, (int64_t)(img.w - 1) << 16));
+  sy = GS_MAX(0, GS_MIN(sy, (int64_t)(img.h - 1) << 16));
+  unsigned x0 = (unsigned)(sx >> 16), y0 = (unsigned)(sy >> 16);
+  unsigned x1 = GS_MIN(x0 + 1, img.w - 1), y1 = GS_MIN(y0 + 1, img.h - 1);
+  uint32_t dx = (uint32_t)(sx & 0xffff), dy = (uint32_t)(sy & 0xffff);
+  uint32_t top = gs_get(img, x0, y0) * (65536 - dx) + gs_get(img, x1, y0) * dx;
+  uint32_t bot = gs_get(img, x0, y1) * (65536 - dx) + gs_get(img, x1, y1) * dx;
+  return (uint8_t)(((uint64_t)top * (65536 - dy) + (uint64_t)bot * dy) >> 32);
+}
+
+#if defined(__wasm_simd128__) && !defined(GS_NO_FLOAT)
+// 4 pixels of gs_resize(), same float operations in the same order as the scalar code
+static inline void gs_resize4(struct gs_image dst, struct gs_image src, unsigned x, unsigned y) {
+  float sy = ((float)y + 0.5f) * src.h / dst.h - 0.5f;
+  sy = GS_MAX(0.0f, GS_MIN(sy, src.h - 1.0f));
+  unsigned sy0 = (unsigned)sy, sy1 = GS_MIN(sy0 + 1, src.h - 1);
+  v128_t dy = wasm_f32x4_splat(sy - sy0), one = wasm_f32x4_splat(1.0f);
+  v128_t sx = wasm_f32x4_add(wasm_f32x4_splat((float)x), wasm_f32x4_make(0.5f, 1.5f, 2.5f, 3.5f));
+  sx = wasm_f32x4_sub(wasm_f32x4_div(wasm_f32x4_mul(sx, wasm_f32x4_splat((float)src.w)),
+                                     wasm_f32x4_splat((float)dst.w)),
+                      wasm_f32x4_splat(0.5f));
+  sx = wasm_f32x4_pmax(wasm_f32x4_pmin(wasm_f32x4_splat(src.w - 1.0f), sx), wasm_f32x4_splat(0));
+  v128_t sxi = wasm_i32x4_trunc_sat_f32x4(sx);
+  v128_t dx = wasm_f32x4_sub(sx, wasm_f32x4_convert_i32x4(sxi));
+  int32_t xs[4];
+  float c[4][4];
+  wasm_v128_store(xs, sxi);
+  for (int i = 0; i < 4; i++) {
+    unsigned x0 = (unsigned)xs[i], x1 = GS_MIN(x0 + 1, src.w - 1);
+    c[0][i] = src.data[sy0 * src.w + x0], c[1][i] = src.data[sy0 * src.w + x1];
+    c[2][i] = src.data[sy1 * src.w + x0], c[3][i] = src.data[sy1 * src.w + x1];
+  }
+  v128_t ndx = wasm_f32x4_sub(one, dx), ndy = wasm_f32x4_sub(one, dy);
+  v128_t p = wasm_f32x4_mul(wasm_f32x4_mul(wasm_v128_load(c[0]), ndx), ndy);
+  p = wasm_f32x4_add(p, wasm_f32x4_mul(wasm_f32x4_mul(wasm_v128_load(c[1]), dx), ndy));
+  p = wasm_f32x4_add(p, wasm_f32x4_mul(wasm_f32x4_mul(wasm_v128_load(c[2]), ndx), dy));
+  p = wasm_f32x4_add(p, wasm_f32x4_mul(wasm_f32x4_mul(wasm_v128_load(c[3]), dx), dy));
+  wasm_v128_store(xs, wasm_u32x4_trunc_sat_f32x4(p));
+  for (int i = 0; i < 4; i++) dst.data[y * dst.w + x + i] = (uint8_t)xs[i];
 }
+#endif
 
 GS_API void gs_resize(struct gs_image dst, struct gs_image src) {
   gs_assert(gs_valid(dst) && gs_valid(src));
+  GS_TRACE_BEGIN("gs_resize", dst.w * dst.h);
   gs_for(dst, x, y) {
+#ifdef GS_NO_FLOAT
+    int64_t sx = ((int64_t)(2 * x + 1) * src.w << 16) / (2 * dst.w) - 32768;
+    int64_t sy = ((int64_t)(2 * y + 1) * src.h << 16) / (2 * dst.h) - 32768;
+    gs_set(dst, x, y, gs_sample_q16(src, sx, sy));
+#else
+#ifdef __wasm_simd128__
+    if (x + 4 <= dst.w) {
+      gs_resize4(dst, src, x, y);
+      x += 3;
+      continue;
+    }
+#endif
     float sx = ((float)x + 0.5f) * src.w / dst.w - 0.5f;  // 0.5f centers the pixel
     float sy = ((float)y + 0.5f) * src.h / dst.h - 0.5f;
     sx = GS_MAX(0.0f, GS_MIN(sx, src.w - 1.0f));
@@ -183,29 +704,53 @@ GS_API void gs_resize(struct gs_image dst, struct gs_image src) {
     uint8_t p = (c00 * (1 - dx) * (1 - dy)) + (c01 * dx * (1 - dy)) + (c10 * (1 - dx) * dy) +
                 (c11 * dx * dy);
     gs_set(dst, x, y, p);
+#endif
   }
+  GS_TRACE_END("gs_resize");
 }
 
 GS_API void gs_downsample(struct gs_image dst, struct gs_image src) {
   gs_assert(gs_valid(src) && gs_valid(dst) && dst.w == src.w / 2 && dst.h == src.h / 2);
+  GS_TRACE_BEGIN("gs_downsample", src.w * src.h);
   gs_for(dst, x, y) {
     unsigned src_x = x * 2, src_y = y * 2;
     unsigned sum = gs_get(src, src_x, src_y) + gs_get(src, src_x + 1, src_y) +
                    gs_get(src, src_x, src_y + 1) + gs_get(src, src_x + 1, src_y + 1);
     gs_set(dst, x, y, (uint8_t)(sum / 4));
   }
+  GS_TRACE_END("gs_downsample");
 }
 
 GS_API void gs_histogram(struct gs_image img, unsigned hist[256]) {
   gs_assert(gs_valid(img) && hist != NULL);
+  GS_TRACE_BEGIN("gs_histogram", img.w * img.h);
   for (unsigned i = 0; i < 256; i++) hist[i] = 0;
   for (unsigned i = 0; i < img.w * img.h; i++) hist[img.data[i]]++;
+  GS_TRACE_END("gs_histogram");
 }
 
 GS_API uint8_t gs_otsu_threshold(struct gs_image img) {
   gs_assert(gs_valid(img));
+  GS_TRACE_BEGIN("gs_otsu_threshold", img.w * img.h);
   unsigned hist[256] = {0}, wb = 0, wf = 0, threshold = 0;
   gs_histogram(img, hist);
+#ifdef GS_NO_FLOAT
+  // wb * wf * (mB - mF)^2 == d^2 / (wb * wf) with d = sumB * N - sum * wb, d scaled to 31 bits
+  int64_t n = img.w * img.h, sum = 0, sumB = 0, varMax = -1;
+  unsigned shift = 0;
+  while ((255 * n * n) >> shift >= ((int64_t)1 << 31)) shift++;
+  for (unsigned i = 0; i < 256; i++) sum += (int64_t)i * hist[i];
+  for (unsigned t = 0; t < 256; t++) {
+    wb += hist[t];
+    if (wb == 0) continue;
+    wf = img.w * img.h - wb;
+    if (wf == 0) break;
+    sumB += (int64_t)t * hist[t];
+    int64_t d = (sumB * n - sum * wb) / ((int64_t)1 << shift);
+    int64_t varBetween = d * d / ((int64_t)wb * wf);
+    if (varBetween > varMax) varMax = varBetween, threshold = t;
+  }
+#else
   float sum = 0, sumB = 0, varMax = -1.0;
   for (unsigned i = 0; i < 256; i++) sum += (float)i * hist[i];
   for (unsigned t = 0; t < 256; t++) {
@@ -219,17 +764,27 @@ GS_API uint8_t gs_otsu_threshold(struct gs_image img) {
     float varBetween = (float)wb * (float)wf * (mB - mF) * (mB - mF);
     if (varBetween > varMax) varMax = varBetween, threshold = t;
   }
+#endif
+  GS_TRACE_END("gs_otsu_threshold");
   return (uint8_t)threshold;
 }
 
 GS_API void gs_threshold(struct gs_image img, uint8_t thresh) {
   gs_assert(gs_valid(img));
-  for (unsigned i = 0; i < img.w * img.h; i++) img.data[i] = (img.data[i] > thresh) ? 255 : 0;
+  GS_TRACE_BEGIN("gs_threshold", img.w * img.h);
+  unsigned i = 0;
+#ifdef __wasm_simd128__
+  for (v128_t t = wasm_u8x16_splat(thresh); i + 16 <= img.w * img.h; i += 16)
+    wasm_v128_store(&img.data[i], wasm_u8x16_gt(wasm_v128_load(&img.data[i]), t));
+#endif
+  for (; i < img.w * img.h; i++) img.data[i] = (img.data[i] > thresh) ? 255 : 0;
+  GS_TRACE_END("gs_threshold");
 }
 
 GS_API void gs_adaptive_threshold(struct gs_image dst, struct gs_image src, unsigned radius,
                                   int c) {
   gs_assert(gs_valid(dst) && gs_valid(src) && dst.w == src.w && dst.h == src.h);
+  GS_TRACE_BEGIN("gs_adaptive_threshold", src.w * src.h);
   gs_for(src, x, y) {
     unsigned sum = 0, count = 0;
     for (int dy = -radius; dy <= (int)radius; dy++) {
@@ -244,6 +799,7 @@ GS_API void gs_adaptive_threshold(struct gs_image dst, struct gs_image src, unsi
     int threshold = sum / count - c;
     gs_set(dst, x, y, (gs_get(src, x, y) > threshold) ? 255 : 0);
   }
+  GS_TRACE_END("gs_adaptive_threshold");
 }
 
 #define gs_sharpen ((struct gs_image){3, 3, (uint8_t[]){0, -1, 0, -1, 5, -1, 0, -1, 0}})  // norm 1
@@ -255,6 +811,7 @@ GS_API void gs_adaptive_threshold(struct gs_image dst, struct gs_image src, unsi
 GS_API void gs_filter(struct gs_image dst, struct gs_image src, struct gs_image kernel,
                       unsigned norm) {
   gs_assert(gs_valid(src) && gs_valid(dst) && dst.w == src.w && dst.h == src.h && norm > 0);
+  GS_TRACE_BEGIN("gs_filter", dst.w * dst.h);
   gs_for(dst, x, y) {
     int sum = 0;
     gs_for(kernel, i, j) {
@@ -263,11 +820,50 @@ GS_API void gs_filter(struct gs_image dst, struct gs_image src, struct gs_image
     sum = sum / norm;
     gs_set(dst, x, y, GS_MIN(255, GS_MAX(0, sum)));
   }
+  GS_TRACE_END("gs_filter");
 }
 
 GS_API void gs_blur(struct gs_image dst, struct gs_image src, unsigned radius) {
   gs_assert(gs_valid(src) && gs_valid(dst) && dst.w == src.w && dst.h == src.h);
+  GS_TRACE_BEGIN("gs_blur", src.w * src.h);
+  unsigned x0 = 0, x1 = 0, y0 = 0, y1 = 0;  // inner area, done with SIMD
+#if defined(__wasm_simd128__) && !defined(GS_NO_FLOAT)
+  unsigned r = radius, w = src.w;
+  if (r <= 7 && w >= 2 * r + 8 && src.h > 2 * r) {  // 16-bit sums do not overflow
+    uint16_t colsum[w];
+    v128_t n = wasm_f32x4_splat((float)((2 * r + 1) * (2 * r + 1)));
+    x0 = r, x1 = r + (w - 2 * r) / 8 * 8, y0 = r, y1 = src.h - r;
+    for (unsigned y = y0; y < y1; y++) {
+      unsigned x = 0;
+      for (; x + 8 <= w; x += 8) {
+        v128_t v = wasm_i16x8_splat(0);
+        for (unsigned dy = 0; dy <= 2 * r; dy++)
+          v = wasm_i16x8_add(v, wasm_u16x8_load8x8(&src.data[(y + dy - r) * w + x]));
+        wasm_v128_store(&colsum[x], v);
+      }
+      for (; x < w; x++) {
+        colsum[x] = 0;
+        for (unsigned dy = 0; dy <= 2 * r; dy++) colsum[x] += src.data[(y + dy - r) * w + x];
+      }
+      for (x = x0; x < x1; x += 8) {
+        v128_t v = wasm_i16x8_splat(0);
+        for (unsigned dx = 0; dx <= 2 * r; dx++)
+          v = wasm_i16x8_add(v, wasm_v128_load(&colsum[x + dx - r]));
+        v128_t lo = wasm_f32x4_convert_u32x4(wasm_u32x4_extend_low_u16x8(v));
+        v128_t hi = wasm_f32x4_convert_u32x4(wasm_u32x4_extend_high_u16x8(v));
+        lo = wasm_u32x4_trunc_sat_f32x4(wasm_f32x4_div(lo, n));  // exact for these sums
+        hi = wasm_u32x4_trunc_sat_f32x4(wasm_f32x4_div(hi, n));
+        v = wasm_u16x8_narrow_i32x4(lo, hi);
+        wasm_v128_store64_lane(&dst.data[y * w + x], wasm_u8x16_narrow_i16x8(v, v), 0);
+      }
+    }
+  }
+#endif
   gs_for(src, x, y) {
+    if (y >= y0 && y < y1 && x >= x0 && x < x1) {
+      x = x1 - 1;
+      continue;
+    }
     unsigned sum = 0, count = 0;
     for (int dy = -radius; dy <= (int)radius; dy++) {
       for (int dx = -radius; dx <= (int)radius; dx++) {
@@ -280,12 +876,27 @@ GS_API void gs_blur(struct gs_image dst, struct gs_image src, unsigned radius) {
     }
     gs_set(dst, x, y, (uint8_t)(sum / count));
   }
+  GS_TRACE_END("gs_blur");
 }
 
 enum { GS_ERODE, GS_DILATE };
 static inline void gs_morph(struct gs_image dst, struct gs_image src, int op) {
   gs_assert(gs_valid(dst) && gs_valid(src) && dst.w == src.w && dst.h == src.h);
+  GS_TRACE_BEGIN(op == GS_ERODE ? "gs_erode" : "gs_dilate", src.w * src.h);
   gs_for(src, x, y) {
+#ifdef __wasm_simd128__
+    if (x > 0 && y > 0 && y + 1 < src.h && x + 17 <= src.w) {  // 16 inner pixels
+      const uint8_t *p = &src.data[(y - 1) * src.w + x - 1];
+      v128_t v = wasm_v128_load(p);
+      for (int i = 0; i < 9; i++) {
+        v128_t q = wasm_v128_load(p + (i / 3) * src.w + i % 3);
+        v = op == GS_ERODE ? wasm_u8x16_min(v, q) : wasm_u8x16_max(v, q);
+      }
+      wasm_v128_store(&dst.data[y * dst.w + x], v);
+      x += 15;
+      continue;
+    }
+#endif
     uint8_t val = op == GS_ERODE ? 255 : 0;
     for (int dy = -1; dy <= 1; dy++) {
       for (int dx = -1; dx <= 1; dx++) {
@@ -299,14 +910,33 @@ static inline void gs_morph(struct gs_image dst, struct gs_image src, int op) {
     }
     gs_set(dst, x, y, val);
   }
+  GS_TRACE_END(op == GS_ERODE ? "gs_erode" : "gs_dilate");
 }
 GS_API void gs_erode(struct gs_image dst, struct gs_image src) { gs_morph(dst, src, GS_ERODE); }
 GS_API void gs_dilate(struct gs_image dst, struct gs_image src) { gs_morph(dst, src, GS_DILATE); }
 
 GS_API void gs_sobel(struct gs_image dst, struct gs_image src) {
   gs_assert(gs_valid(dst) && gs_valid(src) && dst.w == src.w && dst.h == src.h);
+  GS_TRACE_BEGIN("gs_sobel", src.w * src.h);
   for (unsigned y = 1; y < src.h - 1; y++) {
-    for (unsigned x = 1; x < src.w - 1; x++) {
+    unsigned x = 1;
+#ifdef __wasm_simd128__
+    const uint8_t *r0 = &src.data[(y - 1) * src.w], *r1 = r0 + src.w, *r2 = r1 + src.w;
+    for (; x + 9 <= src.w; x += 8) {  // 8 pixels in 16-bit lanes
+      v128_t d0 = wasm_i16x8_sub(wasm_u16x8_load8x8(r0 + x + 1), wasm_u16x8_load8x8(r0 + x - 1));
+      v128_t d1 = wasm_i16x8_sub(wasm_u16x8_load8x8(r1 + x + 1), wasm_u16x8_load8x8(r1 + x - 1));
+      v128_t d2 = wasm_i16x8_sub(wasm_u16x8_load8x8(r2 + x + 1), wasm_u16x8_load8x8(r2 + x - 1));
+      v128_t gx = wasm_i16x8_add(wasm_i16x8_add(d0, d2), wasm_i16x8_shl(d1, 1));
+      v128_t s0 = wasm_i16x8_add(wasm_u16x8_load8x8(r0 + x - 1), wasm_u16x8_load8x8(r0 + x + 1));
+      v128_t s2 = wasm_i16x8_add(wasm_u16x8_load8x8(r2 + x - 1), wasm_u16x8_load8x8(r2 + x + 1));
+      s0 = wasm_i16x8_add(s0, wasm_i16x8_shl(wasm_u16x8_load8x8(r0 + x), 1));
+      s2 = wasm_i16x8_add(s2, wasm_i16x8_shl(wasm_u16x8_load8x8(r2 + x), 1));
+      v128_t gy = wasm_i16x8_sub(s2, s0);
+      v128_t m = wasm_u16x8_shr(wasm_i16x8_add(wasm_i16x8_abs(gx), wasm_i16x8_abs(gy)), 1);
+      wasm_v128_store64_lane(&dst.data[y * dst.w + x], wasm_u8x16_narrow_i16x8(m, m), 0);
+    }
+#endif
+    for (; x < src.w - 1; x++) {
       int gx = -src.data[(y - 1) * src.w + (x - 1)] + src.data[(y - 1) * src.w + (x + 1)] -
                2 * src.data[y * src.w + (x - 1)] + 2 * src.data[y * src.w + (x + 1)] -
                src.data[(y + 1) * src.w + (x - 1)] + src.data[(y + 1) * src.w + (x + 1)];
@@ -317,6 +947,7 @@ GS_API void gs_sobel(struct gs_image dst, struct gs_image src) {
       dst.data[y * dst.w + x] = (uint8_t)GS_MAX(0, GS_MIN(magnitude, 255));
     }
   }
+  GS_TRACE_END("gs_sobel");
 }
 
 //
@@ -327,30 +958,25 @@ static inline gs_label gs_root(gs_label x, gs_label *parents) {
   return x;
 }
 
-GS_API unsigned gs_blobs(struct gs_image img, gs_label *labels, struct gs_blob *blobs,
-                         unsigned nblobs) {
-  gs_assert(gs_valid(img) && labels != NULL && blobs != NULL && nblobs > 0);
-  unsigned w = img.w;
-  gs_label next = 1, parents[nblobs + 1];
-  unsigned cx[nblobs], cy[nblobs];
-  for (unsigned i = 0; i < img.w * img.h; i++) labels[i] = 0;
-  for (unsigned i = 0; i < nblobs; i++)
-    blobs[i] = (struct gs_blob){0, 0, {UINT_MAX, UINT_MAX, 0, 0}, {0, 0}};
-  for (unsigned i = 0; i <= nblobs; i++) parents[i] = i;
-  // first pass: label and union
-  gs_for(img, x, y) {
-    if (gs_get(img, x, y) < 128) continue;  // skip background pixels
-    gs_label left = (x > 0) ? labels[y * w + (x - 1)] : 0;
-    gs_label top = (y > 0) ? labels[(y - 1) * w + x] : 0;
+// Labels one row, top are the labels of the row above (0 for the first row). Pixels get the
+// smaller of the left and top labels and the two are united, returns the next free label.
+static inline gs_label gs_label_row(const uint8_t *row, unsigned w, unsigned y, const gs_label *top,
+                                    gs_label *cur, struct gs_blob *blobs, unsigned nblobs,
+                                    gs_label next, gs_label *parents, unsigned *cx, unsigned *cy) {
+  for (unsigned x = 0; x < w; x++) {
+    cur[x] = 0;
+    if (row[x] < 128) continue;  // skip background pixels
+    gs_label left = (x > 0) ? cur[x - 1] : 0;
+    gs_label up = top ? top[x] : 0;
     // 4-connectivity: pick smallest from left and top, if any is non-zero
-    gs_label n = (left && top ? GS_MIN(left, top) : (left ? left : (top ? top : 0)));
+    gs_label n = (left && up ? GS_MIN(left, up) : (left ? left : (up ? up : 0)));
     if (!n) {                       // new component
       if (next > nblobs) continue;  // out of labels
       blobs[next - 1] = (struct gs_blob){next, 1, {x, y, x, y}, {x, y}};
       cx[next - 1] = x, cy[next - 1] = y;
-      labels[y * w + x] = next++;
+      cur[x] = next++;
     } else {  // existing component
-      labels[y * w + x] = n;
+      cur[x] = n;
       struct gs_blob *b = &blobs[n - 1];
       cx[n - 1] += x, cy[n - 1] += y;
       b->area++;
@@ -358,13 +984,18 @@ GS_API unsigned gs_blobs(struct gs_image img, gs_label *labels, struct gs_blob *
       // keep bottom-right point coordinates in w/h of the rect, adjust later
       b->box.w = GS_MAX(x, b->box.w), b->box.h = GS_MAX(y, b->box.h);
       // union if labels are different
-      if (left && top && left != top) {
-        gs_label root1 = gs_root(left, parents), root2 = gs_root(top, parents);
+      if (left && up && left != up) {
+        gs_label root1 = gs_root(left, parents), root2 = gs_root(up, parents);
         if (root1 != root2) parents[GS_MAX(root1, root2)] = GS_MIN(root1, root2);
       }
     }
   }
-  // merge blobs
+  return next;
+}
+
+// Merges united blobs into their roots and compacts them, returns the number of blobs
+static inline unsigned gs_merge_blobs(struct gs_blob *blobs, gs_label next, gs_label *parents,
+                                      unsigned *cx, unsigned *cy) {
   for (int i = 0; i < next - 1; i++) {
     gs_label root = gs_root(blobs[i].label, parents);
     if (root != blobs[i].label) {
@@ -378,13 +1009,6 @@ GS_API unsigned gs_blobs(struct gs_image img, gs_label *labels, struct gs_blob *
       blobs[i].area = 0;
     }
   }
-  // second pass: update labels
-  gs_for(img, x, y) {
-    gs_label l = labels[y * w + x];
-    if (l) labels[y * w + x] = gs_root(l, parents);
-  }
-
-  // compact blobs
   unsigned m = 0;
   for (int i = 0; i < next - 1; i++) {
     if (blobs[i].area == 0) continue;
@@ -397,13 +1021,41 @@ GS_API unsigned gs_blobs(struct gs_image img, gs_label *labels, struct gs_blob *
     // move to compacted position
     blobs[m++] = blobs[i];
   }
+  return m;
+}
 
+GS_API unsigned gs_blobs(struct gs_image img, gs_label *labels, struct gs_blob *blobs,
+                         unsigned nblobs) {
+  gs_assert(gs_valid(img) && labels != NULL && blobs != NULL && nblobs > 0);
+  GS_TRACE_BEGIN("gs_blobs", img.w * img.h);
+  unsigned w = img.w;
+  gs_label next = 1, parents[nblobs + 1];
+  unsigned cx[nblobs], cy[nblobs];
+  for (unsigned i = 0; i < nblobs; i++)
+    blobs[i] = (struct gs_blob){0, 0, {UINT_MAX, UINT_MAX, 0, 0}, {0, 0}};
+  for (unsigned i = 0; i <= nblobs; i++) parents[i] = i;
+  // first pass: label and union
+  GS_TRACE_BEGIN("gs_blobs/label", img.w * img.h);
+  for (unsigned y = 0; y < img.h; y++)
+    next = gs_label_row(&img.data[y * w], w, y, y ? &labels[(y - 1) * w] : 0, &labels[y * w],
+                        blobs, nblobs, next, parents, cx, cy);
+  GS_TRACE_END("gs_blobs/label");
+  // second pass: update labels
+  GS_TRACE_BEGIN("gs_blobs/relabel", img.w * img.h);
+  gs_for(img, x, y) {
+    gs_label l = labels[y * w + x];
+    if (l) labels[y * w + x] = gs_root(l, parents);
+  }
+  GS_TRACE_END("gs_blobs/relabel");
+  unsigned m = gs_merge_blobs(blobs, next, parents, cx, cy);
+  GS_TRACE_END("gs_blobs");
   return m;  // number of non-empty blobs
 }
 
 GS_API void gs_blob_corners(struct gs_image img, gs_label *labels, struct gs_blob *b,
                             struct gs_point c[4]) {
   gs_assert(gs_valid(img) && b && labels);
+  GS_TRACE_BEGIN("gs_blob_corners", b->box.w * b->box.h);
   struct gs_point tl = b->centroid, tr = b->centroid, br = b->centroid, bl = b->centroid;
   int min_sum = INT_MAX, max_sum = INT_MIN, min_diff = INT_MAX, max_diff = INT_MIN;
   for (unsigned y = b->box.y; y < b->box.y + b->box.h; y++) {
@@ -418,10 +1070,60 @@ GS_API void gs_blob_corners(struct gs_image img, gs_label *labels, struct gs_blo
     }
   }
   c[0] = tl, c[1] = tr, c[2] = br, c[3] = bl;
+  GS_TRACE_END("gs_blob_corners");
+}
+
+// Moves each corner to where the image gradients around it intersect: every gradient in the window
+// is orthogonal to the line from its pixel to the corner, which gives a 2x2 least squares system.
+// Corners stay within radius (up to 32) of their initial positions, e.g. scaled up from a preview.
+GS_API void gs_refine_corners(struct gs_image img, struct gs_point *c, unsigned n,
+                              unsigned radius) {
+  gs_assert(gs_valid(img) && c && img.w > 2 && img.h > 2);
+  GS_TRACE_BEGIN("gs_refine_corners", n * (2 * radius + 1) * (2 * radius + 1));
+  int r = (int)GS_MIN(radius, 32);
+  for (unsigned i = 0; i < n; i++) {
+    int x0 = (int)c[i].x, y0 = (int)c[i].y, cx = x0, cy = y0;
+    for (int iter = 0; iter < 4; iter++) {
+      int64_t gxx = 0, gxy = 0, gyy = 0, bx = 0, by = 0;
+      for (int y = GS_MAX(cy - r, 1); y <= GS_MIN(cy + r, (int)img.h - 2); y++) {
+        for (int x = GS_MAX(cx - r, 1); x <= GS_MIN(cx + r, (int)img.w - 2); x++) {
+          int dx = img.data[y * img.w + x + 1] - img.data[y * img.w + x - 1];
+          int dy = img.data[(y + 1) * img.w + x] - img.data[(y - 1) * img.w + x];
+          gxx += dx * dx, gxy += dx * dy, gyy += dy * dy;
+          bx += (int64_t)(dx * dx) * (x - cx) + (int64_t)(dx * dy) * (y - cy);
+          by += (int64_t)(dx * dy) * (x - cx) + (int64_t)(dy * dy) * (y - cy);
+        }
+      }
+      // flat area or a single straight edge: the corner position is undefined
+      int64_t det = gxx * gyy - gxy * gxy;
+      if (det <= 0 || det * 64 < (gxx + gyy) * (gxx + gyy)) break;
+      int64_t nx = gyy * bx - gxy * by, ny = gxx * by - gxy * bx;
+      int ox = (int)((nx >= 0 ? nx + det / 2 : nx - det / 2) / det);
+      int oy = (int)((ny >= 0 ? ny + det / 2 : ny - det / 2) / det);
+      if (ox == 0 && oy == 0) break;
+      cx = GS_MAX(GS_MIN(cx + ox, x0 + r), x0 - r), cy = GS_MAX(GS_MIN(cy + oy, y0 + r), y0 - r);
+      cx = GS_MAX(GS_MIN(cx, (int)img.w - 1), 0), cy = GS_MAX(GS_MIN(cy, (int)img.h - 1), 0);
+    }
+    c[i] = (struct gs_point){(unsigned)cx, (unsigned)cy};
+  }
+  GS_TRACE_END("gs_refine_corners");
 }
 
 GS_API void gs_perspective_correct(struct gs_image dst, struct gs_image src, struct gs_point c[4]) {
   gs_assert(gs_valid(dst) && gs_valid(src));
+  GS_TRACE_BEGIN("gs_perspective_correct", dst.w * dst.h);
+#ifdef GS_NO_FLOAT
+  // same bilinear blend of the corners with integer weights, divided once into Q16
+  int64_t w = GS_MAX((int64_t)dst.w - 1, 1), h = GS_MAX((int64_t)dst.h - 1, 1);
+  gs_for(dst, x, y) {
+    int64_t w0 = (w - x) * (h - y), w1 = x * (h - y), w2 = x * y, w3 = (w - x) * y;
+    int64_t px = c[0].x * w0 + c[1].x * w1 + c[2].x * w2 + c[3].x * w3;
+    int64_t py = c[0].y * w0 + c[1].y * w1 + c[2].y * w2 + c[3].y * w3;
+    int64_t sx = px / (w * h) * 65536 + px % (w * h) * 65536 / (w * h);
+    int64_t sy = py / (w * h) * 65536 + py % (w * h) * 65536 / (w * h);
+    dst.data[y * dst.w + x] = gs_sample_q16(src, sx, sy);
+  }
+#else
   float w = dst.w - 1.0f, h = dst.h - 1.0f;
   gs_for(dst, x, y) {
     float u = x / w, v = y / h;
@@ -441,12 +1143,37 @@ GS_API void gs_perspective_correct(struct gs_image dst, struct gs_image src, str
     dst.data[y * dst.w + x] = (uint8_t)((c00 * (1 - dx) * (1 - dy)) + (c01 * dx * (1 - dy)) +
                                         (c10 * (1 - dx) * dy) + (c11 * dx * dy));
   }
+#endif
+  GS_TRACE_END("gs_perspective_correct");
+}
+
+// Rotates src around its center by angle (radians, clockwise on screen as y points down) into
+// dst, centered the same way. Fixed-point bilinear sampling in both builds, dst pixels that map
+// outside of src get fill.
+GS_API void gs_rotate(struct gs_image dst, struct gs_image src, gs_real angle, uint8_t fill) {
+  gs_assert(gs_valid(dst) && gs_valid(src));
+  GS_TRACE_BEGIN("gs_rotate", dst.w * dst.h);
+  int64_t s = gs_real_to_q16(gs_sin(angle));
+  int64_t c = gs_real_to_q16(gs_sin(angle + GS_REAL(1.570796f)));
+  int64_t max_x = (int64_t)(src.w - 1) << 16, max_y = (int64_t)(src.h - 1) << 16;
+  int64_t dx = -((int64_t)(dst.w - 1) << 15);
+  for (unsigned y = 0; y < dst.h; y++) {
+    // source of dst (x, y) is the offset from the dst center rotated back around the src center
+    int64_t dy = ((int64_t)y << 16) - ((int64_t)(dst.h - 1) << 15);
+    int64_t sx = (max_x >> 1) + ((c * dx + s * dy) >> 16);
+    int64_t sy = (max_y >> 1) + ((c * dy - s * dx) >> 16);
+    uint8_t *row = &dst.data[y * dst.w];
+    for (unsigned x = 0; x < dst.w; x++, sx += c, sy -= s)
+      row[x] = sx < 0 || sy < 0 || sx > max_x || sy > max_y ? fill : gs_sample_q16(src, sx, sy);
+  }
+  GS_TRACE_END("gs_rotate");
 }
 
 GS_API void gs_trace_contour(struct gs_image img, struct gs_image visited, struct gs_contour *c) {
   gs_assert(gs_valid(img) && gs_valid(visited) && img.w == visited.w && img.h == visited.h);
   static const int dx[] = {1, 1, 0, -1, -1, -1, 0, 1};
   static const int dy[] = {0, 1, 1, 1, 0, -1, -1, -1};
+  GS_TRACE_BEGIN("gs_trace_contour", 0);
 
   c->length = 0;
   c->box = (struct gs_rect){c->start.x, c->start.y, 1, 1};
@@ -477,43 +1204,74 @@ GS_API void gs_trace_contour(struct gs_image img, struct gs_image visited, struc
       seenstart = 1;
     }
   }
+  GS_TRACE_END("gs_trace_contour");
+}
+
+static inline int gs_fast_score(struct gs_image img, unsigned x, unsigned y, unsigned threshold) {
+  static const int dx[16] = {0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3, -3, -3, -2, -1};
+  static const int dy[16] = {-3, -3, -2, -1, 0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3};
+  uint8_t p = gs_get(img, x, y);
+  int run = 0, score = 0;
+  for (int i = 0; i < 16 + 9; i++) {
+    int idx = (i % 16);
+    uint8_t v = gs_get(img, x + dx[idx], y + dy[idx]);
+    if (v > p + threshold) {
+      run = (run > 0) ? run + 1 : 1;
+    } else if (v < p - threshold) {
+      run = (run < 0) ? run - 1 : -1;
+    } else {
+      run = 0;
+    }
+    if (run >= 9 || run <= -9) {
+      score = 255;
+      for (int j = 0; j < 16; j++) {
+        int d = gs_get(img, x + dx[j], y + dy[j]) - p;
+        if (d < 0) d = -d;
+        if (d < score) score = d;
+      }
+      break;
+    }
+  }
+  return score;
 }
 
 GS_API unsigned gs_fast(struct gs_image img, struct gs_image scoremap, struct gs_keypoint *kps,
                         unsigned nkps, unsigned threshold) {
   gs_assert(gs_valid(img) && kps && nkps > 0);
-  static const int dx[16] = {0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3, -3, -3, -2, -1};
-  static const int dy[16] = {-3, -3, -2, -1, 0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3};
   unsigned n = 0;
+  GS_TRACE_BEGIN("gs_fast", img.w * img.h);
   // first pass: compute score map
+  GS_TRACE_BEGIN("gs_fast/score", img.w * img.h);
   for (unsigned y = 3; y < img.h - 3; y++) {
     for (unsigned x = 3; x < img.w - 3; x++) {
-      uint8_t p = gs_get(img, x, y);
-      int run = 0, score = 0;
-      for (int i = 0; i < 16 + 9; i++) {
-        int idx = (i % 16);
-        uint8_t v = gs_get(img, x + dx[idx], y + dy[idx]);
-        if (v > p + threshold) {
-          run = (run > 0) ? run + 1 : 1;
-        } else if (v < p - threshold) {
-          run = (run < 0) ? run - 1 : -1;
-        } else {
-          run = 0;
-        }
-        if (run >= 9 || run <= -9) {
-          score = 255;
-          for (int j = 0; j < 16; j++) {
-            int d = gs_get(img, x + dx[j], y + dy[j]) - p;
-            if (d < 0) d = -d;
-            if (d < score) score = d;
-          }
-          break;
+#ifdef __wasm_simd128__
+      // any 9 pixel arc covers 2 of the 4 compass points, skip 16 pixels where none does
+      if (threshold < 256 && x + 19 <= img.w) {
+        const uint8_t *c = &img.data[y * img.w + x];
+        const uint8_t *q[4] = {c - 3 * img.w, c + 3, c + 3 * img.w, c - 3};
+        v128_t p = wasm_v128_load(c), t = wasm_u8x16_splat(threshold), one = wasm_u8x16_splat(1);
+        v128_t hi = wasm_u8x16_add_sat(p, t), lo = wasm_u8x16_sub_sat(p, t);
+        v128_t wrap = wasm_u8x16_lt(p, t);  // p - threshold wraps, anything is darker
+        v128_t nb = wasm_i8x16_splat(0), nd = nb;
+        for (int i = 0; i < 4; i++) {
+          v128_t v = wasm_v128_load(q[i]), b = wasm_u8x16_gt(v, hi);
+          v128_t d = wasm_v128_andnot(wasm_v128_or(wasm_u8x16_lt(v, lo), wrap), b);
+          nb = wasm_i8x16_sub(nb, b), nd = wasm_i8x16_sub(nd, d);
         }
+        unsigned mask =
+            wasm_i8x16_bitmask(wasm_v128_or(wasm_u8x16_gt(nb, one), wasm_u8x16_gt(nd, one)));
+        for (unsigned i = 0; i < 16; i++)
+          gs_set(scoremap, x + i, y, (mask >> i) & 1 ? gs_fast_score(img, x + i, y, threshold) : 0);
+        x += 15;
+        continue;
       }
-      gs_set(scoremap, x, y, score);
+#endif
+      gs_set(scoremap, x, y, gs_fast_score(img, x, y, threshold));
     }
   }
+  GS_TRACE_END("gs_fast/score");
   // second pass: non-maximum suppression
+  GS_TRACE_BEGIN("gs_fast/nms", img.w * img.h);
   for (unsigned y = 3; y < img.h - 3; y++) {
     for (unsigned x = 3; x < img.w - 3; x++) {
       int s = gs_get(scoremap, x, y), is_max = 1;
@@ -530,6 +1288,8 @@ GS_API unsigned gs_fast(struct gs_image img, struct gs_image scoremap, struct gs
       if (is_max && n < nkps) kps[n++] = (struct gs_keypoint){{x, y}, (unsigned)s, 0, {0}};
     }
   }
+  GS_TRACE_END("gs_fast/nms");
+  GS_TRACE_END("gs_fast");
   return n;
 }
 
@@ -605,9 +1365,9 @@ static const int gs_brief_pattern[256][4] = {
     {-7, 2, 15, 0},     {-3, 2, 13, 6},     {1, 0, 2, 1},        {-7, -4, -4, 3}};
 // clang-format: on
 
-GS_API float gs_compute_orientation(struct gs_image img, unsigned x, unsigned y, unsigned r) {
+GS_API gs_real gs_compute_orientation(struct gs_image img, unsigned x, unsigned y, unsigned r) {
   gs_assert(gs_valid(img) && x >= r && y >= r && x < img.w - r && y < img.h - r);
-  float m01 = 0, m10 = 0;
+  int m01 = 0, m10 = 0;
   for (int dy = -(int)r; dy <= (int)r; dy++) {
     for (int dx = -(int)r; dx <= (int)r; dx++) {
       if (dx * dx + dy * dy <= (int)(r * r)) {
@@ -623,14 +1383,15 @@ GS_API float gs_compute_orientation(struct gs_image img, unsigned x, unsigned y,
 GS_API void gs_brief_descriptor(struct gs_image img, struct gs_keypoint *kp) {
   gs_assert(gs_valid(img) && kp);
   int x = kp->pt.x, y = kp->pt.y;
-  float angle = kp->angle, sin_a = gs_sin(angle), cos_a = gs_sin((float)(angle + 1.57079f));
+  gs_real angle = kp->angle, sin_a = gs_sin(angle), cos_a = gs_sin(angle + GS_REAL(1.57079f));
   for (int i = 0; i < 8; i++) kp->descriptor[i] = 0;
   for (int i = 0; i < 256; i++) {
-    float dx1 = gs_brief_pattern[i][0] * cos_a - gs_brief_pattern[i][1] * sin_a;
-    float dy1 = gs_brief_pattern[i][0] * sin_a + gs_brief_pattern[i][1] * cos_a;
-    float dx2 = gs_brief_pattern[i][2] * cos_a - gs_brief_pattern[i][3] * sin_a;
-    float dy2 = gs_brief_pattern[i][2] * sin_a + gs_brief_pattern[i][3] * cos_a;
-    int x1 = x + (int)dx1, y1 = y + (int)dy1, x2 = x + (int)dx2, y2 = y + (int)dy2;
+    gs_real dx1 = gs_brief_pattern[i][0] * cos_a - gs_brief_pattern[i][1] * sin_a;
+    gs_real dy1 = gs_brief_pattern[i][0] * sin_a + gs_brief_pattern[i][1] * cos_a;
+    gs_real dx2 = gs_brief_pattern[i][2] * cos_a - gs_brief_pattern[i][3] * sin_a;
+    gs_real dy2 = gs_brief_pattern[i][2] * sin_a + gs_brief_pattern[i][3] * cos_a;
+    int x1 = x + GS_REAL_INT(dx1), y1 = y + GS_REAL_INT(dy1);
+    int x2 = x + GS_REAL_INT(dx2), y2 = y + GS_REAL_INT(dy2);
     uint8_t intensity1 = gs_get(img, x1, y1), intensity2 = gs_get(img, x2, y2);
     if (intensity1 > intensity2) kp->descriptor[i / 32] |= (1U << (i % 32));
   }
@@ -651,10 +1412,14 @@ static void gs_sort_keypoints(struct gs_keypoint *kps, unsigned n) {
 GS_API unsigned gs_orb_extract(struct gs_image img, struct gs_keypoint *kps, unsigned nkps,
                                unsigned threshold, uint8_t *scoremap_buffer) {
   gs_assert(gs_valid(img) && kps && nkps > 0 && scoremap_buffer);
+  GS_TRACE_BEGIN("gs_orb_extract", img.w * img.h);
   struct gs_image scoremap = {img.w, img.h, scoremap_buffer};
   static struct gs_keypoint candidates[5000];
   unsigned n_fast = gs_fast(img, scoremap, candidates, GS_MIN(nkps * 4, 5000), threshold);
+  GS_TRACE_BEGIN("gs_orb_extract/sort", n_fast);
   if (n_fast > 1) gs_sort_keypoints(candidates, n_fast);
+  GS_TRACE_END("gs_orb_extract/sort");
+  GS_TRACE_BEGIN("gs_orb_extract/brief", n_fast);
   unsigned n_orb = 0, radius = 15;
   for (unsigned i = 0; i < n_fast && n_orb < nkps; i++) {
     unsigned x = candidates[i].pt.x, y = candidates[i].pt.y;
@@ -665,36 +1430,52 @@ GS_API unsigned gs_orb_extract(struct gs_image img, struct gs_keypoint *kps, uns
       n_orb++;
     }
   }
+  GS_TRACE_END("gs_orb_extract/brief");
+  GS_TRACE_END("gs_orb_extract");
   return n_orb;
 }
 
+static inline unsigned gs_popcount(uint32_t v) {
+  v = v - ((v >> 1) & 0x55555555);
+  v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+  return (((v + (v >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
 static inline unsigned gs_hamming_distance(const uint32_t desc1[8], const uint32_t desc2[8]) {
+#ifdef __wasm_simd128__
+  v128_t a = wasm_v128_xor(wasm_v128_load(desc1), wasm_v128_load(desc2));
+  v128_t b = wasm_v128_xor(wasm_v128_load(desc1 + 4), wasm_v128_load(desc2 + 4));
+  v128_t c = wasm_i8x16_add(wasm_i8x16_popcnt(a), wasm_i8x16_popcnt(b));
+  c = wasm_u32x4_extadd_pairwise_u16x8(wasm_u16x8_extadd_pairwise_u8x16(c));
+  return wasm_i32x4_extract_lane(c, 0) + wasm_i32x4_extract_lane(c, 1) +
+         wasm_i32x4_extract_lane(c, 2) + wasm_i32x4_extract_lane(c, 3);
+#else
   unsigned dist = 0;
-  for (int i = 0; i < 8; i++) {
-    uint32_t eor = desc1[i] ^ desc2[i];
-    while (eor) dist += eor & 1, eor >>= 1;
-  }
+  for (int i = 0; i < 8; i++) dist += gs_popcount(desc1[i] ^ desc2[i]);
   return dist;
+#endif
 }
 
 GS_API unsigned gs_match_orb(const struct gs_keypoint *kps1, unsigned n1,
                              const struct gs_keypoint *kps2, unsigned n2, struct gs_match *matches,
-                             unsigned max_matches, float max_distance) {
+                             unsigned max_matches, unsigned max_distance) {
   gs_assert(kps1 && kps2 && matches);
+  GS_TRACE_BEGIN("gs_match_orb", n1 * n2);
   unsigned n = 0;
   for (unsigned i = 0; i < n1 && n < max_matches; i++) {
-    float best_dist = max_distance + 1, second_best = max_distance + 1;
+    unsigned best_dist = max_distance + 1, second_best = max_distance + 1;
     unsigned best_idx = 0;
     for (unsigned j = 0; j < n2; j++) {
-      float d = gs_hamming_distance(kps1[i].descriptor, kps2[j].descriptor);
+      unsigned d = gs_hamming_distance(kps1[i].descriptor, kps2[j].descriptor);
       if (d < best_dist)
         second_best = best_dist, best_dist = d, best_idx = j;
       else if (d < second_best)
         second_best = d;
     }
-    if (best_dist <= max_distance && best_dist < 0.8f * second_best)
-      matches[n++] = (struct gs_match){i, best_idx, (unsigned)best_dist};
+    if (best_dist <= max_distance && 5 * best_dist < 4 * second_best)  // ratio test, 0.8
+      matches[n++] = (struct gs_match){i, best_idx, best_dist};
   }
+  GS_TRACE_END("gs_match_orb");
   return n;
 }
 
@@ -706,7 +1487,7 @@ GS_API void gs_match_template(struct gs_image img, struct gs_image tmpl, struct
   gs_assert(gs_valid(img) && gs_valid(tmpl) && gs_valid(result));
   gs_assert(img.w >= tmpl.w && img.h >= tmpl.h);
   gs_assert(result.w == img.w - tmpl.w + 1 && result.h == img.h - tmpl.h + 1);
-
+  GS_TRACE_BEGIN("gs_match_template", result.w * result.h * tmpl.w * tmpl.h);
   gs_for(result, rx, ry) {
     unsigned long long sum = 0;
     for (unsigned ty = 0; ty < tmpl.h; ty++) {
@@ -720,6 +1501,7 @@ GS_API void gs_match_template(struct gs_image img, struct gs_image tmpl, struct
     unsigned score = (unsigned)(sum * 255ULL / max_diff);
     gs_set(result, rx, ry, (uint8_t)(255 - GS_MIN(score, 255)));
   }
+  GS_TRACE_END("gs_match_template");
 }
 
 GS_API struct gs_point gs_find_best_match(struct gs_image result) {
@@ -743,12 +1525,19 @@ GS_API struct gs_point gs_find_best_match(struct gs_image result) {
 
 GS_API void gs_integral(struct gs_image src, unsigned *ii) {
   gs_assert(gs_valid(src) && ii);
-  unsigned row = 0;
-  gs_for(src, x, y) {
-    if (x == 0) row = 0;
-    row += gs_get(src, x, y);
-    ii[y * src.w + x] = row + (y ? ii[(y - 1) * src.w + x] : 0);
+  GS_TRACE_BEGIN("gs_integral", src.w * src.h);
+  for (unsigned y = 0; y < src.h; y++) {
+    unsigned row = 0, x = 0, *cur = &ii[y * src.w], *prev = y ? cur - src.w : cur;
+    for (; x < src.w; x++) row += src.data[y * src.w + x], cur[x] = row;
+    if (y == 0) continue;
+    x = 0;
+#ifdef __wasm_simd128__
+    for (; x + 4 <= src.w; x += 4)
+      wasm_v128_store(&cur[x], wasm_i32x4_add(wasm_v128_load(&cur[x]), wasm_v128_load(&prev[x])));
+#endif
+    for (; x < src.w; x++) cur[x] += prev[x];
   }
+  GS_TRACE_END("gs_integral");
 }
 
 static inline uint32_t gs_integral_sum(const unsigned *ii, unsigned iw, unsigned x, unsigned y,
@@ -788,18 +1577,18 @@ static inline int gs_lbp_match(int code, const int32_t *subsets, int n) {
 }
 
 GS_API unsigned gs_lbp_window(const struct gs_lbp_cascade *c, const unsigned *ii, unsigned iw,
-                              unsigned ih, int x, int y, float scale) {
-  int win_w = (int)(c->window_w * scale), win_h = (int)(c->window_h * scale);
+                              unsigned ih, int x, int y, gs_real scale) {
+  int win_w = GS_REAL_INT(c->window_w * scale), win_h = GS_REAL_INT(c->window_h * scale);
   if (x + win_w > (int)iw || y + win_h > (int)ih) return 0;
   for (int si = 0; si < c->nstages; si++) {
     int start = c->stage_weak_start[si], n = c->stage_nweaks[si];
-    float sum = 0.0f;
+    gs_real sum = 0;
     for (int i = 0; i < n; i++) {
       int wi = start + i, fi = c->weak_feature_idx[wi];
-      int fx = (int)(c->features[fi * 4 + 0] * scale);
-      int fy = (int)(c->features[fi * 4 + 1] * scale);
-      int fw = (int)(c->features[fi * 4 + 2] * scale);
-      int fh = (int)(c->features[fi * 4 + 3] * scale);
+      int fx = GS_REAL_INT(c->features[fi * 4 + 0] * scale);
+      int fy = GS_REAL_INT(c->features[fi * 4 + 1] * scale);
+      int fw = GS_REAL_INT(c->features[fi * 4 + 2] * scale);
+      int fh = GS_REAL_INT(c->features[fi * 4 + 3] * scale);
       if (fw < 1) fw = 1;
       if (fh < 1) fh = 1;
       int code = gs_lbp_code(ii, iw, x, y, fx, fy, fw, fh);
@@ -812,26 +1601,1872 @@ GS_API unsigned gs_lbp_window(const struct gs_lbp_cascade *c, const unsigned *ii
   return 1;
 }
 
+// Scans all windows of a single scale, scales are independent and can run in parallel
+GS_API unsigned gs_lbp_detect_scale(const struct gs_lbp_cascade *c, const unsigned *ii,
+                                    unsigned iw, unsigned ih, struct gs_rect *rects,
+                                    unsigned max_rects, gs_real scale, int step) {
+  unsigned n = 0;
+  int win_w = GS_REAL_INT(c->window_w * scale), win_h = GS_REAL_INT(c->window_h * scale);
+  for (int y = 0; y + win_h <= (int)ih && n < max_rects; y += step) {
+    for (int x = 0; x + win_w <= (int)iw && n < max_rects; x += step) {
+      if (gs_lbp_window(c, ii, iw, ih, x, y, scale)) {
+        rects[n].x = x;
+        rects[n].y = y;
+        rects[n].w = win_w;
+        rects[n].h = win_h;
+        n++;
+      }
+    }
+  }
+  return n;
+}
+
 GS_API unsigned gs_lbp_detect(const struct gs_lbp_cascade *c, const unsigned *ii, unsigned iw,
                               unsigned ih, struct gs_rect *rects, unsigned max_rects,
-                              float scale_factor, float min_scale, float max_scale, int step) {
+                              gs_real scale_factor, gs_real min_scale, gs_real max_scale,
+                              int step) {
   unsigned n = 0;
-  for (float scale = min_scale; scale <= max_scale && n < max_rects; scale *= scale_factor) {
-    int win_w = (int)(c->window_w * scale), win_h = (int)(c->window_h * scale);
+  GS_TRACE_BEGIN("gs_lbp_detect", iw * ih);
+  for (gs_real scale = min_scale; scale <= max_scale && n < max_rects;
+       scale = gs_real_mul(scale, scale_factor)) {
+    int win_w = GS_REAL_INT(c->window_w * scale), win_h = GS_REAL_INT(c->window_h * scale);
     if (win_w > (int)iw || win_h > (int)ih) break;
-    for (int y = 0; y + win_h <= (int)ih && n < max_rects; y += step) {
-      for (int x = 0; x + win_w <= (int)iw && n < max_rects; x += step) {
-        if (gs_lbp_window(c, ii, iw, ih, x, y, scale)) {
-          rects[n].x = x;
-          rects[n].y = y;
-          rects[n].w = win_w;
-          rects[n].h = win_h;
-          n++;
-        }
-      }
+    n += gs_lbp_detect_scale(c, ii, iw, ih, rects + n, max_rects - n, scale, step);
+  }
+  GS_TRACE_END("gs_lbp_detect");
+  return n;
+}
+
+// Tiled detection keeps the integral image bounded: tiles start on the step grid and overlap by
+// the largest window, so each window of gs_lbp_detect() on the whole image is evaluated the same
+// way by at least one tile. Returns the number of tiles and sets tile i, empty if i is out of
+// range.
+GS_API unsigned gs_lbp_tile(const struct gs_lbp_cascade *c, unsigned w, unsigned h,
+                            unsigned tile_w, unsigned tile_h, gs_real max_scale, int step,
+                            unsigned i, struct gs_rect *tile) {
+  unsigned overlap_w = (unsigned)GS_REAL_INT(c->window_w * max_scale);
+  unsigned overlap_h = (unsigned)GS_REAL_INT(c->window_h * max_scale);
+  gs_assert(step > 0 && tile_w > overlap_w + step && tile_h > overlap_h + step);
+  unsigned sx = (tile_w - overlap_w) / step * step, sy = (tile_h - overlap_h) / step * step;
+  unsigned nx = w > tile_w ? (w - tile_w + sx - 1) / sx + 1 : 1;
+  unsigned ny = h > tile_h ? (h - tile_h + sy - 1) / sy + 1 : 1;
+  *tile = (struct gs_rect){0, 0, 0, 0};
+  if (i < nx * ny) {
+    unsigned x = (i % nx) * sx, y = (i / nx) * sy;
+    *tile = (struct gs_rect){x, y, GS_MIN(tile_w, w - x), GS_MIN(tile_h, h - y)};
+  }
+  return nx * ny;
+}
+
+// Runs gs_lbp_detect() on one tile of img, ii must hold tile.w * tile.h values
+GS_API unsigned gs_lbp_detect_tile(const struct gs_lbp_cascade *c, struct gs_image img,
+                                   struct gs_rect tile, unsigned *ii, struct gs_rect *rects,
+                                   unsigned max_rects, gs_real scale_factor, gs_real min_scale,
+                                   gs_real max_scale, int step) {
+  gs_assert(gs_valid(img) && ii && tile.x + tile.w <= img.w && tile.y + tile.h <= img.h);
+  for (unsigned y = 0; y < tile.h; y++) {
+    unsigned row = 0;
+    const uint8_t *p = &img.data[(tile.y + y) * img.w + tile.x];
+    for (unsigned x = 0; x < tile.w; x++) {
+      row += p[x];
+      ii[y * tile.w + x] = row + (y ? ii[(y - 1) * tile.w + x] : 0);
+    }
+  }
+  unsigned n = gs_lbp_detect(c, ii, tile.w, tile.h, rects, max_rects, scale_factor, min_scale,
+                             max_scale, step);
+  for (unsigned i = 0; i < n; i++) rects[i].x += tile.x, rects[i].y += tile.y;
+  return n;
+}
+
+// Removes duplicate rects, e.g. the same window found by two overlapping tiles
+GS_API unsigned gs_rects_dedup(struct gs_rect *rects, unsigned n) {
+  unsigned m = 0;
+  for (unsigned i = 0; i < n; i++) {
+    unsigned j = 0;
+    while (j < m && (rects[j].x != rects[i].x || rects[j].y != rects[i].y ||
+                     rects[j].w != rects[i].w || rects[j].h != rects[i].h))
+      j++;
+    if (j == m) rects[m++] = rects[i];
+  }
+  return m;
+}
+
+GS_API unsigned gs_lbp_detect_tiled(const struct gs_lbp_cascade *c, struct gs_image img,
+                                    unsigned *ii, unsigned tile_w, unsigned tile_h,
+                                    struct gs_rect *rects, unsigned max_rects,
+                                    gs_real scale_factor, gs_real min_scale, gs_real max_scale,
+                                    int step) {
+  struct gs_rect tile = {0, 0, 0, 0};
+  unsigned n = 0, ntiles = gs_lbp_tile(c, img.w, img.h, tile_w, tile_h, max_scale, step, 0, &tile);
+  for (unsigned i = 0; i < ntiles && n < max_rects; i++) {
+    gs_lbp_tile(c, img.w, img.h, tile_w, tile_h, max_scale, step, i, &tile);
+    n += gs_lbp_detect_tile(c, img, tile, ii, rects + n, max_rects - n, scale_factor, min_scale,
+                            max_scale, step);
+    n = gs_rects_dedup(rects, n);
+  }
+  return n;
+}
+
+//
+// Hough lines
+//
+static const int16_t gs_cos_q14[91] = {
+    16384, 16382, 16374, 16362, 16344, 16322, 16294, 16262, 16225, 16182, 16135, 16083, 16026,
+    15964, 15897, 15826, 15749, 15668, 15582, 15491, 15396, 15296, 15191, 15082, 14968, 14849,
+    14726, 14598, 14466, 14330, 14189, 14044, 13894, 13741, 13583, 13421, 13255, 13085, 12911,
+    12733, 12551, 12365, 12176, 11982, 11786, 11585, 11381, 11174, 10963, 10749, 10531, 10311,
+    10087, 9860,  9630,  9397,  9162,  8923,  8682,  8438,  8192,  7943,  7692,  7438,  7182,
+    6924,  6664,  6402,  6138,  5872,  5604,  5334,  5063,  4790,  4516,  4240,  3964,  3686,
+    3406,  3126,  2845,  2563,  2280,  1997,  1713,  1428,  1143,  857,   572,   286,   0};
+
+// cos and sin of theta degrees in [0, 180) as Q14
+static inline void gs_hough_trig(unsigned theta, int *c, int *s) {
+  *c = theta <= 90 ? gs_cos_q14[theta] : -gs_cos_q14[180 - theta];
+  *s = theta <= 90 ? gs_cos_q14[90 - theta] : gs_cos_q14[theta - 90];
+}
+
+static inline unsigned gs_isqrt(unsigned n) {
+  unsigned r = 0;
+  for (unsigned bit = 1u << 30; bit; bit >>= 2) {
+    if (n >= r + bit)
+      n -= r + bit, r = (r >> 1) + bit;
+    else
+      r >>= 1;
+  }
+  return r;
+}
+
+// rho is in [-w, diagonal], the accumulator has 180 / angle_step rows of gs_hough_rhos() cells
+static inline unsigned gs_hough_rhos(unsigned w, unsigned h) {
+  return w + gs_isqrt(w * w + h * h) + 2;
+}
+
+GS_API unsigned gs_hough_size(unsigned w, unsigned h, unsigned angle_step) {
+  gs_assert(angle_step > 0 && 180 % angle_step == 0);
+  return 180 / angle_step * gs_hough_rhos(w, h);
+}
+
+// Lists edge pixels (>= 128) of a binary or thresholded edge image, returns their number
+GS_API unsigned gs_edge_points(struct gs_image edges, struct gs_point *pts, unsigned max_pts) {
+  gs_assert(gs_valid(edges) && pts);
+  GS_TRACE_BEGIN("gs_edge_points", edges.w * edges.h);
+  unsigned n = 0;
+  for (unsigned y = 0; y < edges.h && n < max_pts; y++) {
+    const uint8_t *row = &edges.data[y * edges.w];
+    unsigned x = 0;
+#ifdef __wasm_simd128__
+    for (; x + 16 <= edges.w && n < max_pts; x += 16) {  // mostly empty, skip 16 at once
+      for (int m = wasm_i8x16_bitmask(wasm_v128_load(&row[x])); m && n < max_pts; m &= m - 1)
+        pts[n++] = (struct gs_point){x + __builtin_ctz(m), y};
     }
+#endif
+    for (; x < edges.w && n < max_pts; x++)
+      if (row[x] >= 128) pts[n++] = (struct gs_point){x, y};
   }
+  GS_TRACE_END("gs_edge_points");
   return n;
 }
 
+// Adds the votes of one point to all angles, returns the best angle index and its votes
+static inline unsigned gs_hough_vote(uint16_t *acc, unsigned w, unsigned nrho, unsigned angle_step,
+                                     struct gs_point p, int delta, unsigned *best) {
+  unsigned best_i = 0;
+  *best = 0;
+  for (unsigned i = 0, theta = 0; theta < 180; i++, theta += angle_step) {
+    int c, s;
+    gs_hough_trig(theta, &c, &s);
+    uint16_t *v = &acc[i * nrho + (((int)p.x * c + (int)p.y * s + (int)(w << 14) + 8192) >> 14)];
+    if (delta > 0 && *v < 65535) *v += 1;
+    if (delta < 0 && *v > 0) *v -= 1;
+    if (*v > *best) *best = *v, best_i = i;
+  }
+  return best_i;
+}
+
+// Votes for all points, acc holds gs_hough_size() cells
+GS_API void gs_hough(const struct gs_point *pts, unsigned npts, unsigned w, unsigned h,
+                     unsigned angle_step, uint16_t *acc) {
+  gs_assert(pts && acc && w > 0 && h > 0);
+  GS_TRACE_BEGIN("gs_hough", npts * (180 / angle_step));
+  unsigned nrho = gs_hough_rhos(w, h), best;
+  for (unsigned i = 0; i < gs_hough_size(w, h, angle_step); i++) acc[i] = 0;
+  for (unsigned i = 0; i < npts; i++) gs_hough_vote(acc, w, nrho, angle_step, pts[i], 1, &best);
+  GS_TRACE_END("gs_hough");
+}
+
+// Lines closer than d degrees and d pixels, theta 179 is next to theta 0 with the opposite rho
+static inline int gs_lines_near(struct gs_line a, struct gs_line b, unsigned d) {
+  unsigned dt = a.theta > b.theta ? a.theta - b.theta : b.theta - a.theta;
+  int dr = a.rho - b.rho, sr = a.rho + b.rho;
+  return (dt <= d && dr <= (int)d && -dr <= (int)d) ||
+         (180 - dt <= d && sr <= (int)d && -sr <= (int)d);
+}
+
+// Local maxima of the accumulator with at least threshold votes, the strongest first. Of equal
+// neighbours only the first one is a peak. A line spreads its votes over nearby angles, peaks
+// within min_dist degrees and pixels of a stronger line are dropped.
+GS_API unsigned gs_hough_lines(const uint16_t *acc, unsigned w, unsigned h, unsigned angle_step,
+                               unsigned threshold, unsigned min_dist, struct gs_line *lines,
+                               unsigned max_lines) {
+  gs_assert(acc && lines && max_lines > 0);
+  GS_TRACE_BEGIN("gs_hough_lines", gs_hough_size(w, h, angle_step));
+  unsigned nrho = gs_hough_rhos(w, h), nangles = 180 / angle_step, n = 0;
+  for (unsigned a = 0; a < nangles; a++) {
+    for (unsigned r = 0; r < nrho; r++) {
+      unsigned v = acc[a * nrho + r], peak = v >= threshold && v > 0;
+      for (int i = 0; i < 9 && peak; i++) {
+        int na = (int)a + i / 3 - 1, nr = (int)r + i % 3 - 1;
+        if (i == 4 || na < 0 || nr < 0 || na >= (int)nangles || nr >= (int)nrho) continue;
+        unsigned nv = acc[na * nrho + nr];
+        peak = i < 4 ? v > nv : v >= nv;
+      }
+      if (!peak || (n == max_lines && v <= lines[n - 1].votes)) continue;
+      struct gs_line line = {(int)r - (int)w, a * angle_step, v};
+      for (unsigned i = 0; i < n && peak; i++)
+        peak = lines[i].votes < v || !gs_lines_near(lines[i], line, min_dist);
+      if (!peak) continue;
+      unsigned k = 0;
+      for (unsigned i = 0; i < n; i++)  // drop weaker lines near this one
+        if (!gs_lines_near(lines[i], line, min_dist)) lines[k++] = lines[i];
+      n = k;
+      unsigned j = n < max_lines ? n++ : n - 1;  // insert sorted, drop the weakest
+      for (; j > 0 && lines[j - 1].votes < v; j--) lines[j] = lines[j - 1];
+      lines[j] = line;
+    }
+  }
+  GS_TRACE_END("gs_hough_lines");
+  return n;
+}
+
+// Progressive probabilistic Hough transform: points vote in random order and as soon as an angle
+// reaches threshold votes, the line through the point is followed along the edge pixels, across
+// gaps of up to max_gap pixels. Its pixels are removed from edges and their votes from acc, so
+// each pixel ends up in at most one segment and few points vote at all. pts are shuffled.
+GS_API unsigned gs_hough_segments(struct gs_image edges, struct gs_point *pts, unsigned npts,
+                                  unsigned angle_step, uint16_t *acc, unsigned threshold,
+                                  unsigned min_length, unsigned max_gap, struct gs_segment *segs,
+                                  unsigned max_segs) {
+  gs_assert(gs_valid(edges) && pts && acc && segs && threshold > 0);
+  GS_TRACE_BEGIN("gs_hough_segments", edges.w * edges.h);
+  enum { VOTED = 128, EDGE = 255 };  // edge pixels are >= 128, after voting they are 128
+  unsigned w = edges.w, h = edges.h, nrho = gs_hough_rhos(w, h), n = 0, best;
+  uint32_t seed = 1;
+  for (unsigned i = 0; i < gs_hough_size(w, h, angle_step); i++) acc[i] = 0;
+  for (unsigned i = 0; i < npts; i++) edges.data[pts[i].y * w + pts[i].x] = EDGE;
+  for (unsigned i = npts; i > 1; i--) {
+    seed = seed * 1103515245 + 12345;
+    unsigned j = (seed >> 8) % i;
+    struct gs_point t = pts[i - 1];
+    pts[i - 1] = pts[j], pts[j] = t;
+  }
+  for (unsigned i = 0; i < npts && n < max_segs; i++) {
+    struct gs_point p = pts[i];
+    if (edges.data[p.y * w + p.x] < 128) continue;  // already part of a segment
+    edges.data[p.y * w + p.x] = VOTED;
+    unsigned a = gs_hough_vote(acc, w, nrho, angle_step, p, 1, &best);
+    if (best < threshold) continue;
+    // follow the line direction (-sin, cos) in Q16 steps of one pixel along the major axis
+    int c, s, dx, dy;
+    gs_hough_trig(a * angle_step, &c, &s);
+    if ((s < 0 ? -s : s) > (c < 0 ? -c : c))
+      dx = s > 0 ? -65536 : 65536, dy = c * 65536 / (s < 0 ? -s : s);
+    else
+      dy = c > 0 ? 65536 : -65536, dx = -s * 65536 / (c < 0 ? -c : c);
+    struct gs_point end[2] = {p, p};
+    for (int k = 0; k < 2; k++) {
+      int x = (int)(p.x << 16) + 32768, y = (int)(p.y << 16) + 32768, gap = 0;
+      for (;; x += k ? -dx : dx, y += k ? -dy : dy) {
+        if (x < 0 || y < 0 || (unsigned)(x >> 16) >= w || (unsigned)(y >> 16) >= h) break;
+        if (edges.data[(y >> 16) * w + (x >> 16)] >= 128)
+          gap = 0, end[k] = (struct gs_point){(unsigned)(x >> 16), (unsigned)(y >> 16)};
+        else if (++gap > (int)max_gap)
+          break;
+      }
+    }
+    unsigned len = GS_MAX(end[0].x > end[1].x ? end[0].x - end[1].x : end[1].x - end[0].x,
+                          end[0].y > end[1].y ? end[0].y - end[1].y : end[1].y - end[0].y);
+    int good = len >= min_length;
+    // remove the pixels between both ends, and their votes if it is a segment
+    for (int k = 0; k < 2; k++) {
+      int x = (int)(p.x << 16) + 32768, y = (int)(p.y << 16) + 32768;
+      for (;; x += k ? -dx : dx, y += k ? -dy : dy) {
+        struct gs_point q = {(unsigned)(x >> 16), (unsigned)(y >> 16)};
+        uint8_t *m = &edges.data[q.y * w + q.x];
+        if (*m == VOTED && good) gs_hough_vote(acc, w, nrho, angle_step, q, -1, &best);
+        if (*m >= 128) *m = 0;
+        if (q.x == end[k].x && q.y == end[k].y) break;
+      }
+    }
+    if (good) segs[n++] = (struct gs_segment){end[0], end[1]};
+  }
+  GS_TRACE_END("gs_hough_segments");
+  return n;
+}
+
+//
+// QR codes and barcodes
+//
+
+// Binary images are bytes (light >= 128), or packed rows of (w + 7) / 8 bytes, most significant
+// bit first, with set bits for light pixels
+static inline int gs_bin_light(struct gs_image bin, int packed, int x, int y) {
+  if (packed) return bin.data[y * ((bin.w + 7) / 8) + x / 8] >> (7 - x % 8) & 1;
+  return bin.data[y * bin.w + x] >= 128;
+}
+
+// Packs bytes (light >= 128) into rows of (w + 7) / 8 bytes, padding bits are 0
+GS_API void gs_pack_bits(uint8_t *bits, struct gs_image img) {
+  gs_assert(gs_valid(img) && bits);
+  unsigned stride = (img.w + 7) / 8;
+  for (unsigned y = 0; y < img.h; y++) {
+    const uint8_t *row = &img.data[y * img.w];
+    for (unsigned b = 0; b < stride; b++) {
+      unsigned v = 0;
+      for (unsigned x = 8 * b; x < 8 * b + 8; x++) v = v << 1 | (x < img.w && row[x] >= 128);
+      bits[y * stride + b] = (uint8_t)v;
+    }
+  }
+}
+
+// Unpacks bits into bytes of 0 and 255
+GS_API void gs_unpack_bits(struct gs_image img, const uint8_t *bits) {
+  gs_assert(gs_valid(img) && bits);
+  unsigned stride = (img.w + 7) / 8;
+  gs_for(img, x, y) {
+    img.data[y * img.w + x] = (bits[y * stride + x / 8] >> (7 - x % 8) & 1) ? 255 : 0;
+  }
+}
+
+static inline unsigned gs_absdiff(unsigned a, unsigned b) { return a > b ? a - b : b - a; }
+
+// Runs are 1:1:3:1:1 within half a module, or 3/4 of a module when loose
+static inline int gs_finder_ratio(const unsigned r[5], int loose) {
+  int t = (int)(r[0] + r[1] + r[2] + r[3] + r[4]), v = loose ? 3 : 2;
+  if (t < 7) return 0;
+  for (int i = 0; i < 5; i++) {
+    int m = i == 2 ? 3 : 1, d = 28 * (int)r[i] - 4 * m * t;  // 28 * (run - m modules) / module
+    if (d <= -v * m * t || d >= v * m * t) return 0;
+  }
+  return 1;
+}
+
+// Runs through (x, y) along (dx, dy): the dark center, then light and dark rings on both sides,
+// none longer than max_run. Returns 0 if there is no such pattern, else sets the runs and the
+// offset of the middle of the center run in half pixels.
+static inline int gs_finder_cross(struct gs_image bin, int packed, int x, int y, int dx, int dy,
+                                  unsigned max_run, unsigned r[5], int *center2) {
+  unsigned n[2][3] = {{0, 0, 0}, {0, 0, 0}};
+  for (int k = 0; k < 2; k++) {
+    int s = k ? -1 : 1, i = k;
+    for (int ring = 0; ring < 3; ring++) {
+      for (;; i++) {
+        int px = x + s * i * dx, py = y + s * i * dy;
+        if (px < 0 || py < 0 || px >= (int)bin.w || py >= (int)bin.h) break;
+        if (gs_bin_light(bin, packed, px, py) != (ring == 1)) break;
+        if (++n[k][ring] > max_run) return 0;
+      }
+      if (n[k][ring] == 0 && (ring > 0 || k == 0)) return 0;
+    }
+  }
+  r[0] = n[1][2], r[1] = n[1][1], r[2] = n[0][0] + n[1][0], r[3] = n[0][1], r[4] = n[0][2];
+  *center2 = (int)n[0][0] - (int)n[1][0] - 1;
+  return 1;
+}
+
+// Confirms a row hit centered at (x, y) with total run length t vertically, again horizontally
+// through the vertical center and diagonally, then adds it to the finders or merges it into a
+// known one. Returns the new number of finders.
+static inline unsigned gs_finder_confirm(struct gs_image bin, int packed, int x, int y,
+                                         unsigned t, struct gs_finder *f, unsigned n,
+                                         unsigned max_finders) {
+  unsigned v[5], r[5], d[5];
+  int c2;
+  if (!gs_finder_cross(bin, packed, x, y, 0, 1, t, v, &c2) || !gs_finder_ratio(v, 0)) return n;
+  unsigned vt = v[0] + v[1] + v[2] + v[3] + v[4];
+  if (5 * gs_absdiff(vt, t) >= 2 * t) return n;  // about as tall as wide
+  y += c2 / 2;
+  if (!gs_finder_cross(bin, packed, x, y, 1, 0, 2 * vt, r, &c2) || !gs_finder_ratio(r, 0)) return n;
+  x += c2 / 2;
+  unsigned ht = r[0] + r[1] + r[2] + r[3] + r[4], size = (ht + vt + 1) / 2;
+  if (!gs_finder_cross(bin, packed, x, y, 1, 1, size, d, &c2) || !gs_finder_ratio(d, 1)) return n;
+  for (unsigned i = 0; i < n; i++) {
+    unsigned m = f[i].size / 7 + 1, c = f[i].count;
+    if (gs_absdiff(f[i].center.x, x) > m || gs_absdiff(f[i].center.y, y) > m) continue;
+    if (4 * gs_absdiff(f[i].size, size) > f[i].size) continue;
+    f[i].center.x = (f[i].center.x * c + x + c / 2) / (c + 1);
+    f[i].center.y = (f[i].center.y * c + y + c / 2) / (c + 1);
+    f[i].size = (f[i].size * c + size + c / 2) / (c + 1);
+    f[i].count++;
+    return n;
+  }
+  if (n < max_finders) f[n++] = (struct gs_finder){{(unsigned)x, (unsigned)y}, size, 1};
+  return n;
+}
+
+// Finds QR finder patterns in a binary image: dark:light:dark:light:dark runs of 1:1:3:1:1 in a
+// row, confirmed vertically and diagonally. Rows are scanned every 3/2 min_module rows, so each
+// finder center (3 modules tall) is hit at least twice, and every row for the next 3/2 modules
+// after a row with a 1:1:3:1:1 run, so large finders gather more confirmations. Packed rows skip
+// uniform bytes 8 pixels at a time. Returns the number of finders, the most often confirmed first.
+GS_API unsigned gs_qr_finders(struct gs_image bin, int packed, unsigned min_module,
+                              struct gs_finder *f, unsigned max_finders) {
+  gs_assert(gs_valid(bin) && f && max_finders > 0);
+  GS_TRACE_BEGIN("gs_qr_finders", bin.w * bin.h);
+  unsigned n = 0, step = GS_MAX(3 * min_module / 2, 1), stride = (bin.w + 7) / 8, dense = 0;
+  for (unsigned y = 0; y < bin.h; y += dense ? (dense--, 1) : step) {
+    // r[4] is the current run, runs alternate light and dark starting with a light one
+    unsigned r[5] = {0, 0, 0, 0, 0}, runs = 0;
+    int light = 1;
+    for (unsigned x = 0; x <= bin.w; x++) {
+      if (packed && x % 8 == 0 && x + 8 <= bin.w &&
+          bin.data[y * stride + x / 8] == (light ? 0xff : 0)) {
+        r[4] += 8, x += 7;
+        continue;
+      }
+      int l = x < bin.w ? gs_bin_light(bin, packed, x, y) : !light;  // end the last run
+      if (l != light) {
+        if (!light && runs >= 5 && gs_finder_ratio(r, 0)) {
+          unsigned t = r[0] + r[1] + r[2] + r[3] + r[4];
+          dense = GS_MAX(dense, 3 * t / 14);  // 3/2 modules of this run
+          n = gs_finder_confirm(bin, packed, x - r[4] - r[3] - r[2] + r[2] / 2, y, t, f, n,
+                                max_finders);
+        }
+        r[0] = r[1], r[1] = r[2], r[2] = r[3], r[3] = r[4], r[4] = 0;
+        light = l, runs++;
+      }
+      r[4]++;
+    }
+  }
+  for (unsigned i = 1; i < n; i++) {
+    struct gs_finder t = f[i];
+    unsigned j = i;
+    for (; j > 0 && f[j - 1].count < t.count; j--) f[j] = f[j - 1];
+    f[j] = t;
+  }
+  GS_TRACE_END("gs_qr_finders");
+  return n;
+}
+
+// Groups finders into QR codes: three finders of similar size where the corner one sees the other
+// two at about the same distance and a right angle, the best fitting triples first and each finder
+// once. The fourth corner completes the parallelogram, strong perspective is only approximated.
+// Uses the first 32 finders, corners are clamped to w x h.
+GS_API unsigned gs_qr_locate(const struct gs_finder *f, unsigned n, unsigned w, unsigned h,
+                             struct gs_qr *qrs, unsigned max_qrs) {
+  gs_assert(f && qrs);
+  n = GS_MIN(n, 32);
+  GS_TRACE_BEGIN("gs_qr_locate", n * n * n);
+  uint32_t used = 0;
+  unsigned nq = 0;
+  while (nq < max_qrs) {
+    int64_t best = -1;
+    unsigned t[3] = {0, 0, 0};
+    for (unsigned i = 0; i < n; i++) {
+      for (unsigned j = i + 1; j < n; j++) {
+        for (unsigned k = j + 1; k < n; k++) {
+          if (used >> i & 1 || used >> j & 1 || used >> k & 1) continue;
+          unsigned lo = GS_MIN(f[i].size, GS_MIN(f[j].size, f[k].size));
+          unsigned hi = GS_MAX(f[i].size, GS_MAX(f[j].size, f[k].size));
+          if (2 * hi > 3 * lo) continue;
+          unsigned c[3] = {i, j, k};
+          for (int a = 0; a < 3; a++) {
+            struct gs_point pa = f[c[a]].center, pb = f[c[(a + 1) % 3]].center,
+                            pc = f[c[(a + 2) % 3]].center;
+            int64_t abx = (int)pb.x - (int)pa.x, aby = (int)pb.y - (int)pa.y;
+            int64_t acx = (int)pc.x - (int)pa.x, acy = (int)pc.y - (int)pa.y;
+            int64_t d1 = abx * abx + aby * aby, d2 = acx * acx + acy * acy;
+            int64_t dot = abx * acx + aby * acy;
+            // centers at least sqrt(3) finder sizes apart (12 modules, version 1 codes have 14
+            // with some slack for the measured size), cos < 0.35, lengths within 3/2
+            if (d1 < 3 * lo * lo || d2 < 3 * lo * lo || 8 * dot * dot > d1 * d2) continue;
+            if (4 * d1 > 9 * d2 || 4 * d2 > 9 * d1) continue;
+            int64_t diff = d1 > d2 ? d1 - d2 : d2 - d1;
+            int64_t score = 1024 * dot * dot / (d1 * d2) + 1024 * diff / (d1 + d2);
+            if (best < 0 || score < best)
+              best = score, t[0] = c[a], t[1] = c[(a + 1) % 3], t[2] = c[(a + 2) % 3];
+          }
+        }
+      }
+    }
+    if (best < 0) break;
+    used |= 1u << t[0] | 1u << t[1] | 1u << t[2];
+    struct gs_point a = f[t[0]].center, b = f[t[1]].center, c = f[t[2]].center;
+    int abx = (int)b.x - (int)a.x, aby = (int)b.y - (int)a.y;
+    int acx = (int)c.x - (int)a.x, acy = (int)c.y - (int)a.y;
+    if (abx * acy - aby * acx < 0) {  // b must be top-right, c bottom-left
+      struct gs_point p = b;
+      b = c, c = p;
+      int x = abx, y = aby;
+      abx = acx, aby = acy, acx = x, acy = y;
+    }
+    // finder centers are 3.5 modules inside the corners and N - 7 modules apart
+    unsigned d = (gs_isqrt(abx * abx + aby * aby) + gs_isqrt(acx * acx + acy * acy)) / 2;
+    unsigned size = (f[t[0]].size + f[t[1]].size + f[t[2]].size) / 3;
+    unsigned modules = 7 + (14 * d + size) / (2 * size);
+    modules = GS_MAX((modules + 1) / 4 * 4 + 1, 21);  // 4 * version + 17
+    int g = 2 * ((int)modules - 7), ux = 7 * abx / g, uy = 7 * aby / g, vx = 7 * acx / g,
+        vy = 7 * acy / g;
+    int x[4] = {(int)a.x - ux - vx, (int)b.x + ux - vx, (int)b.x + acx + ux + vx,
+                (int)c.x - ux + vx};
+    int y[4] = {(int)a.y - uy - vy, (int)b.y + uy - vy, (int)b.y + acy + uy + vy,
+                (int)c.y - uy + vy};
+    for (int i = 0; i < 4; i++) {
+      qrs[nq].corners[i].x = (unsigned)GS_MAX(GS_MIN(x[i], (int)w - 1), 0);
+      qrs[nq].corners[i].y = (unsigned)GS_MAX(GS_MIN(y[i], (int)h - 1), 0);
+    }
+    qrs[nq++].modules = modules;
+  }
+  GS_TRACE_END("gs_qr_locate");
+  return nq;
+}
+
+// 1D barcodes are many parallel edges: per cell of img (img.w / cells.w x img.h / cells.h
+// pixels) the structure tensor of the gradients gives the squared coherence of their
+// orientation, ((l1 - l2) / (l1 + l2))^2 of its eigenvalues, scaled to 255. Cells with fewer
+// than a third of their pixels on edges are 0, flat areas as well as single edges.
+GS_API void gs_barcode_cells(struct gs_image cells, struct gs_image img) {
+  gs_assert(gs_valid(cells) && gs_valid(img) && img.w >= 2 * cells.w && img.h >= 2 * cells.h);
+  GS_TRACE_BEGIN("gs_barcode_cells", img.w * img.h);
+  unsigned cw = img.w / cells.w, ch = img.h / cells.h;
+  gs_for(cells, cx, cy) {
+    int64_t jxx = 0, jyy = 0, jxy = 0;
+    unsigned strong = 0;
+    for (unsigned y = GS_MAX(cy * ch, 1); y < GS_MIN((cy + 1) * ch, img.h - 1); y++) {
+      const uint8_t *p = &img.data[y * img.w], *up = p - img.w, *down = p + img.w;
+      for (unsigned x = GS_MAX(cx * cw, 1); x < GS_MIN((cx + 1) * cw, img.w - 1); x++) {
+        int gx = p[x + 1] - p[x - 1], gy = down[x] - up[x];
+        jxx += gx * gx, jyy += gy * gy, jxy += gx * gy;
+        strong += gx * gx + gy * gy >= 32 * 32;
+      }
+    }
+    // coherence is scale-free, shift the sums below 2^30 so their squares fit
+    while (jxx + jyy >= (int64_t)1 << 30) jxx >>= 1, jyy >>= 1, jxy /= 2;
+    int64_t e = jxx + jyy, num = (jxx - jyy) * (jxx - jyy) + 4 * jxy * jxy;
+    uint8_t v = 0;
+    if (3 * strong >= cw * ch) v = (uint8_t)GS_MIN(num / (e * e / 255 + 1), 255);
+    cells.data[cy * cells.w + cx] = v;
+  }
+  GS_TRACE_END("gs_barcode_cells");
+}
+
+// Finds barcode-like regions: cells above min_coherence connected into blobs of at least
+// min_cells cells. Boxes and centroids of the blobs are scaled to img pixels, labels holds
+// cells.w * cells.h labels. cells is overwritten. Returns the number of regions.
+GS_API unsigned gs_barcode_regions(struct gs_image img, struct gs_image cells, gs_label *labels,
+                                   struct gs_blob *blobs, unsigned max_blobs,
+                                   uint8_t min_coherence, unsigned min_cells) {
+  gs_assert(labels && blobs && max_blobs > 0);
+  GS_TRACE_BEGIN("gs_barcode_regions", img.w * img.h);
+  gs_barcode_cells(cells, img);
+  gs_threshold(cells, min_coherence);
+  unsigned cw = img.w / cells.w, ch = img.h / cells.h, m = 0;
+  unsigned n = gs_blobs(cells, labels, blobs, max_blobs);
+  for (unsigned i = 0; i < n; i++) {
+    struct gs_blob b = blobs[i];
+    if (b.area < min_cells) continue;
+    b.box = (struct gs_rect){b.box.x * cw, b.box.y * ch, b.box.w * cw, b.box.h * ch};
+    b.centroid = (struct gs_point){b.centroid.x * cw + cw / 2, b.centroid.y * ch + ch / 2};
+    blobs[m++] = b;
+  }
+  GS_TRACE_END("gs_barcode_regions");
+  return m;
+}
+
+//
+// HOG (histograms of oriented gradients)
+//
+
+// Gradient orientation in [0, 180) degrees as one of 9 bins of 20 degrees: binary search for the
+// last bin edge the gradient reaches, with the cos/sin table of the Hough transform
+static inline unsigned gs_hog_bin(int16_t gx, int16_t gy) {
+  int x = gx, y = gy;
+  if (y < 0 || (y == 0 && x < 0)) x = -x, y = -y;
+  unsigned lo = 0, hi = 9;
+  while (hi - lo > 1) {
+    unsigned mid = (lo + hi) / 2;
+    int c, s;
+    gs_hough_trig(20 * mid, &c, &s);
+    if (c * y - s * x >= 0)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Magnitude weighted orientation histograms of cell x cell pixels, 9 bins per cell, in rows of
+// img.w / cell cells. Gradients are central differences (one-sided at the image border), the
+// magnitude is max + 3/8 min of |gx| and |gy|, within 7% of the Euclidean one.
+GS_API void gs_hog_cells(struct gs_image img, unsigned cell, unsigned *hist) {
+  gs_assert(gs_valid(img) && hist && cell > 0);
+  unsigned cw = img.w / cell, ch = img.h / cell;
+  GS_TRACE_BEGIN("gs_hog_cells", cw * ch * cell * cell);
+  for (unsigned i = 0; i < cw * ch * 9; i++) hist[i] = 0;
+  for (unsigned y = 0; y < ch * cell; y++) {
+    const uint8_t *p = &img.data[y * img.w];
+    const uint8_t *up = y > 0 ? p - img.w : p, *down = y + 1 < img.h ? p + img.w : p;
+    unsigned *row = &hist[y / cell * cw * 9];
+    for (unsigned x = 0; x < cw * cell; x++) {
+      int16_t gx = (int16_t)((x + 1 < img.w ? p[x + 1] : p[x]) - (x > 0 ? p[x - 1] : p[x]));
+      int16_t gy = (int16_t)(down[x] - up[x]);
+      unsigned ax = gx < 0 ? -gx : gx, ay = gy < 0 ? -gy : gy;
+      if (ax + ay == 0) continue;
+      row[x / cell * 9 + gs_hog_bin(gx, gy)] += GS_MAX(ax, ay) + 3 * GS_MIN(ax, ay) / 8;
+    }
+  }
+  GS_TRACE_END("gs_hog_cells");
+}
+
+// Normalizes the blocks of 2x2 cells at every cell of a cw x ch grid into 36 bytes each, in rows
+// of cw - 1 blocks. L2-Hys: scaled to a unit L2 norm, clipped at 0.2, scaled again, 255 is 1.
+GS_API void gs_hog_blocks(const unsigned *hist, unsigned cw, unsigned ch, uint8_t *blocks) {
+  gs_assert(hist && blocks && cw > 1 && ch > 1);
+  GS_TRACE_BEGIN("gs_hog_blocks", (cw - 1) * (ch - 1) * 36);
+  for (unsigned by = 0; by + 1 < ch; by++) {
+    for (unsigned bx = 0; bx + 1 < cw; bx++) {
+      unsigned v[36], max = 0, shift = 0, sum = 0, sum2 = 0;
+      for (int i = 0; i < 36; i++) {
+        v[i] = hist[((by + i / 18) * cw + bx + i / 9 % 2) * 9 + i % 9];
+        max = GS_MAX(max, v[i]);
+      }
+      while (max >> shift >= 4096) shift++;  // sum of squares fits in 32 bits
+      for (int i = 0; i < 36; i++) v[i] >>= shift, sum += v[i] * v[i];
+      unsigned norm = gs_isqrt(sum) + 1;
+      for (int i = 0; i < 36; i++) v[i] = GS_MIN(v[i] * 255 / norm, 51), sum2 += v[i] * v[i];
+      unsigned norm2 = gs_isqrt(sum2) + 1;
+      uint8_t *out = &blocks[(by * (cw - 1) + bx) * 36];
+      for (int i = 0; i < 36; i++) out[i] = (uint8_t)GS_MIN(v[i] * 255 / norm2, 255);
+    }
+  }
+  GS_TRACE_END("gs_hog_blocks");
+}
+
+// Score of the window at cell (x, y): the weights times the blocks it covers plus the bias, blocks
+// are in rows of bw. The blocks of a row of the window are contiguous.
+GS_API int32_t gs_hog_window(const struct gs_hog_model *m, const uint8_t *blocks, unsigned bw,
+                             unsigned x, unsigned y) {
+  int32_t score = m->bias;
+  unsigned n = (m->win_w - 1) * 36u;
+  for (unsigned by = 0; by + 1 < m->win_h; by++) {
+    const uint8_t *b = &blocks[((y + by) * bw + x) * 36];
+    const int8_t *w = &m->weights[by * n];
+    unsigned i = 0;
+#ifdef __wasm_simd128__
+    v128_t acc = wasm_i32x4_splat(0);
+    for (; i + 16 <= n; i += 16) {
+      v128_t bv = wasm_v128_load(&b[i]), wv = wasm_v128_load(&w[i]);
+      acc = wasm_i32x4_add(acc, wasm_i32x4_dot_i16x8(wasm_u16x8_extend_low_u8x16(bv),
+                                                     wasm_i16x8_extend_low_i8x16(wv)));
+      acc = wasm_i32x4_add(acc, wasm_i32x4_dot_i16x8(wasm_u16x8_extend_high_u8x16(bv),
+                                                     wasm_i16x8_extend_high_i8x16(wv)));
+    }
+    score += wasm_i32x4_extract_lane(acc, 0) + wasm_i32x4_extract_lane(acc, 1) +
+             wasm_i32x4_extract_lane(acc, 2) + wasm_i32x4_extract_lane(acc, 3);
+#endif
+    for (; i < n; i++) score += w[i] * b[i];
+  }
+  return score;
+}
+
+// Bytes of work memory for gs_hog_detect_scale() on a w x h image, for any scale >= 1
+GS_API unsigned gs_hog_size(const struct gs_hog_model *m, unsigned w, unsigned h) {
+  unsigned cw = w / m->cell, ch = h / m->cell;
+  return cw * ch * 9 * sizeof(unsigned) + (GS_MAX(cw, 1) - 1) * (GS_MAX(ch, 1) - 1) * 36 + w * h;
+}
+
+// Detects at one scale: img is resized by 1 / scale into work, its cells and blocks are computed
+// once and shared by all windows, which slide by one cell. Returns rects in img pixels of windows
+// that score above threshold. Scales are independent, threads need their own work memory.
+GS_API unsigned gs_hog_detect_scale(const struct gs_hog_model *m, struct gs_image img,
+                                    gs_real scale, void *work, int32_t threshold,
+                                    struct gs_rect *rects, unsigned max_rects) {
+  gs_assert(m && gs_valid(img) && work && rects && m->win_w > 1 && m->win_h > 1);
+  gs_assert(scale >= GS_REAL(1));
+  unsigned sw = gs_real_div(img.w, scale), sh = gs_real_div(img.h, scale), n = 0;
+  unsigned cw = sw / m->cell, ch = sh / m->cell;
+  if (cw < m->win_w || ch < m->win_h) return 0;
+  GS_TRACE_BEGIN("gs_hog_detect_scale", sw * sh);
+  unsigned *hist = (unsigned *)work;
+  uint8_t *blocks = (uint8_t *)(hist + cw * ch * 9);
+  struct gs_image s = {sw, sh, blocks + (cw - 1) * (ch - 1) * 36};
+  if (sw == img.w && sh == img.h)
+    s = img;
+  else
+    gs_resize(s, img);
+  gs_hog_cells(s, m->cell, hist);
+  gs_hog_blocks(hist, cw, ch, blocks);
+  for (unsigned y = 0; y + m->win_h <= ch; y++) {
+    for (unsigned x = 0; x + m->win_w <= cw && n < max_rects; x++) {
+      if (gs_hog_window(m, blocks, cw - 1, x, y) <= threshold) continue;
+      rects[n++] = (struct gs_rect){x * m->cell * img.w / sw, y * m->cell * img.h / sh,
+                                    m->win_w * m->cell * img.w / sw,
+                                    m->win_h * m->cell * img.h / sh};
+    }
+  }
+  GS_TRACE_END("gs_hog_detect_scale");
+  return n;
+}
+
+// Detects from min_scale (>= 1) up to max_scale, work holds gs_hog_size() bytes
+GS_API unsigned gs_hog_detect(const struct gs_hog_model *m, struct gs_image img, void *work,
+                              int32_t threshold, struct gs_rect *rects, unsigned max_rects,
+                              gs_real scale_factor, gs_real min_scale, gs_real max_scale) {
+  unsigned n = 0;
+  GS_TRACE_BEGIN("gs_hog_detect", img.w * img.h);
+  for (gs_real scale = min_scale; scale <= max_scale && n < max_rects;
+       scale = gs_real_mul(scale, scale_factor)) {
+    unsigned sw = gs_real_div(img.w, scale), sh = gs_real_div(img.h, scale);
+    if (sw < m->win_w * m->cell || sh < m->win_h * m->cell) break;
+    n += gs_hog_detect_scale(m, img, scale, work, threshold, rects + n, max_rects - n);
+  }
+  GS_TRACE_END("gs_hog_detect");
+  return n;
+}
+
+//
+// Stereo
+//
+
+// Census transform of one pixel: a bit per neighbour in a (2 * rx + 1) x (2 * ry + 1) window, set
+// where it is darker than the center. Neighbours outside the image are clamped to the border.
+static inline uint64_t gs_census(struct gs_image img, int x, int y, int rx, int ry) {
+  uint8_t c = img.data[y * img.w + x];
+  uint64_t bits = 0;
+  if (x >= rx && y >= ry && x + rx < (int)img.w && y + ry < (int)img.h) {
+    for (int dy = -ry; dy <= ry; dy++) {
+      const uint8_t *row = &img.data[(y + dy) * img.w + x];
+      for (int dx = -rx; dx <= rx; dx++)
+        if (dx || dy) bits = bits << 1 | (row[dx] < c);
+    }
+    return bits;
+  }
+  for (int dy = -ry; dy <= ry; dy++) {
+    const uint8_t *row = &img.data[GS_MAX(GS_MIN(y + dy, (int)img.h - 1), 0) * img.w];
+    for (int dx = -rx; dx <= rx; dx++)
+      if (dx || dy) bits = bits << 1 | (row[GS_MAX(GS_MIN(x + dx, (int)img.w - 1), 0)] < c);
+  }
+  return bits;
+}
+
+// Census transforms make matching costs Hamming distances, which do not depend on brightness or
+// gain differences between the cameras. 5x5 windows give 24 bits, 7x9 (wide x tall) give 62.
+GS_API void gs_census5x5(struct gs_image img, uint32_t *census) {
+  gs_assert(gs_valid(img) && census);
+  GS_TRACE_BEGIN("gs_census5x5", img.w * img.h);
+  gs_for(img, x, y) census[y * img.w + x] = (uint32_t)gs_census(img, x, y, 2, 2);
+  GS_TRACE_END("gs_census5x5");
+}
+
+GS_API void gs_census7x9(struct gs_image img, uint64_t *census) {
+  gs_assert(gs_valid(img) && census);
+  GS_TRACE_BEGIN("gs_census7x9", img.w * img.h);
+  gs_for(img, x, y) census[y * img.w + x] = gs_census(img, x, y, 3, 4);
+  GS_TRACE_END("gs_census7x9");
+}
+
+// Disparities are in 1/16 pixels
+enum { GS_DISP_SCALE = 16, GS_DISP_INVALID = -1 };
+
+// Bytes of work memory for gs_stereo_bm()
+GS_API unsigned gs_stereo_size(unsigned w, unsigned max_disp) {
+  return (2 * w * max_disp + w) * sizeof(uint16_t);
+}
+
+// Adds (sign 1) or subtracts (-1) the costs of row y to the column sums: for left x and d < nd
+// the Hamming distance to right x - d, or all bits where x - d is outside the image
+static inline void gs_stereo_costs(const void *left, const void *right, int wide, unsigned w,
+                                   unsigned nd, unsigned y, uint16_t *colsum, int sign) {
+  const uint32_t *l32 = (const uint32_t *)left + y * w, *r32 = (const uint32_t *)right + y * w;
+  const uint64_t *l64 = (const uint64_t *)left + y * w, *r64 = (const uint64_t *)right + y * w;
+  for (unsigned x = 0; x < w; x++) {
+    uint16_t *c = &colsum[x * nd];
+    unsigned d = 0;
+    if (wide) {
+      for (; d < nd && d <= x; d++)
+        c[d] += sign * (gs_popcount((uint32_t)(l64[x] ^ r64[x - d])) +
+                        gs_popcount((uint32_t)((l64[x] ^ r64[x - d]) >> 32)));
+    } else {
+#ifdef __wasm_simd128__
+      // 8 disparities at once, right pixels x - d - 7 .. x - d are in reverse order
+      for (v128_t l = wasm_i32x4_splat(l32[x]); d + 8 <= nd && d + 7 <= x; d += 8) {
+        v128_t a = wasm_i8x16_popcnt(wasm_v128_xor(l, wasm_v128_load(&r32[x - d - 3])));
+        v128_t b = wasm_i8x16_popcnt(wasm_v128_xor(l, wasm_v128_load(&r32[x - d - 7])));
+        a = wasm_u32x4_extadd_pairwise_u16x8(wasm_u16x8_extadd_pairwise_u8x16(a));
+        b = wasm_u32x4_extadd_pairwise_u16x8(wasm_u16x8_extadd_pairwise_u8x16(b));
+        v128_t v = wasm_u16x8_narrow_i32x4(wasm_i32x4_shuffle(a, a, 3, 2, 1, 0),
+                                           wasm_i32x4_shuffle(b, b, 3, 2, 1, 0));
+        v128_t s = wasm_v128_load(&c[d]);
+        wasm_v128_store(&c[d], sign > 0 ? wasm_i16x8_add(s, v) : wasm_i16x8_sub(s, v));
+      }
+#endif
+      for (; d < nd && d <= x; d++) c[d] += sign * gs_popcount(l32[x] ^ r32[x - d]);
+    }
+    for (; d < nd; d++) c[d] += sign * (wide ? 62 : 24);
+  }
+}
+
+static void gs_stereo(const void *left, const void *right, int wide, unsigned w, unsigned h,
+                      unsigned nd, unsigned radius, unsigned uniqueness, void *work,
+                      int16_t *disp) {
+  gs_assert(left && right && work && disp && w > 0 && h > 0 && nd > 0 && radius <= 15);
+  GS_TRACE_BEGIN("gs_stereo_bm", w * h * nd);
+  uint16_t *colsum = (uint16_t *)work, *agg = colsum + w * nd, *right_d = agg + w * nd;
+  int r = (int)radius;
+  for (unsigned i = 0; i < w * nd; i++) colsum[i] = 0;
+  for (int dy = -r; dy <= r; dy++)
+    gs_stereo_costs(left, right, wide, w, nd, GS_MAX(GS_MIN(dy, (int)h - 1), 0), colsum, 1);
+  for (unsigned y = 0; y < h; y++) {
+    if (y > 0) {  // slide the column sums down a row, rows outside the image are clamped
+      gs_stereo_costs(left, right, wide, w, nd, GS_MIN(y + r, h - 1), colsum, 1);
+      gs_stereo_costs(left, right, wide, w, nd, GS_MAX((int)y - r - 1, 0), colsum, -1);
+    }
+    // box sums: slide along the row, for all disparities at once
+    for (unsigned d = 0; d < nd; d++) agg[d] = 0;
+    for (int dx = -r; dx <= r; dx++) {
+      const uint16_t *in = &colsum[GS_MAX(GS_MIN(dx, (int)w - 1), 0) * nd];
+      for (unsigned d = 0; d < nd; d++) agg[d] += in[d];
+    }
+    for (unsigned x = 1; x < w; x++) {
+      uint16_t *a = &agg[x * nd];
+      const uint16_t *prev = a - nd, *in = &colsum[GS_MIN(x + r, w - 1) * nd],
+                     *out = &colsum[GS_MAX((int)x - r - 1, 0) * nd];
+      unsigned d = 0;
+#ifdef __wasm_simd128__
+      for (; d + 8 <= nd; d += 8) {
+        v128_t v = wasm_i16x8_add(wasm_v128_load(&prev[d]), wasm_v128_load(&in[d]));
+        wasm_v128_store(&a[d], wasm_i16x8_sub(v, wasm_v128_load(&out[d])));
+      }
+#endif
+      for (; d < nd; d++) a[d] = prev[d] + in[d] - out[d];
+    }
+    // best disparity of each right pixel xr, matched by left xr + d, for the consistency check
+    for (unsigned xr = 0; xr < w; xr++) {
+      unsigned best = 0xffff, bd = 0;
+      for (unsigned d = 0; d < nd && xr + d < w; d++)
+        if (agg[(xr + d) * nd + d] < best) best = agg[(xr + d) * nd + d], bd = d;
+      right_d[xr] = bd;
+    }
+    for (unsigned x = 0; x < w; x++) {
+      const uint16_t *a = &agg[x * nd];
+      unsigned n = GS_MIN(nd, x + 1), best = 0xffff, second = 0xffff, bd = 0;
+      for (unsigned d = 0; d < n; d++)
+        if (a[d] < best) best = a[d], bd = d;
+      for (unsigned d = 0; d < n; d++)
+        if ((d + 1 < bd || d > bd + 1) && a[d] < second) second = a[d];
+      int16_t v = GS_DISP_INVALID;
+      if (gs_absdiff(right_d[x - bd], bd) <= 1 &&
+          (second == 0xffff || second * 100 > best * (100 + uniqueness))) {
+        int off = 0;  // vertex of the parabola through the costs at bd - 1, bd and bd + 1
+        if (bd > 0 && bd + 1 < n) {
+          int c0 = a[bd - 1], c2 = a[bd + 1], denom = c0 + c2 - 2 * (int)best;
+          if (denom > 0) off = GS_MAX(GS_MIN(8 * (c0 - c2) / denom, 8), -8);
+        }
+        v = (int16_t)(bd * GS_DISP_SCALE + off);
+      }
+      disp[y * w + x] = v;
+    }
+  }
+  GS_TRACE_END("gs_stereo_bm");
+}
+
+// Block matching of rectified images from census transforms of both: the disparity d < max_disp,
+// where left x matches right x - d, with the lowest sum of Hamming costs over a box of
+// (2 * radius + 1)^2 pixels (radius up to 15). Box sums slide along columns and rows as in
+// gs_blur(), so the work per pixel and disparity does not grow with radius. disp holds w * h
+// disparities refined by a parabola through the neighbouring costs, or GS_DISP_INVALID where the
+// best match of the right pixel is more than a pixel off, or the cost is not uniqueness percent
+// below all others. work holds gs_stereo_size() bytes.
+GS_API void gs_stereo_bm(const uint32_t *left, const uint32_t *right, unsigned w, unsigned h,
+                         unsigned max_disp, unsigned radius, unsigned uniqueness, void *work,
+                         int16_t *disp) {
+  gs_stereo(left, right, 0, w, h, max_disp, radius, uniqueness, work, disp);
+}
+
+// Same with 7x9 census transforms
+GS_API void gs_stereo_bm64(const uint64_t *left, const uint64_t *right, unsigned w, unsigned h,
+                           unsigned max_disp, unsigned radius, unsigned uniqueness, void *work,
+                           int16_t *disp) {
+  gs_stereo(left, right, 1, w, h, max_disp, radius, uniqueness, work, disp);
+}
+
+#ifndef GS_NO_FLOAT
+//
+// Tracking
+//
+// In-place radix-2 FFT of n complex values (re, im) at a stride of s values, tw holds
+// e^(-2 pi i k / n) for k < n / 2. The inverse is not scaled by 1 / n.
+static void gs_fft(float *d, unsigned n, unsigned s, const float *tw, int inverse) {
+  for (unsigned i = 1, j = 0; i < n; i++) {  // bit reversed order
+    unsigned bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j |= bit;
+    if (i < j) {
+      float *a = &d[2 * i * s], *b = &d[2 * j * s], re = a[0], im = a[1];
+      a[0] = b[0], a[1] = b[1], b[0] = re, b[1] = im;
+    }
+  }
+  for (unsigned len = 2; len <= n; len <<= 1) {
+    unsigned half = len / 2, step = n / len;
+    for (unsigned i = 0; i < n; i += len) {
+      for (unsigned k = 0; k < half; k++) {
+        float wr = tw[2 * k * step], wi = inverse ? -tw[2 * k * step + 1] : tw[2 * k * step + 1];
+        float *a = &d[2 * (i + k) * s], *b = &d[2 * (i + k + half) * s];
+        float tr = b[0] * wr - b[1] * wi, ti = b[0] * wi + b[1] * wr;
+        b[0] = a[0] - tr, b[1] = a[1] - ti;
+        a[0] += tr, a[1] += ti;
+      }
+    }
+  }
+}
+
+// 2D FFT of n x n complex values, rows then columns
+static void gs_fft2(float *d, unsigned n, const float *tw, int inverse) {
+  for (unsigned y = 0; y < n; y++) gs_fft(&d[2 * y * n], n, 1, tw, inverse);
+  for (unsigned x = 0; x < n; x++) gs_fft(&d[2 * x], n, n, tw, inverse);
+}
+
+// Hann window of n values and the n / 2 twiddles of gs_fft()
+static void gs_fft_tables(unsigned n, float *win, float *tw) {
+  for (unsigned i = 0; i < n; i++) {
+    float s = gs_sin(3.141593f * (i + 0.5f) / n);
+    win[i] = s * s;
+  }
+  for (unsigned k = 0; k < n / 2; k++) {
+    float angle = 6.283185f * k / n;
+    tw[2 * k] = gs_sin(angle + 1.570796f), tw[2 * k + 1] = -gs_sin(angle);
+  }
+}
+
+// Offset of the vertex of the parabola through (-1, l), (0, c), (1, r) from 0, in [-0.5, 0.5]
+static inline float gs_peak_vertex(float l, float c, float r) {
+  float d = l - 2 * c + r;
+  return d < 0 ? GS_MAX(-0.5f, GS_MIN(0.5f, (l - r) / (2 * d))) : 0;
+}
+
+// Largest real part of n x n complex values, returns its index and sets its sub-pixel position
+// from parabolas through the neighbours, which wrap around
+static unsigned gs_fft_peak(const float *d, unsigned n, float *px, float *py) {
+  unsigned best = 0;
+  for (unsigned i = 1; i < n * n; i++)
+    if (d[2 * i] > d[2 * best]) best = i;
+  unsigned x = best % n, y = best / n;
+  const float *row = &d[2 * y * n], *up = &d[2 * ((y + n - 1) % n) * n];
+  const float *down = &d[2 * ((y + 1) % n) * n];
+  *px = x + gs_peak_vertex(row[2 * ((x + n - 1) % n)], row[2 * x], row[2 * ((x + 1) % n)]);
+  *py = y + gs_peak_vertex(up[2 * x], row[2 * x], down[2 * x]);
+  return best;
+}
+
+GS_API unsigned gs_mosse_size(const struct gs_mosse *t) {
+  return (7 * t->n * t->n + 2 * t->n + 256) * sizeof(float);
+}
+
+// Bilinear sample of log(1 + v) at (sx, sy), clamped to the image
+static inline float gs_mosse_sample(const struct gs_mosse *t, struct gs_image img, float sx,
+                                    float sy) {
+  sx = GS_MAX(0.0f, GS_MIN(sx, img.w - 1.0f)), sy = GS_MAX(0.0f, GS_MIN(sy, img.h - 1.0f));
+  unsigned x0 = (unsigned)sx, y0 = (unsigned)sy;
+  unsigned x1 = GS_MIN(x0 + 1, img.w - 1), y1 = GS_MIN(y0 + 1, img.h - 1);
+  float dx = sx - x0, dy = sy - y0, *lut = t->lut;
+  float top = lut[gs_get(img, x0, y0)] * (1 - dx) + lut[gs_get(img, x1, y0)] * dx;
+  float bot = lut[gs_get(img, x0, y1)] * (1 - dx) + lut[gs_get(img, x1, y1)] * dx;
+  return top * (1 - dy) + bot * dy;
+}
+
+// Samples the box centered at (cx, cy) into f as n x n complex values: log(1 + v) with zero mean
+// and unit norm, times the Hann window, then transforms it
+static void gs_mosse_patch(struct gs_mosse *t, struct gs_image img, float cx, float cy) {
+  unsigned n = t->n;
+  float sx = (float)t->box.w / n, sy = (float)t->box.h / n, sum = 0, sq = 0, *f = t->f;
+  for (unsigned y = 0; y < n; y++) {
+    float py = cy + (y + 0.5f - n / 2) * sy - 0.5f;  // 0.5f centers the pixel
+    for (unsigned x = 0; x < n; x++) {
+      float v = gs_mosse_sample(t, img, cx + (x + 0.5f - n / 2) * sx - 0.5f, py);
+      f[2 * (y * n + x)] = v, f[2 * (y * n + x) + 1] = 0, sum += v, sq += v * v;
+    }
+  }
+  float mean = sum / (n * n), norm = sq - sum * mean;
+  norm = norm > 1e-6f ? 1.0f / gs_sqrt(norm) : 0;
+  for (unsigned y = 0; y < n; y++)
+    for (unsigned x = 0; x < n; x++)
+      f[2 * (y * n + x)] = (f[2 * (y * n + x)] - mean) * norm * t->win[y] * t->win[x];
+  gs_fft2(f, n, t->tw, 0);
+}
+
+// A += rate * (G conj(F) - A), B += rate * (F conj(F) - B)
+static void gs_mosse_train(struct gs_mosse *t, float rate) {
+  float *a = t->a, *b = t->b, *f = t->f, *g = t->g;
+  for (unsigned i = 0; i < t->n * t->n; i++) {
+    float fr = f[2 * i], fi = f[2 * i + 1], gr = g[2 * i], gi = g[2 * i + 1];
+    a[2 * i] += rate * (gr * fr + gi * fi - a[2 * i]);
+    a[2 * i + 1] += rate * (gi * fr - gr * fi - a[2 * i + 1]);
+    b[i] += rate * (fr * fr + fi * fi - b[i]);
+  }
+}
+
+// Trains the filter on box in img, work holds gs_mosse_size() bytes aligned for float. The
+// desired response is a Gaussian with sigma n / 16 in the middle of the patch.
+GS_API void gs_mosse_init(struct gs_mosse *t, void *work, struct gs_image img,
+                          struct gs_rect box) {
+  gs_assert(t && work && gs_valid(img) && box.w > 0 && box.h > 0);
+  gs_assert(t->n >= 8 && (t->n & (t->n - 1)) == 0 && t->rate > 0 && t->rate <= 1);
+  unsigned n = t->n;
+  GS_TRACE_BEGIN("gs_mosse_init", n * n);
+  float *p = (float *)work;
+  t->a = p, p += 2 * n * n;
+  t->b = p, p += n * n;
+  t->g = p, p += 2 * n * n;
+  t->f = p, p += 2 * n * n;
+  t->win = p, p += n;
+  t->tw = p, p += n;
+  t->lut = p;
+  for (unsigned i = 0; i < 256; i++) t->lut[i] = gs_log(1.0f + i);
+  gs_fft_tables(n, t->win, t->tw);
+  float k = -128.0f / (n * n);  // -1 / (2 sigma^2)
+  for (unsigned y = 0; y < n; y++) {
+    for (unsigned x = 0; x < n; x++) {
+      float dx = (float)x - n / 2, dy = (float)y - n / 2;
+      t->g[2 * (y * n + x)] = gs_exp(k * (dx * dx + dy * dy)), t->g[2 * (y * n + x) + 1] = 0;
+    }
+  }
+  gs_fft2(t->g, n, t->tw, 0);
+  for (unsigned i = 0; i < 3 * n * n; i++) t->a[i] = 0;  // A and B
+  t->box = box, t->psr = 0;
+  t->cx = box.x + box.w / 2.0f, t->cy = box.y + box.h / 2.0f;
+  gs_mosse_patch(t, img, t->cx, t->cy);
+  gs_mosse_train(t, 1.0f);
+  GS_TRACE_END("gs_mosse_init");
+}
+
+// Correlates the filter with the patch at the last position, moves the box to the peak of the
+// response and trains on the patch there: three n x n FFTs. The peak to sidelobe ratio compares
+// the peak with the response outside of the 11 x 11 window around it. Returns 1, or 0 if it is
+// below min_psr, then the target is lost and neither box nor filter change.
+GS_API int gs_mosse_update(struct gs_mosse *t, struct gs_image img) {
+  gs_assert(t && t->f && gs_valid(img));
+  unsigned n = t->n, nn = n * n, count = 0;
+  float *f = t->f;
+  GS_TRACE_BEGIN("gs_mosse_update", nn);
+  gs_mosse_patch(t, img, t->cx, t->cy);
+  for (unsigned i = 0; i < nn; i++) {  // F A / B, the constant keeps weak frequencies down
+    float fr = f[2 * i], fi = f[2 * i + 1], ar = t->a[2 * i], ai = t->a[2 * i + 1];
+    float d = 1.0f / (t->b[i] + 0.01f);
+    f[2 * i] = (fr * ar - fi * ai) * d, f[2 * i + 1] = (fr * ai + fi * ar) * d;
+  }
+  gs_fft2(f, n, t->tw, 1);
+  float fx, fy;
+  unsigned best = gs_fft_peak(f, n, &fx, &fy), px = best % n, py = best / n;
+  float sum = 0, sq = 0;
+  for (unsigned y = 0; y < n; y++) {
+    unsigned dy = (y + n - py) % n;
+    for (unsigned x = 0; x < n; x++) {
+      unsigned dx = (x + n - px) % n;
+      if (GS_MIN(dy, n - dy) <= 5 && GS_MIN(dx, n - dx) <= 5) continue;  // wraps around
+      float v = f[2 * (y * n + x)];
+      sum += v, sq += v * v, count++;
+    }
+  }
+  float mean = sum / count, var = sq / count - mean * mean;
+  t->psr = var > 0 ? (f[2 * best] - mean) / gs_sqrt(var) : 0;
+  if (t->psr < t->min_psr) {
+    GS_TRACE_END("gs_mosse_update");
+    return 0;
+  }
+  t->cx = GS_MAX(0.0f, GS_MIN((float)img.w, t->cx + (fx - n / 2) * t->box.w / n));
+  t->cy = GS_MAX(0.0f, GS_MIN((float)img.h, t->cy + (fy - n / 2) * t->box.h / n));
+  float bx = t->cx - t->box.w / 2.0f + 0.5f, by = t->cy - t->box.h / 2.0f + 0.5f;
+  t->box.x = bx > 0 ? (unsigned)bx : 0, t->box.y = by > 0 ? (unsigned)by : 0;
+  gs_mosse_patch(t, img, t->cx, t->cy);
+  gs_mosse_train(t, t->rate);
+  GS_TRACE_END("gs_mosse_update");
+  return 1;
+}
+#endif
+
+//
+// Global motion
+//
+enum { GS_SHIFT_SCALE = 16 };  // shifts are in 1/16 pixels
+
+// Row and column sums of img in one pass, rows holds img.h and cols img.w values
+GS_API void gs_projections(struct gs_image img, uint32_t *rows, uint32_t *cols) {
+  gs_assert(gs_valid(img) && rows && cols);
+  GS_TRACE_BEGIN("gs_projections", img.w * img.h);
+  for (unsigned x = 0; x < img.w; x++) cols[x] = 0;
+  for (unsigned y = 0; y < img.h; y++) {
+    const uint8_t *p = &img.data[y * img.w];
+    uint32_t sum = 0;
+    unsigned x = 0;
+#ifdef __wasm_simd128__
+    v128_t acc = wasm_i32x4_splat(0);
+    for (; x + 16 <= img.w; x += 16) {
+      v128_t v = wasm_v128_load(p + x);
+      v128_t lo = wasm_u16x8_extend_low_u8x16(v), hi = wasm_u16x8_extend_high_u8x16(v);
+      wasm_v128_store(&cols[x], wasm_i32x4_add(wasm_v128_load(&cols[x]),
+                                               wasm_u32x4_extend_low_u16x8(lo)));
+      wasm_v128_store(&cols[x + 4], wasm_i32x4_add(wasm_v128_load(&cols[x + 4]),
+                                                   wasm_u32x4_extend_high_u16x8(lo)));
+      wasm_v128_store(&cols[x + 8], wasm_i32x4_add(wasm_v128_load(&cols[x + 8]),
+                                                   wasm_u32x4_extend_low_u16x8(hi)));
+      wasm_v128_store(&cols[x + 12], wasm_i32x4_add(wasm_v128_load(&cols[x + 12]),
+                                                    wasm_u32x4_extend_high_u16x8(hi)));
+      acc = wasm_i32x4_add(acc, wasm_u32x4_extadd_pairwise_u16x8(wasm_i16x8_add(lo, hi)));
+    }
+    sum = wasm_i32x4_extract_lane(acc, 0) + wasm_i32x4_extract_lane(acc, 1) +
+          wasm_i32x4_extract_lane(acc, 2) + wasm_i32x4_extract_lane(acc, 3);
+#endif
+    for (; x < img.w; x++) sum += p[x], cols[x] += p[x];
+    rows[y] = sum;
+  }
+  GS_TRACE_END("gs_projections");
+}
+
+// Mean absolute difference in 1/256 of the zero-mean profiles where b shifted by s overlaps a
+static uint64_t gs_profile_cost(const uint32_t *a, const uint32_t *b, unsigned n, int s,
+                                int64_t ma, int64_t mb) {
+  unsigned i0 = s < 0 ? (unsigned)-s : 0, i1 = s > 0 ? n - s : n;
+  uint64_t sum = 0;
+  for (unsigned i = i0; i < i1; i++) {
+    int64_t d = (int64_t)a[i] - ma - ((int64_t)b[i + s] - mb);
+    sum += (uint64_t)(d < 0 ? -d : d);
+  }
+  return sum * 256 / (i1 - i0);
+}
+
+// Shift of profile b against a in 1/GS_SHIFT_SCALE pixels, b[i + shift] matches a[i]. The mean
+// brightness of each profile is removed, shifts up to max_shift (at most n / 2) are compared by
+// their mean absolute difference and the best one is refined by a parabola. Rows of
+// gs_projections() give the vertical motion between two frames, columns the horizontal one.
+GS_API int gs_projection_shift(const uint32_t *a, const uint32_t *b, unsigned n,
+                               unsigned max_shift) {
+  gs_assert(a && b && n > 1 && max_shift <= n / 2);
+  int64_t ma = 0, mb = 0;
+  for (unsigned i = 0; i < n; i++) ma += a[i], mb += b[i];
+  ma /= n, mb /= n;
+  int best = 0, m = (int)max_shift;
+  uint64_t best_cost = gs_profile_cost(a, b, n, 0, ma, mb);
+  for (int s = -m; s <= m; s++) {
+    uint64_t c = gs_profile_cost(a, b, n, s, ma, mb);
+    if (c < best_cost) best = s, best_cost = c;
+  }
+  int shift = best * GS_SHIFT_SCALE;
+  if (best > -m && best < m) {
+    int64_t l = (int64_t)gs_profile_cost(a, b, n, best - 1, ma, mb);
+    int64_t r = (int64_t)gs_profile_cost(a, b, n, best + 1, ma, mb);
+    int64_t d = l - 2 * (int64_t)best_cost + r;
+    if (d > 0) shift += (int)GS_MAX(-8, GS_MIN(8, (l - r) * GS_SHIFT_SCALE / (2 * d)));
+  }
+  return shift;
+}
+
+#ifndef GS_NO_FLOAT
+GS_API unsigned gs_phase_size(unsigned n) { return (4 * n * n + 2 * n) * sizeof(float); }
+
+// Means of img over an n x n grid of cells, zero mean and times the Hann window, as complex values
+static void gs_phase_sample(struct gs_image img, unsigned n, const float *win, float *d) {
+  float total = 0;
+  for (unsigned y = 0; y < n; y++) {
+    unsigned y0 = y * img.h / n, y1 = (y + 1) * img.h / n;
+    for (unsigned x = 0; x < n; x++) {
+      unsigned x0 = x * img.w / n, x1 = (x + 1) * img.w / n, sum = 0;
+      for (unsigned v = y0; v < y1; v++)
+        for (unsigned u = x0; u < x1; u++) sum += img.data[v * img.w + u];
+      float mean = (float)sum / ((x1 - x0) * (y1 - y0));
+      d[2 * (y * n + x)] = mean, d[2 * (y * n + x) + 1] = 0, total += mean;
+    }
+  }
+  total /= n * n;
+  for (unsigned y = 0; y < n; y++)
+    for (unsigned x = 0; x < n; x++)
+      d[2 * (y * n + x)] = (d[2 * (y * n + x)] - total) * win[y] * win[x];
+}
+
+// A shifted impulse spreads over the peak c and its larger neighbour as a sinc, the sub-pixel
+// offset towards the neighbour is v / (v + c) (Foroosh et al.)
+static inline float gs_phase_offset(float c, float l, float r) {
+  if (l > r) return l > 0 ? -l / (l + c) : 0;
+  return r > 0 ? r / (r + c) : 0;
+}
+
+// Translation of b against a by phase correlation, b(x, y) matches a(x - dx, y - dy). Both are
+// reduced to n x n cell means (n a power of 2 up to the image size), the normalized cross power
+// spectrum has one peak at the shift, up to n / 2 cells. Returns the peak height in (0, 1] as
+// confidence, work holds gs_phase_size() bytes aligned for float.
+GS_API float gs_phase_correlate(struct gs_image a, struct gs_image b, unsigned n, void *work,
+                                float *dx, float *dy) {
+  gs_assert(gs_valid(a) && gs_valid(b) && a.w == b.w && a.h == b.h && work && dx && dy);
+  gs_assert(n >= 8 && (n & (n - 1)) == 0 && n <= a.w && n <= a.h);
+  GS_TRACE_BEGIN("gs_phase_correlate", a.w * a.h);
+  unsigned nn = n * n;
+  float *fa = (float *)work, *fb = fa + 2 * nn, *win = fb + 2 * nn, *tw = win + n;
+  gs_fft_tables(n, win, tw);
+  gs_phase_sample(a, n, win, fa);
+  gs_phase_sample(b, n, win, fb);
+  gs_fft2(fa, n, tw, 0);
+  gs_fft2(fb, n, tw, 0);
+  for (unsigned i = 0; i < nn; i++) {  // B conj(A) / |B conj(A)|
+    float ar = fa[2 * i], ai = fa[2 * i + 1], br = fb[2 * i], bi = fb[2 * i + 1];
+    float re = br * ar + bi * ai, im = bi * ar - br * ai, m = gs_sqrt(re * re + im * im);
+    m = m > 1e-9f ? 1.0f / m : 0;
+    fa[2 * i] = re * m, fa[2 * i + 1] = im * m;
+  }
+  gs_fft2(fa, n, tw, 1);
+  float px, py;
+  unsigned best = gs_fft_peak(fa, n, &px, &py), x = best % n, y = best / n;
+  px = x + gs_phase_offset(fa[2 * best], fa[2 * (y * n + (x + n - 1) % n)],
+                           fa[2 * (y * n + (x + 1) % n)]);
+  py = y + gs_phase_offset(fa[2 * best], fa[2 * ((y + n - 1) % n * n + x)],
+                           fa[2 * ((y + 1) % n * n + x)]);
+  if (px >= n / 2) px -= n;
+  if (py >= n / 2) py -= n;
+  *dx = px * a.w / n, *dy = py * a.h / n;
+  GS_TRACE_END("gs_phase_correlate");
+  return fa[2 * best] / nn;
+}
+#endif
+
+//
+// Document skew
+//
+GS_API unsigned gs_skew_size(unsigned w, unsigned h) {
+  return (h + w + 8) * sizeof(uint32_t) + (w + 7) / 8 * h;
+}
+
+// Q16 tangent of an angle in hundredths of a degree
+static int32_t gs_skew_tan(int a) {
+  gs_real r = gs_real_from_q16((int32_t)((int64_t)a * 205887 / 18000));  // pi in Q16
+  int64_t s = gs_real_to_q16(gs_sin(r)), c = gs_real_to_q16(gs_sin(r + GS_REAL(1.570796f)));
+  return (int32_t)(s * 65536 / c);
+}
+
+// Sum of squared ink counts of the rows after a shear by tangent t: pixel (x, y) goes to row
+// y - x * t, so text lines along that slope fall into few rows. Strips of 8 columns move by the
+// integer offset of their middle column.
+static uint64_t gs_skew_score(const uint8_t *counts, unsigned w, unsigned h, int a,
+                              uint32_t *bins) {
+  unsigned nb = (w + 7) / 8;
+  int32_t t = gs_skew_tan(a);
+  int off0 = (int)((4 * (int64_t)t + 32768) >> 16);
+  int off1 = (int)(((int64_t)(8 * nb - 4) * t + 32768) >> 16);
+  int lo = GS_MIN(off0, off1), hi = GS_MAX(off0, off1);
+  unsigned nbins = h + (unsigned)(hi - lo);
+  for (unsigned i = 0; i < nbins; i++) bins[i] = 0;
+  for (unsigned b = 0; b < nb; b++) {
+    int off = (int)(((int64_t)(8 * b + 4) * t + 32768) >> 16);
+    uint32_t *dst = &bins[hi - off];
+    const uint8_t *col = &counts[b * h];
+    for (unsigned y = 0; y < h; y++) dst[y] += col[y];
+  }
+  uint64_t score = 0;
+  for (unsigned i = 0; i < nbins; i++) score += (uint64_t)bins[i] * bins[i];
+  return score;
+}
+
+// Skew of text lines in a binary image (ink < 128), e.g. a downsampled and thresholded page, in
+// gs_real radians within max_deg (up to 30) degrees, positive when lines fall to the right, so
+// gs_rotate() by the negative angle straightens the page. The sharpest row projection is
+// searched in steps of 0.5 degrees, then 0.1 degrees, and refined by a parabola. work holds
+// gs_skew_size() bytes aligned for uint32_t. Returns 0 for images without ink.
+GS_API gs_real gs_skew(struct gs_image bin, unsigned max_deg, void *work) {
+  gs_assert(gs_valid(bin) && work && max_deg <= 30);
+  GS_TRACE_BEGIN("gs_skew", bin.w * bin.h);
+  unsigned w = bin.w, h = bin.h, nb = (w + 7) / 8;
+  uint32_t *bins = (uint32_t *)work;
+  uint8_t *counts = (uint8_t *)(bins + h + w + 8);
+  for (unsigned i = 0; i < nb * h; i++) counts[i] = 0;
+  gs_for(bin, x, y) counts[x / 8 * h + y] += bin.data[y * w + x] < 128;
+  int m = (int)max_deg * 100, best = 0;
+  uint64_t best_score = gs_skew_score(counts, w, h, 0, bins);
+  for (int a = -m; a <= m; a += 50) {
+    uint64_t score = gs_skew_score(counts, w, h, a, bins);
+    if (score > best_score) best = a, best_score = score;
+  }
+  for (int a = GS_MAX(-m, best - 40), end = GS_MIN(m, best + 40); a <= end; a += 10) {
+    uint64_t score = gs_skew_score(counts, w, h, a, bins);
+    if (score > best_score) best = a, best_score = score;
+  }
+  int skew = best * 16;  // in 1/1600 degrees
+  if (best > -m && best < m) {
+    int64_t l = (int64_t)gs_skew_score(counts, w, h, best - 10, bins), c = (int64_t)best_score;
+    int64_t r = (int64_t)gs_skew_score(counts, w, h, best + 10, bins), d = l - 2 * c + r;
+    if (d < 0) skew += (int)GS_MAX(-80, GS_MIN(80, (l - r) * 160 / (2 * d)));
+  }
+  GS_TRACE_END("gs_skew");
+  return gs_real_from_q16((int32_t)((int64_t)skew * 205887 / 288000));
+}
+
+//
+// Thinning
+//
+enum { GS_ZHANG_SUEN, GS_GUO_HALL };
+
+// Adds bit planes v[0..n) into the 4-bit counts c, bit-sliced: c[k] holds bit k of every lane
+static inline void gs_bit_count(const uint32_t *v, unsigned n, uint32_t c[4]) {
+  c[0] = c[1] = c[2] = c[3] = 0;
+  for (unsigned i = 0; i < n; i++) {
+    uint32_t carry = v[i];
+    for (unsigned k = 0; k < 4 && carry; k++) {
+      uint32_t t = c[k] & carry;
+      c[k] ^= carry, carry = t;
+    }
+  }
+}
+
+// Lanes where the bit-sliced count c equals k
+static inline uint32_t gs_bit_eq(const uint32_t c[4], unsigned k) {
+  uint32_t m = ~0u;
+  for (unsigned i = 0; i < 4; i++) m &= (k >> i & 1) ? c[i] : ~c[i];
+  return m;
+}
+
+// Lanes deleted by one sub-iteration of Zhang-Suen or Guo-Hall, given the neighbour planes
+// p[0..8) = P2..P9 (N, NE, E, SE, S, SW, W, NW) of foreground pixels
+static uint32_t gs_thin_mask(const uint32_t p[8], int method, int sub) {
+  uint32_t t[8], c[4], m, n1[4], n2[4];
+  enum { P2, P3, P4, P5, P6, P7, P8, P9 };
+  if (method == GS_ZHANG_SUEN) {
+    // 2 <= B <= 6 neighbours, A = 1 background to foreground transition around the ring
+    gs_bit_count(p, 8, c);
+    m = (c[1] | c[2]) & ~c[3] & ~(c[2] & c[1] & c[0]);
+    for (unsigned i = 0; i < 8; i++) t[i] = ~p[i] & p[(i + 1) % 8];
+    gs_bit_count(t, 8, c);
+    m &= gs_bit_eq(c, 1);
+    if (sub == 0) return m & ~(p[P2] & p[P4] & p[P6]) & ~(p[P4] & p[P6] & p[P8]);
+    return m & ~(p[P2] & p[P4] & p[P8]) & ~(p[P2] & p[P6] & p[P8]);
+  }
+  // C = 1 connected background run, 2 <= min(N1, N2) <= 3 neighbour pairs
+  for (unsigned i = 0; i < 4; i++) t[i] = ~p[2 * i] & (p[2 * i + 1] | p[(2 * i + 2) % 8]);
+  gs_bit_count(t, 4, c);
+  m = gs_bit_eq(c, 1);
+  for (unsigned i = 0; i < 4; i++) t[i] = p[(2 * i + 7) % 8] | p[2 * i];
+  for (unsigned i = 0; i < 4; i++) t[4 + i] = p[2 * i] | p[2 * i + 1];
+  gs_bit_count(t, 4, n1);
+  gs_bit_count(t + 4, 4, n2);
+  uint32_t lo1 = gs_bit_eq(n1, 2) | gs_bit_eq(n1, 3), lo2 = gs_bit_eq(n2, 2) | gs_bit_eq(n2, 3);
+  m &= ((n1[1] | n1[2]) & (n2[1] | n2[2])) & (lo1 | lo2);
+  if (sub == 0) return m & ~((p[P6] | p[P7] | ~p[P9]) & p[P8]);
+  return m & ~((p[P2] | p[P3] | ~p[P5]) & p[P4]);
+}
+
+// 3x3 neighbourhood of (x, y) as bits P2..P9, outside of the image is background
+static inline unsigned gs_thin_code(struct gs_image img, unsigned x, unsigned y) {
+  static const int8_t dx[8] = {0, 1, 1, 1, 0, -1, -1, -1}, dy[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+  unsigned code = 0;
+  for (unsigned k = 0; k < 8; k++) {
+    unsigned nx = x + dx[k], ny = y + dy[k];
+    if (nx < img.w && ny < img.h && img.data[ny * img.w + nx] >= 128) code |= 1u << k;
+  }
+  return code;
+}
+
+// Thins foreground (>= 128) strokes of img in place to 8-connected skeletons of 0 and 255 by
+// GS_ZHANG_SUEN or GS_GUO_HALL. Each sub-iteration looks up the 3x3 neighbourhood of the
+// candidate pixels in a 256-entry deletion table and removes the marked ones at once, then only
+// the neighbours of removed pixels become candidates again, so the work follows the strokes.
+// list holds max pixel indices, at least the number of foreground pixels. Returns the number of
+// removed pixels, or -1 if list is too small, img is binarised then.
+GS_API int gs_thin(struct gs_image img, int method, uint32_t *list, unsigned max) {
+  gs_assert(gs_valid(img) && list && (method == GS_ZHANG_SUEN || method == GS_GUO_HALL));
+  GS_TRACE_BEGIN("gs_thin", img.w * img.h);
+  uint8_t lut[2][256];
+  for (int sub = 0; sub < 2; sub++) {
+    for (unsigned code = 0; code < 256; code++) {
+      uint32_t p[8];
+      for (unsigned k = 0; k < 8; k++) p[k] = code >> k & 1;
+      lut[sub][code] = gs_thin_mask(p, method, sub) & 1;
+    }
+  }
+  unsigned fg = 0, n = 0;
+  for (unsigned i = 0; i < img.w * img.h; i++) {
+    img.data[i] = img.data[i] >= 128 ? 255 : 0;
+    fg += img.data[i] != 0;
+  }
+  if (fg > max) {
+    GS_TRACE_END("gs_thin");
+    return -1;
+  }
+  // Candidates are 254, or 253 once they survived a sub-iteration. Surviving both sub-iterations
+  // without a change around them they leave the list (251), 252 marks pixels to be added.
+  gs_for(img, x, y) {
+    if (img.data[y * img.w + x] && gs_thin_code(img, x, y) != 255) list[n++] = y * img.w + x;
+  }
+  for (unsigned i = 0; i < n; i++) img.data[list[i]] = 254;
+  int removed = 0;
+  for (int sub = 0; n > 0; sub ^= 1) {
+    // deletable candidates of the unchanged image go to the end of the list
+    unsigned end = n;
+    for (unsigned i = 0; i < end;) {
+      uint32_t idx = list[i];
+      if (lut[sub][gs_thin_code(img, idx % img.w, idx / img.w)]) {
+        list[i] = list[--end], list[end] = idx;
+      } else {
+        i++;
+      }
+    }
+    // and then to the end of the buffer, the candidates never grow past them
+    unsigned nd = n - end;
+    for (unsigned i = 0; i < nd; i++) list[max - 1 - i] = list[n - 1 - i];
+    const uint32_t *del = &list[max - nd];
+    for (unsigned i = 0; i < nd; i++) img.data[del[i]] = 0;
+    removed += (int)nd;
+    for (unsigned i = 0; i < end; i++) img.data[list[i]] = img.data[list[i]] == 254 ? 253 : 251;
+    for (unsigned i = 0; i < nd; i++) {
+      unsigned x = del[i] % img.w, y = del[i] / img.w;
+      for (unsigned ny = y ? y - 1 : 0; ny <= y + 1 && ny < img.h; ny++) {
+        for (unsigned nx = x ? x - 1 : 0; nx <= x + 1 && nx < img.w; nx++) {
+          uint8_t *v = &img.data[ny * img.w + nx];
+          if (*v && *v != 252) *v = *v == 255 ? 252 : 254;
+        }
+      }
+    }
+    n = 0;
+    for (unsigned i = 0; i < end; i++) {
+      if (img.data[list[i]] == 251) {
+        img.data[list[i]] = 255;
+      } else {
+        list[n++] = list[i];
+      }
+    }
+    for (unsigned i = 0; i < nd; i++) {
+      unsigned x = del[i] % img.w, y = del[i] / img.w;
+      for (unsigned ny = y ? y - 1 : 0; ny <= y + 1 && ny < img.h; ny++) {
+        for (unsigned nx = x ? x - 1 : 0; nx <= x + 1 && nx < img.w; nx++) {
+          if (img.data[ny * img.w + nx] == 252) {
+            img.data[ny * img.w + nx] = 254;
+            list[n++] = ny * img.w + nx;
+          }
+        }
+      }
+    }
+  }
+  GS_TRACE_END("gs_thin");
+  return removed;
+}
+
+// 32 pixels of a packed row from bit 32 * i on, MSB first, 0 outside of the row
+static inline uint32_t gs_bits_word(const uint8_t *row, unsigned stride, int i) {
+  uint32_t v = 0;
+  if (!row || i < 0) return 0;
+  for (unsigned k = 4 * (unsigned)i; k < 4 * (unsigned)i + 4; k++) {
+    v = v << 8 | (k < stride ? row[k] : 0);
+  }
+  return v;
+}
+
+// Same skeleton as gs_thin() on a packed image (see gs_bin_light(), padding bits 0), without a
+// list: every sub-iteration evaluates the deletion rule as bitwise logic on 32 pixels at once,
+// skipping empty words. work holds two packed rows, (w + 7) / 8 * 2 bytes. Returns the number
+// of removed pixels.
+GS_API unsigned gs_thin_packed(struct gs_image bits, int method, uint8_t *work) {
+  gs_assert(gs_valid(bits) && work && (method == GS_ZHANG_SUEN || method == GS_GUO_HALL));
+  GS_TRACE_BEGIN("gs_thin_packed", bits.w * bits.h);
+  unsigned stride = (bits.w + 7) / 8, nw = (stride + 3) / 4, removed = 0, changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int sub = 0; sub < 2; sub++) {
+      // the rows above and at y before this sub-iteration changed them
+      uint8_t *prev = work, *cur = work + stride;
+      for (unsigned y = 0; y < bits.h; y++) {
+        uint8_t *row = &bits.data[y * stride];
+        const uint8_t *up = y ? prev : 0, *down = y + 1 < bits.h ? row + stride : 0;
+        for (unsigned i = 0; i < stride; i++) cur[i] = row[i];
+        for (int i = 0; i < (int)nw; i++) {
+          uint32_t c = gs_bits_word(cur, stride, i);
+          if (!c) continue;
+          uint32_t u = gs_bits_word(up, stride, i), d = gs_bits_word(down, stride, i);
+          uint32_t ul = gs_bits_word(up, stride, i - 1), ur = gs_bits_word(up, stride, i + 1);
+          uint32_t cl = gs_bits_word(cur, stride, i - 1), cr = gs_bits_word(cur, stride, i + 1);
+          uint32_t dl = gs_bits_word(down, stride, i - 1), dr = gs_bits_word(down, stride, i + 1);
+          // west neighbours are one bit up, east ones one bit down
+          uint32_t p[8] = {u,
+                           u << 1 | ur >> 31,
+                           c << 1 | cr >> 31,
+                           d << 1 | dr >> 31,
+                           d,
+                           d >> 1 | dl << 31,
+                           c >> 1 | cl << 31,
+                           u >> 1 | ul << 31};
+          uint32_t del = c & gs_thin_mask(p, method, sub);
+          if (!del) continue;
+          c &= ~del;
+          removed += gs_popcount(del), changed = 1;
+          for (unsigned k = 0; k < 4 && 4 * (unsigned)i + k < stride; k++) {
+            row[4 * i + k] = (uint8_t)(c >> (24 - 8 * k));
+          }
+        }
+        uint8_t *t = prev;
+        prev = cur, cur = t;
+      }
+    }
+  }
+  GS_TRACE_END("gs_thin_packed");
+  return removed;
+}
+
+//
+// Flood fill
+//
+struct gs_span {
+  uint16_t x0, x1, y;  // pixels [x0, x1] of row y to scan
+  int16_t dy;          // away from the row that pushed it
+};
+
+// Pushes the part of [x0, x1] within the image, returns 0 if the stack is full
+static inline int gs_span_push(struct gs_span *stack, unsigned *n, unsigned max_spans,
+                               struct gs_image img, int x0, int x1, int y, int dy) {
+  x0 = GS_MAX(x0, 0), x1 = GS_MIN(x1, (int)img.w - 1);
+  if (x0 > x1 || y < 0 || y >= (int)img.h) return 1;
+  if (*n == max_spans) return 0;
+  stack[(*n)++] = (struct gs_span){(uint16_t)x0, (uint16_t)x1, (uint16_t)y, (int16_t)dy};
+  return 1;
+}
+
+// Fills the region of pixels within tolerance of the seed pixel (x, y) that is 4-connected, or
+// 8-connected if eight is set, with value. Filled runs push spans of the rows above and below to
+// scan, so the stack grows with the number of runs, not pixels. value must lie outside of the
+// tolerance range of the seed, else nothing is filled. Returns the number of filled pixels, or
+// -1 if max_spans were not enough and the region is partly filled.
+GS_API int gs_flood_fill(struct gs_image img, unsigned x, unsigned y, uint8_t value,
+                         uint8_t tolerance, int eight, struct gs_span *stack, unsigned max_spans) {
+  gs_assert(gs_valid(img) && stack && x < img.w && y < img.h);
+  gs_assert(img.w <= 65536 && img.h <= 65536);
+  int seed = img.data[y * img.w + x], lo = seed - tolerance, hi = seed + tolerance;
+  if (value >= lo && value <= hi) return 0;
+  GS_TRACE_BEGIN("gs_flood_fill", img.w * img.h);
+  int e = eight ? 1 : 0, filled = 0;
+  unsigned n = 0;
+  int ok = gs_span_push(stack, &n, max_spans, img, (int)x, (int)x, (int)y, 1) &&
+       gs_span_push(stack, &n, max_spans, img, (int)x - e, (int)x + e, (int)y - 1, -1);
+  while (n > 0 && ok) {
+    struct gs_span s = stack[--n];
+    int x0 = s.x0, x1 = s.x1, dy = s.dy, y0 = s.y;
+    const uint8_t *row = &img.data[s.y * img.w];
+    for (int sx = x0; sx <= x1 && ok; sx++) {
+      if (row[sx] < lo || row[sx] > hi) continue;
+      // the run through sx, then the row ahead and the parts of the row behind past the parent
+      int l = sx, r = sx;
+      while (l > 0 && row[l - 1] >= lo && row[l - 1] <= hi) l--;
+      while (r + 1 < (int)img.w && row[r + 1] >= lo && row[r + 1] <= hi) r++;
+      for (int i = l; i <= r; i++) img.data[s.y * img.w + i] = value;
+      filled += r - l + 1;
+      ok = gs_span_push(stack, &n, max_spans, img, l - e, r + e, y0 + dy, dy);
+      if (ok && l < x0 + e) {
+        ok = gs_span_push(stack, &n, max_spans, img, l - e, x0 + e - 1, y0 - dy, -dy);
+      }
+      if (ok && r > x1 - e) {
+        ok = gs_span_push(stack, &n, max_spans, img, x1 - e + 1, r + e, y0 - dy, -dy);
+      }
+      sx = r + 1;
+    }
+  }
+  GS_TRACE_END("gs_flood_fill");
+  return ok ? filled : -1;
+}
+
+// Fills holes of a binary image (light >= 128) in place: dark pixels that are not 4-connected to
+// the border become 255, all others 0 or 255. Dark regions are filled from the border with a
+// marker first, whatever stays dark is a hole. Returns the number of filled pixels, or -1 if
+// max_spans were not enough, the image is only binarised then.
+GS_API int gs_fill_holes(struct gs_image img, struct gs_span *stack, unsigned max_spans) {
+  gs_assert(gs_valid(img) && stack);
+  GS_TRACE_BEGIN("gs_fill_holes", img.w * img.h);
+  for (unsigned i = 0; i < img.w * img.h; i++) img.data[i] = img.data[i] >= 128 ? 255 : 0;
+  int ok = 1, holes = 0;
+  // top and bottom rows, then left and right columns
+  for (unsigned i = 0; i < 2 * (img.w + img.h) && ok; i++) {
+    unsigned x = i < 2 * img.w ? i / 2 : (i & 1) * (img.w - 1);
+    unsigned y = i < 2 * img.w ? (i & 1) * (img.h - 1) : (i - 2 * img.w) / 2;
+    if (!img.data[y * img.w + x]) ok = gs_flood_fill(img, x, y, 1, 0, 0, stack, max_spans) >= 0;
+  }
+  for (unsigned i = 0; i < img.w * img.h; i++) {
+    holes += img.data[i] == 0;
+    img.data[i] = img.data[i] == 1 ? 0 : ok ? 255 : img.data[i];
+  }
+  GS_TRACE_END("gs_fill_holes");
+  return ok ? holes : -1;
+}
+
+//
+// Harris and Shi-Tomasi corners
+//
+enum { GS_HARRIS, GS_SHI_TOMASI };
+
+GS_API unsigned gs_corners_size(unsigned w) { return 6 * w * sizeof(int32_t); }
+
+static inline uint64_t gs_isqrt64(uint64_t n) {
+  uint64_t r = 0;
+  for (uint64_t bit = (uint64_t)1 << 62; bit; bit >>= 2) {
+    if (n >= r + bit)
+      n -= r + bit, r = (r >> 1) + bit;
+    else
+      r >>= 1;
+  }
+  return r;
+}
+
+// Gradient products gx * gx, gy * gy and gx * gy of row y from int16 Sobel gradients, 0 at the
+// left and right border
+static void gs_corner_row(struct gs_image img, unsigned y, int32_t *xx, int32_t *yy, int32_t *xy) {
+  const uint8_t *r0 = &img.data[(y - 1) * img.w], *r1 = r0 + img.w, *r2 = r1 + img.w;
+  xx[0] = yy[0] = xy[0] = xx[img.w - 1] = yy[img.w - 1] = xy[img.w - 1] = 0;
+  for (unsigned x = 1; x + 1 < img.w; x++) {
+    int16_t gx = (int16_t)(r0[x + 1] - r0[x - 1] + 2 * (r1[x + 1] - r1[x - 1]) + r2[x + 1] -
+                           r2[x - 1]);
+    int16_t gy = (int16_t)(r2[x - 1] - r0[x - 1] + 2 * (r2[x] - r0[x]) + r2[x + 1] - r0[x + 1]);
+    xx[x] = gx * gx, yy[x] = gy * gy, xy[x] = gx * gy;
+  }
+}
+
+// Corner response of every pixel from the sums of the gradient products over a window of
+// (2 * radius + 1)^2 pixels, up to 15. Column sums move down by a row and window sums along the
+// row by a column, so the cost does not depend on the radius. GS_HARRIS is det - trace^2 / 25 of
+// the mean products / 256, GS_SHI_TOMASI their smaller eigenvalue, both clamped to 0. Pixels
+// closer than radius + 1 to the border get 0. work holds gs_corners_size() bytes.
+GS_API void gs_corners(struct gs_image img, unsigned radius, int method, void *work,
+                       uint32_t *resp) {
+  gs_assert(gs_valid(img) && work && resp && radius <= 15);
+  gs_assert(method == GS_HARRIS || method == GS_SHI_TOMASI);
+  GS_TRACE_BEGIN("gs_corners", img.w * img.h);
+  unsigned w = img.w, h = img.h, r = radius, d = 2 * r + 1;
+  int64_t area = (int64_t)d * d;
+  int32_t *cxx = (int32_t *)work, *cyy = cxx + w, *cxy = cyy + w;
+  int32_t *pxx = cxy + w, *pyy = pxx + w, *pxy = pyy + w;
+  for (unsigned i = 0; i < w * h; i++) resp[i] = 0;
+  if (w < d + 2 || h < d + 2) {
+    GS_TRACE_END("gs_corners");
+    return;
+  }
+  for (unsigned x = 0; x < w; x++) cxx[x] = cyy[x] = cxy[x] = 0;
+  for (unsigned y = 1; y < d; y++) {
+    gs_corner_row(img, y, pxx, pyy, pxy);
+    for (unsigned x = 0; x < w; x++) cxx[x] += pxx[x], cyy[x] += pyy[x], cxy[x] += pxy[x];
+  }
+  for (unsigned y = r + 1; y + r + 1 < h; y++) {
+    // column sums of rows y - r .. y + r
+    gs_corner_row(img, y + r, pxx, pyy, pxy);
+    for (unsigned x = 0; x < w; x++) cxx[x] += pxx[x], cyy[x] += pyy[x], cxy[x] += pxy[x];
+    int32_t sxx = 0, syy = 0, sxy = 0;
+    for (unsigned x = 1; x < d; x++) sxx += cxx[x], syy += cyy[x], sxy += cxy[x];
+    for (unsigned x = r + 1; x + r + 1 < w; x++) {
+      sxx += cxx[x + r], syy += cyy[x + r], sxy += cxy[x + r];
+      int64_t a = sxx, b = sxy, c = syy, v;
+      if (method == GS_HARRIS) {
+        v = ((a * c - b * b - (a + c) * (a + c) / 25) / area / area) >> 8;
+      } else {
+        uint64_t disc = (uint64_t)((a - c) * (a - c)) + (uint64_t)(4 * b * b);
+        v = (a + c - (int64_t)gs_isqrt64(disc)) / (2 * area);
+      }
+      resp[y * w + x] = (uint32_t)GS_MAX(0, GS_MIN(v, (int64_t)0xffffffff));
+      sxx -= cxx[x - r], syy -= cyy[x - r], sxy -= cxy[x - r];
+    }
+    gs_corner_row(img, y - r, pxx, pyy, pxy);
+    for (unsigned x = 0; x < w; x++) cxx[x] -= pxx[x], cyy[x] -= pyy[x], cxy[x] -= pxy[x];
+  }
+  GS_TRACE_END("gs_corners");
+}
+
+// Grid cells of min_dist * 0.7 pixels hold at most one feature
+static inline unsigned gs_features_cell(unsigned min_dist) { return GS_MAX(min_dist * 7 / 10, 1); }
+
+GS_API unsigned gs_features_size(unsigned w, unsigned h, unsigned min_dist) {
+  unsigned cell = gs_features_cell(min_dist);
+  return (w + 1) / 2 * ((h + 1) / 2) * sizeof(uint64_t) +
+         ((w + cell - 1) / cell) * ((h + cell - 1) / cell) * sizeof(uint32_t);
+}
+
+// Moves a[i] down a heap of n values with the smallest on top
+static inline void gs_sift64(uint64_t *a, unsigned i, unsigned n) {
+  for (unsigned c; (c = 2 * i + 1) < n; i = c) {
+    if (c + 1 < n && a[c + 1] < a[c]) c++;
+    if (a[i] <= a[c]) break;
+    uint64_t t = a[i];
+    a[i] = a[c], a[c] = t;
+  }
+}
+
+// Heap sort, largest first
+static void gs_sort_desc64(uint64_t *a, unsigned n) {
+  for (unsigned i = n / 2; i-- > 0;) gs_sift64(a, i, n);
+  for (unsigned end = n; end-- > 1;) {
+    uint64_t t = a[0];
+    a[0] = a[end], a[end] = t;
+    gs_sift64(a, 0, end);
+  }
+}
+
+// Strongest local maxima of a response map of at least quality / 1000 of the largest response,
+// no closer than min_dist pixels to a stronger one. Accepted features are marked in a coarse
+// grid, so each candidate checks a few cells instead of all features. work holds
+// gs_features_size() bytes aligned for uint64_t. Returns the number of features, strongest first.
+GS_API unsigned gs_good_features(const uint32_t *resp, unsigned w, unsigned h, unsigned quality,
+                                 unsigned min_dist, void *work, struct gs_keypoint *kps,
+                                 unsigned max_kps) {
+  gs_assert(resp && work && kps && w > 0 && h > 0);
+  GS_TRACE_BEGIN("gs_good_features", w * h);
+  uint32_t best = 0;
+  for (unsigned i = 0; i < w * h; i++) best = GS_MAX(best, resp[i]);
+  uint32_t threshold = GS_MAX((uint32_t)((uint64_t)best * quality / 1000), 1);
+  // 3x3 maxima, ties go to the first in scan order so no two candidates touch
+  uint64_t *cand = (uint64_t *)work;
+  unsigned nc = 0, n = 0;
+  for (unsigned y = 0; y < h; y++) {
+    for (unsigned x = 0; x < w; x++) {
+      uint32_t v = resp[y * w + x];
+      int peak = v >= threshold;
+      for (int dy = -1; dy <= 1 && peak; dy++) {
+        for (int dx = -1; dx <= 1 && peak; dx++) {
+          unsigned nx = x + dx, ny = y + dy;
+          if (nx >= w || ny >= h || (dx == 0 && dy == 0)) continue;
+          uint32_t u = resp[ny * w + nx];
+          peak = (dy < 0 || (dy == 0 && dx < 0)) ? v > u : v >= u;
+        }
+      }
+      if (peak) cand[nc++] = (uint64_t)v << 32 | (0xffffffffu - (y * w + x));
+    }
+  }
+  gs_sort_desc64(cand, nc);
+  unsigned cell = gs_features_cell(min_dist), reach = (min_dist + cell - 1) / cell;
+  unsigned gw = (w + cell - 1) / cell, gh = (h + cell - 1) / cell;
+  uint32_t *grid = (uint32_t *)(cand + (w + 1) / 2 * ((h + 1) / 2));
+  for (unsigned i = 0; i < gw * gh; i++) grid[i] = 0;
+  for (unsigned i = 0; i < nc && n < max_kps; i++) {
+    unsigned idx = 0xffffffffu - (uint32_t)cand[i], x = idx % w, y = idx / w;
+    unsigned gx = x / cell, gy = y / cell, ok = 1;
+    for (unsigned cy = gy > reach ? gy - reach : 0; cy <= gy + reach && cy < gh && ok; cy++) {
+      for (unsigned cx = gx > reach ? gx - reach : 0; cx <= gx + reach && cx < gw && ok; cx++) {
+        uint32_t k = grid[cy * gw + cx];
+        if (!k) continue;
+        int ddx = (int)kps[k - 1].pt.x - (int)x, ddy = (int)kps[k - 1].pt.y - (int)y;
+        ok = (unsigned)(ddx * ddx + ddy * ddy) >= min_dist * min_dist;
+      }
+    }
+    if (!ok) continue;
+    kps[n] = (struct gs_keypoint){{x, y}, (unsigned)(cand[i] >> 32), 0, {0}};
+    grid[gy * gw + gx] = ++n;
+  }
+  GS_TRACE_END("gs_good_features");
+  return n;
+}
+
+//
+// Streaming
+//
+GS_API unsigned gs_stream_size(const struct gs_stream *s) {
+  unsigned ow = s->downsample ? s->w / 2 : s->w, rows = s->blur ? 2 * s->blur + 1 : 0;
+  unsigned n = (s->blur ? ow : 0) * sizeof(unsigned);
+  if (s->blobs) n += 2 * s->max_blobs * sizeof(unsigned);
+  if (s->blobs) n += (2 * ow + s->max_blobs + 1) * sizeof(gs_label);
+  return n + (s->downsample ? s->w : 0) + rows * ow + ow;
+}
+
+// Splits work (gs_stream_size() bytes, aligned for unsigned) into the row buffers
+GS_API void gs_stream_init(struct gs_stream *s, void *work) {
+  gs_assert(s && work && s->w > 0 && s->h > 0 && (!s->blobs || s->max_blobs > 0));
+  gs_assert(s->max_blobs < 65535 && s->threshold < 256);
+  s->out_w = s->downsample ? s->w / 2 : s->w, s->out_h = s->downsample ? s->h / 2 : s->h;
+  gs_assert(s->out_w > 0 && s->out_h > 0);
+  unsigned *u = work, ow = s->out_w;
+  s->colsum = u, u += s->blur ? ow : 0;
+  s->cx = u, u += s->blobs ? s->max_blobs : 0;
+  s->cy = u, u += s->blobs ? s->max_blobs : 0;
+  gs_label *l = (gs_label *)u;
+  s->labels = l, l += s->blobs ? 2 * ow : 0;
+  s->parents = l, l += s->blobs ? s->max_blobs + 1 : 0;
+  uint8_t *b = (uint8_t *)l;
+  s->prev = b, b += s->downsample ? s->w : 0;
+  s->rows = b, b += s->blur ? (2 * s->blur + 1) * ow : 0;
+  s->out = b;
+  s->y = 0;
+}
+
+// A row of the processed frame, after downsample and blur
+static void gs_stream_emit(struct gs_stream *s, const uint8_t *row) {
+  unsigned w = s->out_w, y = s->out_y++;
+  if (s->hist)
+    for (unsigned x = 0; x < w; x++) s->hist[row[x]]++;
+  if (s->ii) {
+    unsigned sum = 0, *cur = &s->ii[y * w], *prev = y ? cur - w : 0;
+    for (unsigned x = 0; x < w; x++) sum += row[x], cur[x] = sum + (prev ? prev[x] : 0);
+  }
+  if (s->threshold >= 0) {
+    for (unsigned x = 0; x < w; x++) s->out[x] = row[x] > s->threshold ? 255 : 0;
+    row = s->out;
+  }
+  if (s->blobs) {
+    gs_label *top = &s->labels[(y + 1) % 2 * w], *cur = &s->labels[y % 2 * w];
+    s->next = gs_label_row(row, w, y, y ? top : 0, cur, s->blobs, s->max_blobs, s->next,
+                           s->parents, s->cx, s->cy);
+  }
+  if (s->row_cb) s->row_cb(s->arg, y, row);
+  if (y + 1 == s->out_h && s->blobs)
+    s->nblobs = gs_merge_blobs(s->blobs, s->next, s->parents, s->cx, s->cy);
+}
+
+// Output row y of the blur from the column sums of rows blur_top..y+r, as gs_blur() does
+static void gs_stream_blur_row(struct gs_stream *s, unsigned y) {
+  unsigned w = s->out_w, r = s->blur, n = s->blur_y - s->blur_top;
+  unsigned *colsum = s->colsum;
+  while (s->blur_top + r < y) {  // drop the row above the window
+    const uint8_t *old = &s->rows[s->blur_top++ % (2 * r + 1) * w];
+    for (unsigned x = 0; x < w; x++) colsum[x] -= old[x];
+    n--;
+  }
+  unsigned sum = 0;
+  for (unsigned x = 0; x < r && x < w; x++) sum += colsum[x];
+  for (unsigned x = 0; x < w; x++) {
+    if (x + r < w) sum += colsum[x + r];
+    if (x > r) sum -= colsum[x - r - 1];
+    unsigned cols = GS_MIN(x + r, w - 1) - (x > r ? x - r : 0) + 1;
+    s->out[x] = (uint8_t)(sum / (n * cols));
+  }
+  gs_stream_emit(s, s->out);
+}
+
+// Adds a row to the blur window and writes the rows that have all their neighbours
+static void gs_stream_blur(struct gs_stream *s, const uint8_t *row) {
+  unsigned w = s->out_w, r = s->blur, y = s->blur_y++;
+  uint8_t *slot = &s->rows[y % (2 * r + 1) * w];
+  // the row leaving the window shares the slot, drop it before overwriting
+  if (y >= 2 * r + 1 && s->blur_top <= y - (2 * r + 1)) {
+    for (unsigned x = 0; x < w; x++) s->colsum[x] -= slot[x];
+    s->blur_top++;
+  }
+  for (unsigned x = 0; x < w; x++) slot[x] = row[x], s->colsum[x] += row[x];
+  if (y >= r) gs_stream_blur_row(s, y - r);
+  if (y + 1 == s->out_h)
+    for (unsigned i = y >= r ? y - r + 1 : 0; i < s->out_h; i++) gs_stream_blur_row(s, i);
+}
+
+// Consumes the next row of w pixels, returns 1 when it completes the frame
+GS_API int gs_stream_push_row(struct gs_stream *s, const uint8_t *row) {
+  gs_assert(s && row && s->y < s->h);
+  unsigned y = s->y++, w = s->out_w;
+  if (y == 0) {  // new frame
+    s->blur_y = s->blur_top = s->out_y = 0, s->next = 1, s->nblobs = 0;
+    for (unsigned x = 0; s->blur && x < w; x++) s->colsum[x] = 0;
+    for (unsigned i = 0; s->hist && i < 256; i++) s->hist[i] = 0;
+    for (unsigned i = 0; s->blobs && i < s->max_blobs; i++)
+      s->blobs[i] = (struct gs_blob){0, 0, {UINT_MAX, UINT_MAX, 0, 0}, {0, 0}};
+    for (unsigned i = 0; s->blobs && i <= s->max_blobs; i++) s->parents[i] = i;
+  }
+  if (s->downsample) {
+    if (y % 2 == 0) {
+      gs_copy_bytes(s->prev, row, s->w);
+    } else if (y / 2 < s->out_h) {
+      for (unsigned x = 0; x < w; x++)
+        s->out[x] = (s->prev[2 * x] + s->prev[2 * x + 1] + row[2 * x] + row[2 * x + 1]) / 4;
+      row = s->out;
+    }
+  }
+  if (!s->downsample || (y % 2 == 1 && y / 2 < s->out_h)) {
+    if (s->blur)
+      gs_stream_blur(s, row);
+    else
+      gs_stream_emit(s, row);
+  }
+  if (s->y < s->h) return 0;
+  s->y = 0;
+  return 1;
+}
+
 #endif  // GRAYSKULL_H
@@ -1,6 +1,7 @@
 #include <assert.h>
 
 #include "grayskull.h"
+#include "examples/nanomagick/frontalface.h"
 
 static void test_crop(void) {
   uint8_t data[4 * 4] = {
@@ -21,6 +22,27 @@ static void test_crop(void) {
   gs_for(cropped, x, y) assert(cropped.data[y * cropped.w + x] == expected[y * cropped.w + x]);
 }
 
+static void test_crop_inplace(void) {
+  uint8_t data[5 * 4] = {
+      0,  1,  2,  3,  4,   //
+      5,  6,  7,  8,  9,   //
+      10, 11, 12, 13, 14,  //
+      15, 16, 17, 18, 19   //
+  };
+  struct gs_image img = {5, 4, data};
+  struct gs_image cropped = gs_crop_inplace(img, (struct gs_rect){1, 1, 3, 3});
+  uint8_t expected[3 * 3] = {6, 7, 8, 11, 12, 13, 16, 17, 18};
+  assert(cropped.w == 3 && cropped.h == 3 && cropped.data == data);
+  for (unsigned i = 0; i < 3 * 3; i++) assert(cropped.data[i] == expected[i]);
+
+  // full width rows go in one copy
+  uint8_t src_data[5 * 4], dst_data[5 * 2];
+  for (unsigned i = 0; i < 5 * 4; i++) src_data[i] = i;
+  struct gs_image src = {5, 4, src_data}, dst = {5, 2, dst_data};
+  gs_crop(dst, src, (struct gs_rect){0, 2, 5, 2});
+  for (unsigned i = 0; i < 5 * 2; i++) assert(dst.data[i] == 10 + i);
+}
+
 static void test_resize(void) {
   // Downscale: 4x4 -> 2x2
   uint8_t data_4x4[4 * 4] = {
@@ -348,8 +370,726 @@ static void test_template_matching(void) {
   assert(simple_best.x == 1 && simple_best.y == 1);
 }
 
+static void test_rgba(void) {
+  uint8_t rgba[4 * 2 * 4] = {
+      255, 0,   0,   255, 0,   255, 0,   255, 0,  0,  255, 255, 255, 255, 255, 255,  //
+      0,   0,   0,   255, 10,  20,  30,  0,   50, 50, 50,  255, 255, 255, 255, 0     //
+  };
+  uint8_t gray_data[4 * 2], half_data[2 * 1], back[4 * 2 * 4];
+  struct gs_image gray = {4, 2, gray_data}, half = {2, 1, half_data};
+  gs_rgba_to_gray(gray, rgba);
+  uint8_t expected[4 * 2] = {77, 149, 29, 255, 0, 18, 50, 255};
+  for (int i = 0; i < 4 * 2; i++) assert(gray_data[i] == expected[i]);
+  // convert and downsample in one pass
+  gs_rgba_to_gray_half(half, rgba, 4);
+  assert(half_data[0] == (77 + 149 + 0 + 18) / 4 && half_data[1] == (29 + 255 + 50 + 255) / 4);
+  gs_gray_to_rgba(back, gray);
+  for (int i = 0; i < 4 * 2; i++) {
+    assert(back[i * 4] == expected[i] && back[i * 4 + 1] == expected[i]);
+    assert(back[i * 4 + 2] == expected[i] && back[i * 4 + 3] == 255);
+  }
+}
+
+static void test_sensor_formats(void) {
+  // 37x3 pixels in rows of 40, wide enough for the SIMD loops and their tails
+  enum { FW = 37, FH = 3, FS = 40 };
+  uint8_t rgb[FS * FH * 3], yuyv[FS * FH * 2], gray[FW * FH], expected[FW * FH];
+  uint16_t rgb565[FS * FH];
+  struct gs_image img = {FW, FH, gray};
+  for (unsigned i = 0; i < sizeof(rgb); i++) rgb[i] = (i * 7919 + 13) % 256;
+  for (unsigned y = 0; y < FH; y++) {
+    for (unsigned x = 0; x < FW; x++) {
+      const uint8_t *p = &rgb[(y * FS + x) * 3];
+      expected[y * FW + x] = gs_luma(p[0], p[1], p[2]);
+    }
+  }
+  gs_rgb_to_gray(img, rgb, FS);
+  for (unsigned i = 0; i < FW * FH; i++) assert(gray[i] == expected[i]);
+
+  for (unsigned i = 0; i < FS * FH; i++) yuyv[i * 2] = rgb[i], yuyv[i * 2 + 1] = 128;
+  gs_yuyv_to_gray(img, yuyv, FS);
+  gs_for(img, x, y) assert(gray[y * FW + x] == rgb[y * FS + x]);
+  // UYVY through uyvy + 1 in a buffer that ends with the last luma byte, rows of 16 pixels
+  static uint8_t uyvy[16 * 2 * 2];
+  struct gs_image row16 = {16, 2, gray};
+  for (unsigned i = 0; i < 16 * 2; i++) uyvy[i * 2] = 128, uyvy[i * 2 + 1] = rgb[i];
+  gs_yuyv_to_gray(row16, uyvy + 1, 16);
+  for (unsigned i = 0; i < 16 * 2; i++) assert(gray[i] == rgb[i]);
+  gs_plane_to_gray(img, rgb, FS);
+  gs_for(img, x, y) assert(gray[y * FW + x] == rgb[y * FS + x]);
+  struct gs_image view = gs_yuv420_luma(rgb, FS, FH);
+  assert(view.data == rgb && view.w == FS && view.h == FH);
+
+  // 5 and 6 bit channels, full scale is 255
+  for (unsigned i = 0; i < FS * FH; i++) rgb565[i] = (uint16_t)(i * 2654435761u >> 7);
+  rgb565[0] = 0xffff, rgb565[1] = 0xf800, rgb565[2] = 0x07e0, rgb565[3] = 0x001f;
+  gs_rgb565_to_gray(img, rgb565, FS);
+  assert(gray[0] == 255 && gray[1] == 77 && gray[2] == 149 && gray[3] == 29);
+  gs_for(img, x, y) {
+    unsigned v = rgb565[y * FS + x], r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+    r = (r << 3) | (r >> 2), g = (g << 2) | (g >> 4), b = (b << 3) | (b >> 2);
+    assert(gray[y * FW + x] == gs_luma(r, g, b));
+  }
+
+  // Bayer: every pattern reads R, G, B from its own positions in the 2x2 cell
+  struct gs_image half = {FW / 2, 1, gray};
+  for (int pattern = GS_BAYER_RGGB; pattern <= GS_BAYER_BGGR; pattern++) {
+    gs_bayer_to_gray_half(half, rgb, FS, pattern);
+    for (unsigned x = 0; x < half.w; x++) {
+      uint8_t c[4] = {rgb[x * 2], rgb[x * 2 + 1], rgb[FS + x * 2], rgb[FS + x * 2 + 1]};
+      unsigned r = c[pattern], g = c[pattern ^ 1] + c[pattern ^ 2], b = c[3 - pattern];
+      assert(gray[x] == (77 * r + 75 * g + 29 * b + 128) >> 8);
+    }
+  }
+  uint8_t flat[4 * 4] = {
+      200, 100, 200, 100,  //
+      100, 50,  100, 50,   //
+      200, 100, 200, 100,  //
+      100, 50,  100, 50    //
+  };
+  uint8_t flat_gray[2 * 2];
+  gs_bayer_to_gray_half((struct gs_image){2, 2, flat_gray}, flat, 4, GS_BAYER_RGGB);
+  for (int i = 0; i < 4; i++) assert(flat_gray[i] == gs_luma(200, 100, 50));
+}
+
+static void test_refine_corners(void) {
+  uint8_t data[64 * 64];
+  struct gs_image img = {64, 64, data};
+  gs_for(img, x, y) data[y * 64 + x] = (x >= 20 && x < 50 && y >= 15 && y < 45) ? 200 : 30;
+  // rough corners, e.g. scaled up from a preview
+  struct gs_point c[4] = {{17, 18}, {53, 12}, {46, 41}, {23, 48}};
+  gs_refine_corners(img, c, 4, 6);
+  assert(c[0].x == 20 && c[0].y == 15);
+  assert(c[1].x == 49 && c[1].y == 15);
+  assert(c[2].x == 49 && c[2].y == 44);
+  assert(c[3].x == 20 && c[3].y == 44);
+  // a flat area has no corner, the point is left as is
+  struct gs_point flat = {5, 5};
+  gs_refine_corners(img, &flat, 1, 4);
+  assert(flat.x == 5 && flat.y == 5);
+}
+
+static void test_lbp_tiled(void) {
+  static unsigned ii[128 * 128];
+  struct gs_rect rects[100], tiled[100], tile;
+  struct gs_image img = gs_read_pgm("testdata/lena.pgm");
+  assert(gs_valid(img) && img.w == 128 && img.h == 128);
+  gs_integral(img, ii);
+  unsigned n = gs_lbp_detect(&frontalface, ii, img.w, img.h, rects, 100, GS_REAL(1.2f),
+                             GS_REAL(1.0f), GS_REAL(4.0f), 2);
+  assert(n > 0);
+
+  // 110x112 tiles with 96px overlap, every tile is within the image
+  unsigned ntiles = gs_lbp_tile(&frontalface, img.w, img.h, 110, 112, GS_REAL(4.0f), 2, 0, &tile);
+  assert(ntiles == 6);
+  for (unsigned i = 0; i < ntiles; i++) {
+    gs_lbp_tile(&frontalface, img.w, img.h, 110, 112, GS_REAL(4.0f), 2, i, &tile);
+    assert(tile.x % 2 == 0 && tile.y % 2 == 0);
+    assert(tile.x + tile.w <= img.w && tile.y + tile.h <= img.h);
+  }
+
+  // Same windows as the whole image, each found once
+  unsigned m = gs_lbp_detect_tiled(&frontalface, img, ii, 110, 112, tiled, 100, GS_REAL(1.2f),
+                                   GS_REAL(1.0f), GS_REAL(4.0f), 2);
+  assert(m == n);
+  for (unsigned i = 0; i < m; i++) {
+    unsigned j = 0;
+    while (j < n && (rects[j].x != tiled[i].x || rects[j].y != tiled[i].y ||
+                     rects[j].w != tiled[i].w || rects[j].h != tiled[i].h))
+      j++;
+    assert(j < n);
+  }
+  gs_free(img);
+}
+
+static void test_hough(void) {
+  static uint8_t data[64 * 48];
+  static uint16_t acc[180 * 200];
+  struct gs_point pts[256];
+  struct gs_image img = {64, 48, data};
+  for (unsigned i = 0; i < 64 * 48; i++) data[i] = 0;
+  for (unsigned x = 5; x < 55; x++) data[10 * 64 + x] = 255;         // rho 10, theta 90
+  for (unsigned y = 5; y < 45; y++) data[y * 64 + 40] = 255;         // rho 40, theta 0
+  for (unsigned i = 0; i < 25; i++) data[(20 + i) * 64 + 5 + i] = 255;  // theta 135
+  unsigned n = gs_edge_points(img, pts, 256);
+  assert(n == 50 + 40 + 25 - 1 && pts[0].x == 40 && pts[0].y == 5);
+  assert(gs_hough_size(64, 48, 1) <= sizeof(acc) / sizeof(acc[0]));
+  gs_hough(pts, n, 64, 48, 1, acc);
+  struct gs_line lines[4];
+  assert(gs_hough_lines(acc, 64, 48, 1, 20, 0, lines, 4) == 4);
+  assert(lines[0].rho == 10 && lines[0].theta == 90 && lines[0].votes == 50);
+  assert(lines[1].rho == 40 && lines[1].theta == 0 && lines[1].votes == 40);
+  // the vertical line also peaks at theta 178, where its pixels fall into fewer rho bins
+  assert(lines[2].rho == -39 && lines[2].theta == 178);
+  assert(gs_hough_lines(acc, 64, 48, 1, 20, 3, lines, 4) == 3);
+  assert(lines[0].rho == 10 && lines[0].theta == 90 && lines[0].votes == 50);
+  assert(lines[1].rho == 40 && lines[1].theta == 0 && lines[1].votes == 40);
+  assert(lines[2].rho == 11 && lines[2].theta == 135 && lines[2].votes == 25);
+  // coarser angles, only the strongest line
+  gs_hough(pts, n, 64, 48, 5, acc);
+  assert(gs_hough_lines(acc, 64, 48, 5, 20, 3, lines, 1) == 1 && lines[0].theta == 90);
+
+  // segments end on the last pixels of each line
+  struct gs_segment segs[8];
+  unsigned m = gs_hough_segments(img, pts, n, 1, acc, 12, 15, 2, segs, 8);
+  assert(m == 3);
+  for (unsigned i = 0; i < m; i++) {
+    struct gs_point a = segs[i].p0, b = segs[i].p1;
+    if (a.x > b.x || (a.x == b.x && a.y > b.y)) a = segs[i].p1, b = segs[i].p0;
+    assert((a.x == 5 && a.y == 10 && b.x == 54 && b.y == 10) ||
+           (a.x == 40 && a.y == 5 && b.x == 40 && b.y == 44) ||
+           (a.x == 5 && a.y == 20 && b.x == 29 && b.y == 44));
+  }
+  for (unsigned i = 0; i < 64 * 48; i++) assert(data[i] < 128);  // all pixels were used
+}
+
+// Finder pattern of 7x7 modules at module (mx, my) of a code at (ox, oy) with module size m
+static void draw_finder(struct gs_image img, unsigned ox, unsigned oy, unsigned m, unsigned mx,
+                        unsigned my) {
+  for (unsigned y = 0; y < 7 * m; y++) {
+    for (unsigned x = 0; x < 7 * m; x++) {
+      unsigned r = GS_MAX(GS_MAX(x / m, 6 - x / m), GS_MAX(y / m, 6 - y / m));
+      gs_set(img, ox + mx * m + x, oy + my * m + y, r == 5 ? 255 : 0);
+    }
+  }
+}
+
+static void test_qr(void) {
+  static uint8_t data[200 * 160], bits[25 * 160];
+  struct gs_image img = {200, 160, data}, packed = {200, 160, bits};
+  // 25 modules of 4 pixels at (30, 20), random data outside of the finders and their separators
+  uint32_t seed = 7;
+  for (unsigned i = 0; i < 200 * 160; i++) data[i] = 255;
+  for (unsigned my = 0; my < 25; my++) {
+    for (unsigned mx = 0; mx < 25; mx++) {
+      seed = seed * 1103515245 + 12345;
+      if ((mx < 8 && my < 8) || (mx > 16 && my < 8) || (mx < 8 && my > 16)) continue;
+      for (unsigned i = 0; i < 16; i++)
+        gs_set(img, 30 + mx * 4 + i % 4, 20 + my * 4 + i / 4, (seed >> 16) & 1 ? 0 : 255);
+    }
+  }
+  draw_finder(img, 30, 20, 4, 0, 0);
+  draw_finder(img, 30, 20, 4, 18, 0);
+  draw_finder(img, 30, 20, 4, 0, 18);
+  for (unsigned i = 0; i < 25 * 160; i++) bits[i] = 0;
+  gs_for(img, x, y) bits[y * 25 + x / 8] |= (data[y * 200 + x] >= 128) << (7 - x % 8);
+
+  struct gs_finder f[8], fp[8];
+  unsigned n = gs_qr_finders(img, 0, 2, f, 8);
+  assert(n == 3 && gs_qr_finders(packed, 1, 2, fp, 8) == 3);
+  for (unsigned i = 0; i < n; i++) {
+    assert(f[i].center.x == fp[i].center.x && f[i].center.y == fp[i].center.y);
+    assert(f[i].count >= 2 && f[i].size >= 27 && f[i].size <= 29);
+  }
+  struct gs_qr qr[2];
+  assert(gs_qr_locate(f, n, 200, 160, qr, 2) == 1 && qr[0].modules == 25);
+  struct gs_point c[4] = {{30, 20}, {129, 20}, {129, 119}, {30, 119}};
+  for (int i = 0; i < 4; i++) {
+    assert(qr[0].corners[i].x + 2 >= c[i].x && qr[0].corners[i].x <= c[i].x + 2);
+    assert(qr[0].corners[i].y + 2 >= c[i].y && qr[0].corners[i].y <= c[i].y + 2);
+  }
+  // smaller modules than min_module may be skipped, but no finders are made up
+  assert(gs_qr_finders(img, 0, 8, f, 8) <= 3);
+}
+
+static void test_barcode(void) {
+  static uint8_t data[160 * 120], cdata[20 * 15];
+  struct gs_image img = {160, 120, data}, cells = {20, 15, cdata};
+  uint32_t seed = 3;
+  gs_for(img, x, y) {
+    seed = seed * 1103515245 + 12345;
+    data[y * 160 + x] = 120 + (seed >> 28);  // weak noise
+  }
+  // a checkerboard of 4x4 squares, strong edges in both directions
+  for (unsigned y = 80; y < 112; y++)
+    for (unsigned x = 4; x < 36; x++) data[y * 160 + x] = (x / 4 + y / 4) % 2 ? 20 : 230;
+  // vertical bars of 1 to 4 pixels
+  for (unsigned x = 40, bar = 0; x < 120; bar++) {
+    seed = seed * 1103515245 + 12345;
+    for (unsigned w = 1 + (seed >> 30); w > 0 && x < 120; w--, x++)
+      for (unsigned y = 30; y < 90; y++) data[y * 160 + x] = bar % 2 ? 230 : 20;
+  }
+  gs_label labels[20 * 15];
+  struct gs_blob blobs[8];
+  assert(gs_barcode_regions(img, cells, labels, blobs, 8, 200, 8) == 1);
+  struct gs_rect b = blobs[0].box;
+  assert(b.x >= 32 && b.x <= 48 && b.x + b.w >= 112 && b.x + b.w <= 128);
+  assert(b.y >= 24 && b.y <= 40 && b.y + b.h >= 80 && b.y + b.h <= 96);
+  // one large cell of strong bars, its gradient sums squared would not fit in 64 bits
+  static uint8_t bars[400 * 400];
+  struct gs_image big = {400, 400, bars}, one = {1, 1, cdata};
+  gs_for(big, x, y) bars[y * 400 + x] = x / 2 % 2 ? 255 : 0;
+  gs_barcode_cells(one, big);
+  assert(cdata[0] >= 250);
+}
+
+static void test_hog(void) {
+  static uint8_t data[128 * 96], work[128 * 96 * 8];
+  unsigned hist[4 * 9];
+  uint8_t blocks[36];
+  // diagonal, horizontal and vertical edges each fall into a single bin, diagonal ones only away
+  // from the image border where gradients are one-sided
+  struct gs_image img = {16, 16, data};
+  const unsigned bins[3] = {2, 4, 0};
+  for (int k = 0; k < 3; k++) {
+    gs_for(img, x, y) data[y * 16 + x] = (k == 2 ? x : k == 1 ? y : x + y) >= 8 ? 200 : 50;
+    gs_hog_cells(img, 8, hist);
+    for (unsigned i = 0; i < (k ? 4 * 9 : 9); i++) assert(hist[i] == 0 || i % 9 == bins[k]);
+    assert(hist[bins[k]] > 0);
+  }
+  // four equal values clipped at 0.2, then scaled to a unit norm again
+  gs_hog_blocks(hist, 2, 2, blocks);
+  for (unsigned i = 0; i < 36; i++) assert(blocks[i] == (i % 9 == 0 ? 126 : 0));
+
+  // a bright vertical bar, windows of 4x4 cells score the vertical edges they cover
+  img = (struct gs_image){128, 96, data};
+  gs_for(img, x, y) data[y * 128 + x] = x >= 60 && x < 68 ? 220 : 30;
+  static int8_t weights[3 * 3 * 36];
+  for (unsigned i = 0; i < sizeof(weights); i++) weights[i] = i % 9 == 0 ? 1 : -1;
+  struct gs_hog_model m = {8, 4, 4, weights, -1000};
+  assert(gs_hog_size(&m, 128, 96) <= sizeof(work));
+  struct gs_rect rects[64];
+  unsigned n = gs_hog_detect_scale(&m, img, GS_REAL(1), work, 0, rects, 64);
+  assert(n > 0);
+  for (unsigned i = 0; i < n; i++) {
+    assert(rects[i].w == 32 && rects[i].h == 32 && rects[i].x < 68 && rects[i].x + 32 > 60);
+  }
+  n = gs_hog_detect(&m, img, work, 0, rects, 64, GS_REAL(2), GS_REAL(1), GS_REAL(2));
+  assert(n > 0 && rects[n - 1].w == 64);
+  for (unsigned i = 0; i < n; i++) assert(rects[i].x < 68 && rects[i].x + rects[i].w > 60);
+}
+
+static void test_stereo(void) {
+  enum { SW = 96, SH = 64 };
+  struct gs_image lena = gs_read_pgm("testdata/lena.pgm");
+  assert(gs_valid(lena));
+  static uint8_t ldata[SW * SH], rdata[SW * SH];
+  static uint32_t lc[SW * SH], rc[SW * SH];
+  static uint64_t lc64[SW * SH], rc64[SW * SH];
+  static int16_t disp[SW * SH];
+  static uint16_t work[2 * SW * 32 + SW];
+  struct gs_image left = {SW, SH, ldata}, right = {SW, SH, rdata};
+  // background at disparity 4, a box at (36, 20) of 30x24 pixels in front at disparity 10
+  gs_for(left, x, y) {
+    int fg = x >= 36 && x < 66 && y >= 20 && y < 44;
+    ldata[y * SW + x] = fg ? gs_get(lena, 30 + x, 60 + y) : gs_get(lena, 10 + x, 40 + y);
+    int rfg = x + 10 >= 36 && x + 10 < 66 && y >= 20 && y < 44;
+    rdata[y * SW + x] = rfg ? gs_get(lena, 40 + x, 60 + y) : gs_get(lena, 14 + x, 40 + y);
+  }
+  assert(gs_stereo_size(SW, 32) <= sizeof(work));
+  gs_census5x5(left, lc);
+  gs_census5x5(right, rc);
+  gs_census7x9(left, lc64);
+  gs_census7x9(right, rc64);
+  for (int k = 0; k < 2; k++) {
+    if (k == 0) gs_stereo_bm(lc, rc, SW, SH, 32, 3, 5, work, disp);
+    if (k == 1) gs_stereo_bm64(lc64, rc64, SW, SH, 32, 2, 5, work, disp);
+    unsigned good = 0, total = 0;
+    gs_for(left, x, y) {
+      int fg = x >= 40 && x < 62 && y >= 24 && y < 40;
+      int bg = x >= 8 && (x < 28 || x >= 74 || y < 12 || y >= 52);
+      if (!fg && !bg) continue;
+      int d = disp[y * SW + x] - (fg ? 10 : 4) * GS_DISP_SCALE;
+      total++, good += d >= -2 && d <= 2;
+    }
+    assert(good * 10 >= total * 9);
+    // background left of the box is hidden behind it in the right image and has no match
+    unsigned invalid = 0;
+    for (unsigned y = 24; y < 40; y++)
+      for (unsigned x = 30; x < 36; x++) invalid += disp[y * SW + x] == GS_DISP_INVALID;
+    assert(invalid * 2 >= 16 * 6);
+  }
+
+  // half a pixel shift of a blurred image is found by the parabola
+  gs_blur(right, left, 1);
+  gs_for(left, x, y) ldata[y * SW + x] = rdata[y * SW + x];
+  gs_for(left, x, y) {
+    unsigned a = ldata[y * SW + GS_MIN(x + 2, SW - 1)], b = ldata[y * SW + GS_MIN(x + 3, SW - 1)];
+    rdata[y * SW + x] = (uint8_t)((a + b + 1) / 2);
+  }
+  gs_census5x5(left, lc);
+  gs_census5x5(right, rc);
+  gs_stereo_bm(lc, rc, SW, SH, 16, 3, 0, work, disp);
+  int sum = 0, n = 0;
+  for (unsigned y = 8; y < SH - 8; y++)
+    for (unsigned x = 20; x < SW - 8; x++)
+      if (disp[y * SW + x] != GS_DISP_INVALID) sum += disp[y * SW + x], n++;
+  assert(n > 0 && sum >= n * 38 && sum <= n * 42);
+  gs_free(lena);
+}
+
+#ifndef GS_NO_FLOAT
+static void test_mosse(void) {
+  enum { FW = 96, FH = 96 };
+  struct gs_image lena = gs_read_pgm("testdata/lena.pgm");
+  assert(gs_valid(lena));
+  static uint8_t data[FW * FH];
+  static float work[7 * 32 * 32 + 2 * 32 + 256];
+  struct gs_image frame = {FW, FH, data};
+  // the content moves by (ox, oy) from frame to frame, a box of 32x32 and one of 48x48 pixels
+  static const int path[][2] = {{0, 0}, {3, -2}, {6, -3}, {8, 0}, {9, 3}, {7, 6}};
+  for (unsigned size = 32; size <= 48; size += 16) {
+    struct gs_mosse t = {.n = 32, .rate = 0.125f, .min_psr = 7};
+    assert(gs_mosse_size(&t) == sizeof(work));
+    for (unsigned i = 0; i < sizeof(path) / sizeof(path[0]); i++) {
+      int ox = path[i][0], oy = path[i][1];
+      gs_for(frame, x, y) data[y * FW + x] = gs_get(lena, (unsigned)(16 + (int)x - ox),
+                                                     (unsigned)(16 + (int)y - oy));
+      if (i == 0) {
+        gs_mosse_init(&t, work, frame, (struct gs_rect){24, 24, size, size});
+        continue;
+      }
+      assert(gs_mosse_update(&t, frame) == 1 && t.psr >= 7);
+      int dx = (int)t.box.x - (24 + ox), dy = (int)t.box.y - (24 + oy);
+      assert(dx >= -1 && dx <= 1 && dy >= -1 && dy <= 1);
+    }
+    // noise has no clear peak, the target is lost and the box stays
+    struct gs_rect box = t.box;
+    unsigned seed = 1;
+    gs_for(frame, x, y) data[y * FW + x] = (uint8_t)((seed = seed * 1103515245 + 12345) >> 24);
+    assert(gs_mosse_update(&t, frame) == 0 && t.psr < 7);
+    assert(t.box.x == box.x && t.box.y == box.y);
+  }
+  gs_free(lena);
+}
+#endif
+
+static void test_motion(void) {
+  enum { FW = 96, FH = 96 };
+  struct gs_image lena = gs_read_pgm("testdata/lena.pgm");
+  assert(gs_valid(lena));
+  static uint8_t adata[FW * FH], bdata[FW * FH];
+  static uint32_t arows[FH], acols[FW], brows[FH], bcols[FW];
+  struct gs_image a = {FW, FH, adata}, b = {FW, FH, bdata};
+  // the content of b moves by (6, -3) pixels, then by half a pixel more to the right
+  gs_for(a, x, y) {
+    adata[y * FW + x] = gs_get(lena, 16 + x, 16 + y);
+    bdata[y * FW + x] = gs_get(lena, 10 + x, 19 + y);
+  }
+  gs_projections(a, arows, acols);
+  gs_projections(b, brows, bcols);
+  uint32_t row = 0, col = 0;
+  for (unsigned i = 0; i < FW; i++) row += adata[5 * FW + i], col += adata[i * FW + 7];
+  assert(arows[5] == row && acols[7] == col);
+  int dx = gs_projection_shift(acols, bcols, FW, 16);
+  int dy = gs_projection_shift(arows, brows, FH, 16);
+  assert(dx >= 6 * GS_SHIFT_SCALE - 8 && dx <= 6 * GS_SHIFT_SCALE + 8);
+  assert(dy >= -3 * GS_SHIFT_SCALE - 8 && dy <= -3 * GS_SHIFT_SCALE + 8);
+  gs_for(b, x, y) {
+    unsigned l = gs_get(lena, 10 + x, 19 + y), r = gs_get(lena, 9 + x, 19 + y);
+    bdata[y * FW + x] = (uint8_t)((l + r + 1) / 2);
+  }
+  gs_projections(b, brows, bcols);
+  dx = gs_projection_shift(acols, bcols, FW, 16);
+  assert(dx >= 13 * GS_SHIFT_SCALE / 2 - 6 && dx <= 13 * GS_SHIFT_SCALE / 2 + 6);
+#ifndef GS_NO_FLOAT
+  // phase correlation on the full 64x64 grid and on 32x32 cell means of 3x3 pixels
+  static float work[4 * 64 * 64 + 2 * 64];
+  gs_for(b, x, y) bdata[y * FW + x] = gs_get(lena, 10 + x, 19 + y);
+  for (unsigned n = 32; n <= 64; n *= 2) {
+    struct gs_image ca = a, cb = b;
+    if (n == 64) ca.w = ca.h = cb.w = cb.h = 64;
+    assert(gs_phase_size(n) <= sizeof(work));
+    float fx, fy, peak;
+    if (n == 64) {
+      static uint8_t a64[64 * 64], b64[64 * 64];
+      gs_for(ca, x, y) a64[y * 64 + x] = adata[y * FW + x], b64[y * 64 + x] = bdata[y * FW + x];
+      ca.data = a64, cb.data = b64;
+    }
+    peak = gs_phase_correlate(ca, cb, n, work, &fx, &fy);
+    assert(peak > 0.2f && peak <= 1.0f);
+    assert(fx > 5.0f && fx < 7.0f && fy > -4.0f && fy < -2.0f);
+  }
+#endif
+  gs_free(lena);
+}
+
+static void stream_row(void *arg, unsigned y, const uint8_t *row) {
+  struct gs_image *img = arg;
+  for (unsigned x = 0; x < img->w; x++) img->data[y * img->w + x] = row[x];
+}
+
+// Streams src row by row and compares with the whole-image functions
+static void check_stream(struct gs_image src, unsigned downsample, unsigned blur, int threshold) {
+  static uint8_t buf[3][128 * 128], work[16384];
+  static unsigned hist[256], ii[128 * 128], ref_hist[256], ref_ii[128 * 128];
+  static gs_label labels[128 * 128];
+  struct gs_blob blobs[64], ref_blobs[64];
+  struct gs_image ref = {downsample ? src.w / 2 : src.w, downsample ? src.h / 2 : src.h, buf[0]};
+  struct gs_image out = {ref.w, ref.h, buf[1]}, tmp = {ref.w, ref.h, buf[2]};
+  if (downsample)
+    gs_downsample(ref, src);
+  else
+    gs_copy(ref, src);
+  if (blur) gs_copy(tmp, ref), gs_blur(ref, tmp, blur);
+  gs_histogram(ref, ref_hist);
+  gs_integral(ref, ref_ii);
+  if (threshold >= 0) gs_threshold(ref, threshold);
+  unsigned nref = gs_blobs(ref, labels, ref_blobs, 64);
+
+  struct gs_stream s = {.w = src.w, .h = src.h, .downsample = downsample, .blur = blur,
+                        .threshold = threshold, .hist = hist, .ii = ii, .blobs = blobs,
+                        .max_blobs = 64, .row_cb = stream_row, .arg = &out};
+  assert(gs_stream_size(&s) <= sizeof(work));
+  gs_stream_init(&s, work);
+  for (int frame = 0; frame < 2; frame++)  // state is reset for every frame
+    for (unsigned y = 0; y < src.h; y++)
+      assert(gs_stream_push_row(&s, &src.data[y * src.w]) == (y + 1 == src.h));
+  for (unsigned i = 0; i < ref.w * ref.h; i++) assert(out.data[i] == ref.data[i]);
+  for (unsigned i = 0; i < ref.w * ref.h; i++) assert(ii[i] == ref_ii[i]);
+  for (unsigned i = 0; i < 256; i++) assert(hist[i] == ref_hist[i]);
+  assert(s.nblobs == nref);
+  for (unsigned i = 0; i < nref; i++) {
+    assert(blobs[i].label == ref_blobs[i].label && blobs[i].area == ref_blobs[i].area);
+    assert(blobs[i].box.x == ref_blobs[i].box.x && blobs[i].box.w == ref_blobs[i].box.w);
+    assert(blobs[i].box.y == ref_blobs[i].box.y && blobs[i].box.h == ref_blobs[i].box.h);
+    assert(blobs[i].centroid.x == ref_blobs[i].centroid.x);
+    assert(blobs[i].centroid.y == ref_blobs[i].centroid.y);
+  }
+}
+
+static void test_stream(void) {
+  struct gs_image img = gs_read_pgm("testdata/lena.pgm");
+  assert(gs_valid(img));
+  check_stream(img, 0, 0, -1);
+  check_stream(img, 0, 2, 110);
+  check_stream(img, 1, 1, 100);
+  check_stream(img, 1, 0, 90);
+  gs_free(img);
+  uint8_t data[37 * 23];
+  for (unsigned i = 0; i < 37 * 23; i++) data[i] = (i * 7919) % 251;
+  struct gs_image odd = {37, 23, data};
+  check_stream(odd, 1, 3, 128);
+  check_stream(odd, 0, 30, 120);  // window larger than the image
+  check_stream((struct gs_image){37, 1, data}, 0, 2, 100);
+}
+
+// gs_real values in thousandths, the same in float and GS_NO_FLOAT builds
+static int milli(gs_real v) { return GS_REAL_INT(v * 1000); }
+#define assert_near(a, b) assert((a) - (b) <= 2 && (b) - (a) <= 2)
+
+static void test_orientation(void) {
+  assert(milli(gs_sin(0)) == 0);
+  assert_near(milli(gs_sin(GS_REAL(1.5708f))), 1000);
+  assert_near(milli(gs_sin(GS_REAL(-0.5236f))), -500);
+  assert_near(milli(gs_sin(GS_REAL(7.3304f))), 866);  // 2 pi + pi / 3
+  assert_near(milli(gs_atan2(1, 1)), 785);
+  assert_near(milli(gs_atan2(-3, -3)), -2356);
+  assert_near(milli(gs_atan2(0, -5)), 3141);
+  assert_near(milli(gs_atan2(-20000, 1)), -1570);
+
+  // intensity centroid points to the bright side
+  uint8_t data[31 * 31];
+  struct gs_image img = {31, 31, data};
+  gs_for(img, x, y) data[y * 31 + x] = x * 8;
+  assert_near(milli(gs_compute_orientation(img, 15, 15, 15)), 0);
+  gs_for(img, x, y) data[y * 31 + x] = y * 8;
+  assert_near(milli(gs_compute_orientation(img, 15, 15, 15)), 1570);
+  gs_for(img, x, y) data[y * 31 + x] = 240 - x * 8;
+  assert_near(milli(gs_compute_orientation(img, 15, 15, 15)), 3141);
+}
+
+static void test_skew(void) {
+  enum { PW = 240, PH = 200 };
+  static uint8_t page[PW * PH], rotated[PW * PH], back[PW * PH];
+  static uint32_t work[PW + PH + 8 + PW / 8 * PH / 4];
+  struct gs_image a = {PW, PH, page}, b = {PW, PH, rotated}, c = {PW, PH, back};
+  assert(gs_skew_size(PW, PH) <= sizeof(work));
+  // lines of words 5 pixels tall every 12 pixels, with a margin that stays inside when rotated
+  unsigned seed = 7;
+  gs_for(a, x, y) page[y * PW + x] = 255;
+  for (unsigned y = 30; y + 5 < PH - 30; y += 12) {
+    for (unsigned x = 30; x < PW - 30;) {
+      unsigned len = 8 + ((seed = seed * 1103515245 + 12345) >> 16) % 24;
+      for (unsigned i = 0; i < len && x + i < PW - 30; i++)
+        for (unsigned j = 0; j < 5; j++) page[(y + j) * PW + x + i] = 0;
+      x += len + 4;
+    }
+  }
+  assert(milli(gs_skew(a, 10, work)) == 0);
+  // rotation by 0 keeps the page, by 3 degrees both ways is found and undone
+  gs_rotate(b, a, 0, 255);
+  gs_for(a, x, y) assert(rotated[y * PW + x] + 1 >= page[y * PW + x] &&
+                         rotated[y * PW + x] <= page[y * PW + x] + 1);
+  for (int sign = -1; sign <= 1; sign += 2) {
+    gs_rotate(b, a, sign * GS_REAL(0.05236f), 255);
+    gs_real skew = gs_skew(b, 10, work);
+    assert(milli(skew) - sign * 52 <= 3 && sign * 52 - milli(skew) <= 3);
+    gs_rotate(c, b, -skew, 255);
+    unsigned same = 0;
+    gs_for(a, x, y) same += (back[y * PW + x] < 128) == (page[y * PW + x] < 128);
+    assert(same * 100 >= PW * PH * 98);
+  }
+  // a point right of the center moves down by 90 degrees
+  gs_for(a, x, y) page[y * PW + x] = (x == PW / 2 + 40 && y == PH / 2) ? 0 : 255;
+  gs_rotate(b, a, GS_REAL(1.570796f), 255);
+  unsigned best = 0;
+  gs_for(b, x, y) if (rotated[y * PW + x] < rotated[best]) best = y * PW + x;
+  assert(best % PW >= PW / 2 - 1 && best % PW <= PW / 2 + 1);
+  assert(best / PW >= PH / 2 + 39 && best / PW <= PH / 2 + 41);
+}
+
+static void test_thin(void) {
+  enum { TW = 70, TH = 50 };
+  static uint8_t data[TW * TH], orig[TW * TH], unpacked[TW * TH], bits[(TW + 7) / 8 * TH];
+  static uint8_t rows[(TW + 7) / 8 * 2];
+  static uint32_t list[TW * TH];
+  struct gs_image img = {TW, TH, data}, up = {TW, TH, unpacked}, packed = {TW, TH, bits};
+  // a bar 7 pixels thick, a ring of radius 8 to 13 and a thick diagonal touching the border
+  gs_for(img, x, y) {
+    int dx = (int)x - 50, dy = (int)y - 20, r2 = dx * dx + dy * dy;
+    int bar = x >= 5 && x < 35 && y >= 5 && y < 12, ring = r2 >= 64 && r2 <= 169;
+    int diag = (int)x - (int)y >= -3 && (int)x - (int)y <= 3 && y >= 25;
+    orig[y * TW + x] = data[y * TW + x] = (bar || ring || diag) ? 200 : 30;
+  }
+  for (int method = GS_ZHANG_SUEN; method <= GS_GUO_HALL; method++) {
+    gs_copy(img, (struct gs_image){TW, TH, orig});
+    assert(gs_thin(img, method, list, 10) == -1);
+    gs_copy(img, (struct gs_image){TW, TH, orig});
+    gs_pack_bits(bits, img);
+    int removed = gs_thin(img, method, list, TW * TH);
+    assert(removed > 0 && (unsigned)removed == gs_thin_packed(packed, method, rows));
+    gs_unpack_bits(up, bits);
+    unsigned bar = 0, ring = 0;
+    gs_for(img, x, y) {
+      uint8_t v = data[y * TW + x];
+      assert((v == 0 || v == 255) && v == unpacked[y * TW + x] && (!v || orig[y * TW + x] > 128));
+      // one pixel wide, no 2x2 squares left
+      const uint8_t *d = &data[y * TW + x];
+      if (x + 1 < TW && y + 1 < TH) assert(!(v && d[1] && d[TW] && d[TW + 1]));
+      bar += v && y < 12 && x < 35, ring += v && x > 36 && y < 34;
+    }
+    // the bar shrinks to a line of about its length, the ring to a loop around its hole
+    assert(bar >= 20 && bar <= 32 && ring >= 50 && ring <= 80);
+    unsigned left = 0;
+    for (unsigned x = 38; x <= 43; x++) left += data[20 * TW + x] != 0;
+    assert(!data[20 * TW + 50] && left == 1);
+    // a skeleton is stable
+    gs_copy(up, img);
+    assert(gs_thin(img, method, list, TW * TH) == 0 && memcmp(data, unpacked, TW * TH) == 0);
+  }
+}
+
+static void test_flood_fill(void) {
+  enum { FW = 61, FH = 47 };
+  static uint8_t data[FW * FH], ref[FW * FH], seen[FW * FH];
+  static unsigned queue[FW * FH];
+  static struct gs_span stack[256];
+  struct gs_image img = {FW, FH, data};
+  // random blocky levels, compared with a breadth-first fill
+  unsigned seed = 11;
+  for (int k = 0; k < 8; k++) {
+    gs_for(img, x, y) {
+      if (x % 3 == 0 && y % 2 == 0) seed = seed * 1103515245 + 12345;
+      data[y * FW + x] = (uint8_t)(((seed >> 16) % 4) * 40 + (x == 0 ? 10 : 0));
+    }
+    memcpy(ref, data, sizeof(ref));
+    memset(seen, 0, sizeof(seen));
+    unsigned sx = (k * 17) % FW, sy = (k * 11) % FH, head = 0, tail = 0, tol = k % 2 ? 45 : 0;
+    int eight = k / 2 % 2, v0 = ref[sy * FW + sx], filled = 0;
+    queue[tail++] = sy * FW + sx, seen[sy * FW + sx] = 1;
+    while (head < tail) {
+      unsigned i = queue[head++], x = i % FW, y = i / FW;
+      ref[i] = 255, filled++;
+      for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+          unsigned nx = x + dx, ny = y + dy, j = ny * FW + nx;
+          if (nx >= FW || ny >= FH || seen[j] || (!eight && dx && dy)) continue;
+          if (ref[j] + tol < (unsigned)v0 || ref[j] > v0 + tol) continue;
+          seen[j] = 1, queue[tail++] = j;
+        }
+      }
+    }
+    assert(gs_flood_fill(img, sx, sy, 255, tol, eight, stack, 256) == filled);
+    assert(memcmp(data, ref, sizeof(ref)) == 0);
+  }
+  // no spans left for a region with many runs, a value within the tolerance fills nothing
+  gs_for(img, x, y) data[y * FW + x] = (x % 2 && y % 4) ? 200 : 0;
+  assert(gs_flood_fill(img, 0, 0, 255, 0, 0, stack, 4) == -1);
+  assert(gs_flood_fill(img, 1, 1, 210, 20, 0, stack, 256) == 0 && data[FW + 1] == 200);
+  // rings with holes, one of them open to the border, and a hole in a hole
+  gs_for(img, x, y) {
+    unsigned d = GS_MAX(gs_absdiff(x, 15), gs_absdiff(y, 20));
+    unsigned e = GS_MAX(gs_absdiff(x, 45), gs_absdiff(y, 20));
+    data[y * FW + x] = (d >= 8 && d <= 10) || d <= 3 || (e >= 4 && e <= 6 && y < 20) ? 180 : 20;
+  }
+  memcpy(ref, data, sizeof(ref));
+  assert(gs_fill_holes(img, stack, 256) == 15 * 15 - 7 * 7);
+  gs_for(img, x, y) {
+    unsigned d = GS_MAX(gs_absdiff(x, 15), gs_absdiff(y, 20));
+    assert(data[y * FW + x] == ((d <= 10 || ref[y * FW + x] > 128) ? 255 : 0));
+  }
+}
+
+static void test_corners(void) {
+  enum { CW = 80, CH = 60 };
+  static uint8_t data[CW * CH];
+  static uint32_t resp[CW * CH], work[6 * CW], fwork[(CW / 2) * (CH / 2) * 2 + CW * CH];
+  struct gs_image img = {CW, CH, data};
+  // two bright squares, one touching the right border so it has a single vertical edge there
+  gs_for(img, x, y) {
+    int a = x >= 10 && x < 30 && y >= 15 && y < 40, b = x >= 50 && y >= 10 && y < 50;
+    data[y * CW + x] = (a || b) ? 200 : 40 + (x * 7 + y * 3) % 5;
+  }
+  for (int method = GS_HARRIS; method <= GS_SHI_TOMASI; method++) {
+    for (unsigned r = 1; r <= 3; r += 2) {
+      gs_corners(img, r, method, work, resp);
+      // window sums against direct ones at a few pixels
+      unsigned px[4][2] = {{10, 15}, {29, 39}, {20, 15}, {40, 30}};
+      for (unsigned k = 0; k < 4; k++) {
+        int64_t a = 0, b = 0, c = 0, area = (2 * r + 1) * (2 * r + 1), v;
+        for (unsigned y = px[k][1] - r; y <= px[k][1] + r; y++) {
+          for (unsigned x = px[k][0] - r; x <= px[k][0] + r; x++) {
+            const uint8_t *p = &data[y * CW + x];
+            int gx = p[-CW + 1] - p[-CW - 1] + 2 * (p[1] - p[-1]) + p[CW + 1] - p[CW - 1];
+            int gy = p[CW - 1] - p[-CW - 1] + 2 * (p[CW] - p[-CW]) + p[CW + 1] - p[-CW + 1];
+            a += gx * gx, b += gx * gy, c += gy * gy;
+          }
+        }
+        if (method == GS_HARRIS) {
+          v = ((a * c - b * b - (a + c) * (a + c) / 25) / area / area) >> 8;
+        } else {
+          int64_t s = 0;
+          while ((s + 1) * (s + 1) <= (a - c) * (a - c) + 4 * b * b) s++;
+          v = (a + c - s) / (2 * area);
+        }
+        assert(resp[px[k][1] * CW + px[k][0]] == (uint32_t)GS_MAX(v, 0));
+      }
+      for (unsigned y = 0; y < CH; y++) assert(!resp[y * CW + r] && !resp[y * CW + CW - 1 - r]);
+      // the straight edge of the right square hardly responds
+      uint32_t best = 0;
+      for (unsigned i = 0; i < CW * CH; i++) best = GS_MAX(best, resp[i]);
+      assert(resp[30 * CW + 50] * 100 < best);
+    }
+    // the corners of the squares, a bit inside with the radius 3 window, strongest first
+    struct gs_keypoint kps[16];
+    assert(gs_features_size(CW, CH, 8) <= sizeof(fwork));
+    unsigned n = gs_good_features(resp, CW, CH, 100, 8, fwork, kps, 16);
+    struct gs_point expect[6] = {{10, 15}, {29, 15}, {10, 39}, {29, 39}, {50, 10}, {50, 49}};
+    assert(n == 6);
+    for (unsigned i = 0; i < n; i++) {
+      unsigned found = 0;
+      for (unsigned j = 0; j < 6; j++) {
+        unsigned dx = gs_absdiff(kps[i].pt.x, expect[j].x);
+        found |= dx <= 2 && gs_absdiff(kps[i].pt.y, expect[j].y) <= 2;
+      }
+      assert(found && (i == 0 || kps[i].response <= kps[i - 1].response));
+    }
+    // a distance larger than the sides of the squares keeps fewer corners, all far apart
+    n = gs_good_features(resp, CW, CH, 100, 30, fwork, kps, 16);
+    assert(n >= 2 && n < 6);
+    for (unsigned i = 0; i < n; i++) {
+      for (unsigned j = 0; j < i; j++) {
+        int dx = (int)kps[i].pt.x - (int)kps[j].pt.x, dy = (int)kps[i].pt.y - (int)kps[j].pt.y;
+        assert(dx * dx + dy * dy >= 30 * 30);
+      }
+    }
+  }
+}
+
 int main(void) {
   test_crop();
+  test_crop_inplace();
   test_resize();
   test_blur();
   test_histogram();
@@ -362,5 +1102,24 @@ int main(void) {
   test_trace_contour();
   test_integral();
   test_template_matching();
+  test_rgba();
+  test_sensor_formats();
+  test_refine_corners();
+  test_lbp_tiled();
+  test_orientation();
+  test_stream();
+  test_hough();
+  test_qr();
+  test_barcode();
+  test_hog();
+  test_stereo();
+#ifndef GS_NO_FLOAT
+  test_mosse();
+#endif
+  test_motion();
+  test_skew();
+  test_thin();
+  test_flood_fill();
+  test_corners();
   return 0;
 }